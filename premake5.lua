@@ -98,3 +98,50 @@ project "Compiler"
 			"UNICODE",
 			"_CRT_SECURE_NO_WARNINGS",
 		}
+
+
+-----------------------------------------
+-- LEXER BENCHMARK
+-----------------------------------------
+
+-- premake5 lexer-benchmark writes programs/build/lexer_benchmark.o2, about 15 MB of small functions with a comment
+-- above each, so that comments, whitespace and identifiers make up most of what the lexer scans. The input is always
+-- the same, so the "Lexer:" lines of two compiler builds can be compared. programs/lexer_benchmark.cmd runs it.
+newaction {
+	trigger = "lexer-benchmark",
+	description = "Write a large input for measuring lexer throughput",
+
+	execute = function()
+		local lines = {}
+		local function_count = 30000
+
+		for i = 1, function_count do
+			lines[#lines + 1] = "// Combines the three arguments in two different ways and returns the larger result. Generated function " .. i .. ","
+			lines[#lines + 1] = "// so the lexer sees roughly as many bytes of comments as of code."
+			lines[#lines + 1] = "fn function_" .. i .. " :: (first_argument : i32, second_argument : i32, third_argument : i32) -> (i32)"
+			lines[#lines + 1] = "{"
+			lines[#lines + 1] = "\tcombined_sum := first_argument * " .. i .. " + second_argument;"
+			lines[#lines + 1] = "\tcombined_difference := (second_argument - third_argument) / 3;"
+			lines[#lines + 1] = "\tif (combined_sum > combined_difference)"
+			lines[#lines + 1] = "\t{"
+			lines[#lines + 1] = "\t\treturn combined_sum;"
+			lines[#lines + 1] = "\t}"
+			lines[#lines + 1] = "\treturn combined_difference;"
+			lines[#lines + 1] = "}"
+			lines[#lines + 1] = ""
+		end
+
+		lines[#lines + 1] = "fn main :: () -> (i32)"
+		lines[#lines + 1] = "{"
+		lines[#lines + 1] = "\treturn function_" .. function_count .. "(1, 2, 3) - function_" .. function_count .. "(1, 2, 3);"
+		lines[#lines + 1] = "}"
+		lines[#lines + 1] = ""
+
+		local directory = path.join(_MAIN_SCRIPT_DIR, "programs/build")
+		os.mkdir(directory)
+
+		local file = io.open(path.join(directory, "lexer_benchmark.o2"), "wb")
+		file:write(table.concat(lines, "\n"))
+		file:close()
+	end
+}
@@ -0,0 +1,10 @@
+@echo off
+
+rem Compiles the same generated input several times with the Release build and prints the lexer time of each run.
+rem Rebuild the compiler between two runs of this script to compare lexer changes.
+
+..\premake\premake5.exe --file=..\premake5.lua lexer-benchmark
+
+for /L %%i in (1,1,5) do (
+	..\bin\Release_x86_64\Compiler.exe --no-cache build\lexer_benchmark.o2 build\out.obj | findstr /B "Lexer:"
+)
@@ -1,20 +1,51 @@
 #include "program.h"
+#include "platform.h"
 
 #include <assert.h>
 
-typedef DynamicArray(LocalVariable) LocalVariableContext;
+// Local variables in scope, innermost last. Symbols are dense, so the innermost declaration of each name is found by
+// indexing latest_by_name with the symbol; declarations that it shadows are chained through shadowed.
+struct LocalVariableContext
+{
+	DynamicArray(LocalVariable) variables;
+	DynamicArray(i32) shadowed; // Per variable: The outer declaration with the same name, or -1.
+	i32* latest_by_name; // Per symbol: The innermost declaration, or -1.
+};
+typedef struct LocalVariableContext LocalVariableContext;
+
+// Functions by name and parameter count, built once before analysis. Each entry heads a chain, in declaration order, of
+// all functions with that key; more than one means calls to it are ambiguous.
+struct FunctionTableEntry
+{
+	Symbol name;
+	i32 parameter_count;
+	i32 first_function; // -1 if the slot is empty.
+	i32 last_function;
+};
+typedef struct FunctionTableEntry FunctionTableEntry;
+
+struct FunctionTable
+{
+	FunctionTableEntry* slots;
+	i64 slot_count;
+	i32* next_function; // Per function: The next one with the same name and parameter count, or -1.
+};
+typedef struct FunctionTable FunctionTable;
+
+// Functions are analyzed in parallel, so diagnostics are collected per function and printed in source order at the end.
+typedef StringBuffer DiagnosticBuffer;
 
 struct StackInfo
 {
 	LocalVariableContext* current_local_variables;
-	i32 stack_size;
-	i32 current_offset_from_frame_pointer;
+	FunctionTable* functions;
+	DiagnosticBuffer* diagnostics;
+	NumericDatatype return_data_type;
+	i32 variable_count; // Parameters and locals declared so far.
 };
 typedef struct StackInfo StackInfo;
 
 
-typedef i64 LogicalRegister;
-
 
 static NumericDatatype unary_operation_result_datatype(NumericDatatype rhs, ExpressionType expression_type)
 {
@@ -48,6 +79,14 @@ static NumericDatatype binary_operation_result_datatype(NumericDatatype lhs, Num
 		return NumericDatatype_Unknown;
 	}
 
+	// Neither of u32 and i32 holds all values of the other, so operations on one of each are rejected, except for the
+	// logical ones, which only look at whether each side is zero. Literals that fit have already taken the other type.
+	b32 mixes_signedness = numeric_is_integral(lhs) && numeric_is_integral(rhs) && lhs != rhs;
+	if (mixes_signedness && expression_type != ExpressionType_LogicalOr && expression_type != ExpressionType_LogicalAnd)
+	{
+		return NumericDatatype_Unknown;
+	}
+
 	NumericDatatype result = NumericDatatype_Unknown;
 
 	switch (expression_type)
@@ -92,34 +131,136 @@ static NumericDatatype binary_operation_result_datatype(NumericDatatype lhs, Num
 	return result;
 }
 
-static LocalVariable* find_local_variable(LocalVariableContext* local_variables, String name, i64 block_start)
+static void report(StackInfo* stack_info, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	string_buffer_push_va(stack_info->diagnostics, format, args);
+	va_end(args);
+}
+
+// Buffered versions of program_print_line and program_print_line_error.
+static void report_line(Program* program, SourceLocation source_location, StackInfo* stack_info)
+{
+	String line = program_get_line(program, source_location.global_character_index);
+	report(stack_info, "%.*s\n", (i32)line.len, line.str);
+}
+
+static void report_line_error(Program* program, SourceLocation source_location, StackInfo* stack_info)
 {
-	for (i64 i = local_variables->count - 1; i >= block_start; --i)
+	String line = program_get_line(program, source_location.global_character_index);
+	i32 column = program_get_column(program, source_location, line);
+
+	report(stack_info, "%.*s\n", (i32)line.len, line.str);
+	report(stack_info, "%*s^\n", column, "");
+}
+
+static FunctionTableEntry* find_function_slot(FunctionTable* table, Symbol name, i64 parameter_count)
+{
+	u32 hash = (name * 0x9E3779B1u) ^ ((u32)parameter_count * 0x85EBCA77u);
+	hash ^= hash >> 15;
+
+	i64 mask = table->slot_count - 1;
+	for (i64 slot = hash & mask; ; slot = (slot + 1) & mask)
 	{
-		if (string_equal(local_variables->items[i].name, name))
+		FunctionTableEntry* entry = &table->slots[slot];
+		if (entry->first_function < 0 || (entry->name == name && entry->parameter_count == parameter_count))
 		{
-			return &local_variables->items[i];
+			return entry;
 		}
 	}
-	return 0;
 }
 
-static b32 assert_no_variable_name_collision(Program* program, String identifier, SourceLocation source_location,
+static FunctionTable build_function_table(Program* program)
+{
+	FunctionTable table = { 0 };
+
+	table.slot_count = 16;
+	while (table.slot_count < program->functions.count * 2)
+	{
+		table.slot_count *= 2;
+	}
+
+	table.slots = malloc(sizeof(FunctionTableEntry) * table.slot_count);
+	for (i64 i = 0; i < table.slot_count; ++i)
+	{
+		table.slots[i].first_function = -1;
+	}
+
+	table.next_function = malloc(sizeof(i32) * max(program->functions.count, 1));
+
+	for (i64 i = 0; i < program->functions.count; ++i)
+	{
+		Function* function = program_get_function(program, i);
+		FunctionTableEntry* entry = find_function_slot(&table, function->name, function->parameter_count);
+
+		if (entry->first_function < 0)
+		{
+			*entry = (FunctionTableEntry){ .name = function->name, .parameter_count = (i32)function->parameter_count, .first_function = (i32)i };
+		}
+		else
+		{
+			table.next_function[entry->last_function] = (i32)i;
+		}
+
+		entry->last_function = (i32)i;
+		table.next_function[i] = -1;
+	}
+
+	return table;
+}
+
+static void free_function_table(FunctionTable* table)
+{
+	free(table->slots);
+	free(table->next_function);
+	*table = (FunctionTable){ 0 };
+}
+
+static LocalVariable* find_local_variable(LocalVariableContext* local_variables, Symbol name, i64 block_start)
+{
+	i32 index = local_variables->latest_by_name[name];
+	return (index >= block_start) ? &local_variables->variables.items[index] : 0;
+}
+
+static void push_local_variable(LocalVariableContext* local_variables, LocalVariable variable)
+{
+	i32 index = (i32)local_variables->variables.count;
+
+	array_push(&local_variables->variables, variable);
+	array_push(&local_variables->shadowed, local_variables->latest_by_name[variable.name]);
+	local_variables->latest_by_name[variable.name] = index;
+}
+
+// Leaves the scope that started when there were variable_count variables.
+static void pop_local_variables(LocalVariableContext* local_variables, i64 variable_count)
+{
+	while (local_variables->variables.count > variable_count)
+	{
+		i64 index = --local_variables->variables.count;
+		local_variables->latest_by_name[local_variables->variables.items[index].name] = local_variables->shadowed.items[index];
+	}
+	local_variables->shadowed.count = variable_count;
+}
+
+static b32 assert_no_variable_name_collision(Program* program, Symbol identifier, SourceLocation source_location,
 	StackInfo* stack_info, i64 first_local_variable_in_current_block)
 {
 	LocalVariable* var = find_local_variable(stack_info->current_local_variables, identifier, first_local_variable_in_current_block);
 
 	if (var)
 	{
-		fprintf(stderr, "LINE %d: Identifier '%.*s' is already declared in line %d:\n", source_location.line, (i32)identifier.len, identifier.str, var->source_location.line);
-		program_print_line_error(program, var->source_location);
+		String name = program_get_name(program, identifier);
+		report(stack_info, "LINE %d: Identifier '%.*s' is already declared in line %d:\n",
+			program_get_line_number(program, source_location), (i32)name.len, name.str, program_get_line_number(program, var->source_location));
+		report_line_error(program, var->source_location, stack_info);
 		return false;
 	}
 
 	return true;
 }
 
-static b32 add_local_variable(Program* program, String identifier, NumericDatatype data_type, SourceLocation source_location,
+static b32 add_local_variable(Program* program, Symbol identifier, NumericDatatype data_type, SourceLocation source_location,
 	StackInfo* stack_info, i64 first_local_variable_in_current_block)
 {
 	if (!assert_no_variable_name_collision(program, identifier, source_location, stack_info, first_local_variable_in_current_block))
@@ -127,23 +268,20 @@ static b32 add_local_variable(Program* program, String identifier, NumericDataty
 		return false;
 	}
 
-	stack_info->current_offset_from_frame_pointer += 8; // Increment first!
-	stack_info->stack_size = max(stack_info->stack_size, stack_info->current_offset_from_frame_pointer);
-
 	LocalVariable variable =
 	{
 		.name = identifier,
-		.offset_from_frame_pointer = -stack_info->current_offset_from_frame_pointer,
+		.variable_index = stack_info->variable_count++,
 		.data_type = data_type,
 		.source_location = source_location,
 	};
 
-	array_push(stack_info->current_local_variables, variable);
+	push_local_variable(stack_info->current_local_variables, variable);
 
 	return true;
 }
 
-static b32 add_parameter_variable(Program* program, String identifier, NumericDatatype data_type, SourceLocation source_location,
+static b32 add_parameter_variable(Program* program, Symbol identifier, NumericDatatype data_type, SourceLocation source_location,
 	i32 parameter_index, StackInfo* stack_info, i64 first_local_variable_in_current_block)
 {
 	if (!assert_no_variable_name_collision(program, identifier, source_location, stack_info, first_local_variable_in_current_block))
@@ -154,12 +292,79 @@ static b32 add_parameter_variable(Program* program, String identifier, NumericDa
 	LocalVariable variable =
 	{
 		.name = identifier,
-		.offset_from_frame_pointer = parameter_index * 8 + 16, // Skip over return address and pushed rbp.
+		.variable_index = parameter_index,
 		.data_type = data_type,
 		.source_location = source_location,
 	};
 
-	array_push(stack_info->current_local_variables, variable);
+	push_local_variable(stack_info->current_local_variables, variable);
+
+	return true;
+}
+
+// Values only widen along b32, u32, i32, f32. Between u32 and i32, neither side holds all values of the other.
+static b32 numeric_converts_implicitly(NumericDatatype from, NumericDatatype to)
+{
+	if (from == NumericDatatype_Unknown || to == NumericDatatype_Unknown)
+	{
+		return false;
+	}
+
+	return (from <= to) && !(from == NumericDatatype_U32 && to == NumericDatatype_I32);
+}
+
+static b32 is_integer_literal(Expression* expression)
+{
+	return expression->type == ExpressionType_NumericLiteral && numeric_is_integral(expression->numeric_literal.type);
+}
+
+// Integer literals are i32 whenever they fit, and u32 otherwise. Where they meet another integer type, they take that
+// type if their value fits it, which keeps the bits the same, so that x > 5 compares unsigned if x is u32.
+static b32 retype_integer_literal(Expression* expression, NumericDatatype to)
+{
+	if (!is_integer_literal(expression) || !numeric_is_integral(to))
+	{
+		return false;
+	}
+
+	NumericLiteral* literal = &expression->numeric_literal;
+	b32 fits = (literal->type == to)
+		|| (to == NumericDatatype_U32 && literal->data_i32 >= 0)
+		|| (to == NumericDatatype_I32 && literal->data_u32 <= INT32_MAX);
+	if (fits)
+	{
+		literal->type = to;
+		expression->result_data_type = to;
+	}
+	return fits;
+}
+
+static b32 check_conversion(Program* program, ExpressionHandle expression_handle, NumericDatatype to, StackInfo* stack_info)
+{
+	Expression* expression = program_get_expression(program, expression_handle);
+
+	if (!retype_integer_literal(expression, to) && !numeric_converts_implicitly(expression->result_data_type, to))
+	{
+		report(stack_info, "LINE %d: Cannot convert '%s' to '%s'.\n", program_get_line_number(program, expression->source_location),
+			numeric_to_string(expression->result_data_type), numeric_to_string(to));
+		report_line_error(program, expression->source_location, stack_info);
+		return false;
+	}
+
+	return true;
+}
+
+static b32 check_condition(Program* program, ExpressionHandle expression_handle, StackInfo* stack_info)
+{
+	Expression* expression = program_get_expression(program, expression_handle);
+
+	if (!numeric_converts_to_b32(expression->result_data_type))
+	{
+		report(stack_info, "LINE %d: Condition of type '%s' does not convert to 'b32'.\n", program_get_line_number(program, expression->source_location),
+			numeric_to_string(expression->result_data_type));
+		report_line_error(program, expression->source_location, stack_info);
+		return false;
+	}
 
 	return true;
 }
@@ -180,13 +385,14 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 		Expression* lhs_expression = program_get_expression(program, e.lhs);
 		assert(lhs_expression->type == ExpressionType_Identifier); // Temporary.
 
-		String identifier = lhs_expression->identifier.name;
+		Symbol identifier = lhs_expression->identifier.name;
 		LocalVariable* var = find_local_variable(stack_info->current_local_variables, identifier, 0);
 
 		if (!var)
 		{
-			fprintf(stderr, "LINE %d: Undeclared identifier '%.*s'.\n", lhs_expression->source_location.line, (i32)identifier.len, identifier.str);
-			program_print_line_error(program, lhs_expression->source_location);
+			String name = program_get_name(program, identifier);
+			report(stack_info, "LINE %d: Undeclared identifier '%.*s'.\n", program_get_line_number(program, lhs_expression->source_location), (i32)name.len, name.str);
+			report_line_error(program, lhs_expression->source_location, stack_info);
 			return false;
 		}
 
@@ -195,7 +401,12 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 			return false;
 		}
 
-		//expression->result_data_type = var->data_type;
+		if (!check_conversion(program, e.rhs, var->data_type, stack_info))
+		{
+			return false;
+		}
+
+		expression->result_data_type = var->data_type;
 	}
 	else if (expression_is_binary_operation(expression->type))
 	{
@@ -213,7 +424,23 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 		Expression* lhs = program_get_expression(program, e.lhs);
 		Expression* rhs = program_get_expression(program, e.rhs);
 
-		//expression->result_data_type = binary_operation_result_datatype(lhs->result_data_type, rhs->result_data_type, expression->type);
+		if (!is_integer_literal(rhs))
+		{
+			retype_integer_literal(lhs, rhs->result_data_type);
+		}
+		else if (!is_integer_literal(lhs))
+		{
+			retype_integer_literal(rhs, lhs->result_data_type);
+		}
+
+		expression->result_data_type = binary_operation_result_datatype(lhs->result_data_type, rhs->result_data_type, expression->type);
+		if (expression->result_data_type == NumericDatatype_Unknown)
+		{
+			report(stack_info, "LINE %d: Invalid operand types '%s' and '%s'.\n", program_get_line_number(program, expression->source_location),
+				numeric_to_string(lhs->result_data_type), numeric_to_string(rhs->result_data_type));
+			report_line_error(program, expression->source_location, stack_info);
+			return false;
+		}
 	}
 	else if (expression_is_unary_operation(expression->type))
 	{
@@ -226,31 +453,41 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 
 		Expression* rhs = program_get_expression(program, e.rhs);
 
-		//expression->result_data_type = unary_operation_result_datatype(rhs->result_data_type, expression->type);
+		expression->result_data_type = unary_operation_result_datatype(rhs->result_data_type, expression->type);
+		if (expression->result_data_type == NumericDatatype_Unknown)
+		{
+			report(stack_info, "LINE %d: Invalid operand type '%s'.\n", program_get_line_number(program, expression->source_location),
+				numeric_to_string(rhs->result_data_type));
+			report_line_error(program, expression->source_location, stack_info);
+			return false;
+		}
 	}
 	else if (expression->type == ExpressionType_NumericLiteral)
 	{
-		//expression->result_data_type = expression->literal.type;
+		expression->result_data_type = expression->numeric_literal.type;
 	}
 	else if (expression->type == ExpressionType_StringLiteral)
 	{
-		//expression->result_data_type = expression->literal.type;
+		// The lexer produces string literal tokens, but nothing past the parser can handle them yet.
+		report(stack_info, "LINE %d: String literals are not supported yet.\n", program_get_line_number(program, expression->source_location));
+		report_line_error(program, expression->source_location, stack_info);
+		return false;
 	}
 	else if (expression->type == ExpressionType_Identifier)
 	{
 		IdentifierExpression* e = &expression->identifier;
 
-		String name = e->name;
-		LocalVariable* var = find_local_variable(stack_info->current_local_variables, name, 0);
+		LocalVariable* var = find_local_variable(stack_info->current_local_variables, e->name, 0);
 		if (!var)
 		{
-			fprintf(stderr, "LINE %d: Undeclared identifier '%.*s'.\n", expression->source_location.line, (i32)name.len, name.str);
-			program_print_line_error(program, expression->source_location);
+			String name = program_get_name(program, e->name);
+			report(stack_info, "LINE %d: Undeclared identifier '%.*s'.\n", program_get_line_number(program, expression->source_location), (i32)name.len, name.str);
+			report_line_error(program, expression->source_location, stack_info);
 			return false;
 		}
 
-		//expression->result_data_type = var->data_type;
-		e->offset_from_frame_pointer = var->offset_from_frame_pointer;
+		expression->result_data_type = var->data_type;
+		e->variable_index = var->variable_index;
 	}
 	else if (expression->type == ExpressionType_FunctionCall)
 	{
@@ -269,41 +506,46 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 			argument = program_get_expression(program, argument)->next;
 		}
 
-		Function* called_function = 0;
-		b32 error_printed = false;
-		for (i64 function_index = 0; function_index < program->functions.count; ++function_index)
+		FunctionTable* functions = stack_info->functions;
+		FunctionTableEntry* entry = find_function_slot(functions, e->function_name, argument_count);
+
+		if (entry->first_function < 0)
 		{
-			Function* function = &program->functions.items[function_index];
-			if (string_equal(function->name, e->function_name) && function->parameter_count == argument_count)
-			{
-				if (called_function)
-				{
-					if (!error_printed)
-					{
-						fprintf(stderr, "LINE %d: More than one function matches call:\n", expression->source_location.line);
-						program_print_line_error(program, expression->source_location);
-						fprintf(stderr, "Could be either:\n");
-						fprintf(stderr, "LINE %d: ", called_function->source_location.line);
-						program_print_line(program, called_function->source_location, stderr);
-						error_printed = true;
-					}
-					fprintf(stderr, "LINE %d: ", function->source_location.line);
-					program_print_line(program, function->source_location, stderr);
-				}
-				called_function = function;
-			}
+			report(stack_info, "LINE %d: No matching function found for call:\n", program_get_line_number(program, expression->source_location));
+			report_line_error(program, expression->source_location, stack_info);
+			return false;
 		}
-		if (!called_function)
+
+		if (entry->first_function != entry->last_function)
 		{
-			fprintf(stderr, "LINE %d: No matching function found for call:\n", expression->source_location.line);
-			program_print_line_error(program, expression->source_location);
+			report(stack_info, "LINE %d: More than one function matches call:\n", program_get_line_number(program, expression->source_location));
+			report_line_error(program, expression->source_location, stack_info);
+			report(stack_info, "Could be either:\n");
+
+			for (i32 function_index = entry->first_function; function_index >= 0; function_index = functions->next_function[function_index])
+			{
+				Function* function = program_get_function(program, function_index);
+				report(stack_info, "LINE %d: ", program_get_line_number(program, function->source_location));
+				report_line(program, function->source_location, stack_info);
+			}
 			return false;
 		}
-		if (error_printed)
+
+		e->function_index = entry->first_function;
+
+		Function* function = program_get_function(program, e->function_index);
+
+		i64 parameter_index = function->first_parameter;
+		for (argument = e->first_argument; argument; argument = program_get_expression(program, argument)->next)
 		{
-			return false;
+			NumericDatatype parameter_data_type = program->function_parameters.items[parameter_index++].data_type;
+			if (!check_conversion(program, argument, parameter_data_type, stack_info))
+			{
+				return false;
+			}
 		}
-		e->function_index = (i32)(called_function - program->functions.items);
+
+		expression->result_data_type = function->return_data_type;
 	}
 	else
 	{
@@ -315,10 +557,9 @@ static b32 analyze_expression(Program* program, ExpressionHandle expression_hand
 
 static b32 analyze_statements(Program* program, i32 first_statement, i32 statement_count, StackInfo* stack_info)
 {
-	i64 first_local_variable_in_current_block = stack_info->current_local_variables->count;
+	i64 first_local_variable_in_current_block = stack_info->current_local_variables->variables.count;
 
-	i32 current_offset_from_frame_pointer = stack_info->current_offset_from_frame_pointer;
-	i64 current_local_variable_count = stack_info->current_local_variables->count;
+	i64 current_local_variable_count = stack_info->current_local_variables->variables.count;
 
 	for (i32 i = 0; i < statement_count; ++i)
 	{
@@ -337,7 +578,7 @@ static b32 analyze_statements(Program* program, i32 first_statement, i32 stateme
 			Expression* lhs = program_get_expression(program, e.lhs);
 			assert(lhs->type == ExpressionType_Identifier); // Temporary.
 
-			String identifier = lhs->identifier.name;
+			Symbol identifier = lhs->identifier.name;
 
 			if (!add_local_variable(program, identifier, e.data_type, statement->source_location, stack_info, first_local_variable_in_current_block)) { return false; }
 			if (!analyze_expression(program, e.lhs, stack_info)) { return false; }
@@ -352,15 +593,18 @@ static b32 analyze_statements(Program* program, i32 first_statement, i32 stateme
 			Expression* lhs = program_get_expression(program, e.lhs);
 			assert(lhs->type == ExpressionType_Identifier); // Temporary.
 
-			NumericDatatype data_type = e.data_type;// (e.data_type == NumericDatatype_Unknown) ? rhs->result_data_type : e.data_type;
+			NumericDatatype data_type = (e.data_type == NumericDatatype_Unknown) ? rhs->result_data_type : e.data_type;
+			if (!check_conversion(program, e.rhs, data_type, stack_info)) { return false; }
+			statement->declaration_assignment.data_type = data_type;
 
-			String identifier = lhs->identifier.name;
+			Symbol identifier = lhs->identifier.name;
 			if (!add_local_variable(program, identifier, data_type, statement->source_location, stack_info, first_local_variable_in_current_block)) { return false; }
 			if (!analyze_expression(program, e.lhs, stack_info)) { return false; }
 		}
 		else if (statement->type == StatementType_Return)
 		{
 			if (!analyze_expression(program, statement->ret.rhs, stack_info)) { return false; }
+			if (!check_conversion(program, statement->ret.rhs, stack_info->return_data_type, stack_info)) { return false; }
 		}
 		else if (statement->type == StatementType_Block)
 		{
@@ -372,6 +616,7 @@ static b32 analyze_statements(Program* program, i32 first_statement, i32 stateme
 			BranchStatement e = statement->branch;
 
 			if (!analyze_expression(program, e.condition, stack_info)) { return false; }
+			if (!check_condition(program, e.condition, stack_info)) { return false; }
 
 			if (!analyze_statements(program, statement_index + 1, e.then_statement_count, stack_info)) { return false; }
 			if (!analyze_statements(program, statement_index + e.then_statement_count + 1, e.else_statement_count, stack_info)) { return false; }
@@ -382,6 +627,7 @@ static b32 analyze_statements(Program* program, i32 first_statement, i32 stateme
 			LoopStatement e = statement->loop;
 
 			if (!analyze_expression(program, e.condition, stack_info)) { return false; }
+			if (!check_condition(program, e.condition, stack_info)) { return false; }
 
 			if (!analyze_statements(program, statement_index + 1, e.then_statement_count, stack_info)) { return false; }
 			i += e.then_statement_count;
@@ -392,24 +638,31 @@ static b32 analyze_statements(Program* program, i32 first_statement, i32 stateme
 		}
 	}
 
-	stack_info->current_local_variables->count = current_local_variable_count;
-	stack_info->current_offset_from_frame_pointer = current_offset_from_frame_pointer;
+	pop_local_variables(stack_info->current_local_variables, current_local_variable_count);
 
 	return true;
 }
 
-static b32 analyze_function(Program* program, Function* function, LocalVariableContext* local_variable_context)
+static b32 analyze_function(Program* program, Function* function, FunctionTable* functions, LocalVariableContext* local_variable_context,
+	DiagnosticBuffer* diagnostics)
 {
-	i64 variable_count = local_variable_context->count;
+	i64 variable_count = local_variable_context->variables.count;
 
-	StackInfo stack_info = { .current_local_variables = local_variable_context };
+	StackInfo stack_info =
+	{
+		.current_local_variables = local_variable_context,
+		.functions = functions,
+		.diagnostics = diagnostics,
+		.return_data_type = function->return_data_type,
+		.variable_count = (i32)function->parameter_count,
+	};
 
 	b32 result = true;
 
 	for (i64 i = 0; i < function->parameter_count; ++i)
 	{
 		FunctionParameter parameter = program->function_parameters.items[i + function->first_parameter];
-		if (!add_parameter_variable(program, parameter.name, NumericDatatype_I32, function->source_location, (i32)i, &stack_info, variable_count))
+		if (!add_parameter_variable(program, parameter.name, parameter.data_type, function->source_location, (i32)i, &stack_info, variable_count))
 		{
 			result = false;
 		}
@@ -420,27 +673,86 @@ static b32 analyze_function(Program* program, Function* function, LocalVariableC
 		result = false;
 	}
 
-	function->stack_size = stack_info.stack_size;
-	local_variable_context->count = variable_count;
+	function->variable_count = stack_info.variable_count;
+	pop_local_variables(local_variable_context, variable_count); // Also after errors, which return early.
 
 	return result;
 }
 
-b32 analyze(Program* program)
+// Functions only read each other's signatures, so they can be analyzed independently. Each worker has its own local
+// variable context.
+struct ParallelAnalysis
 {
-	LocalVariableContext local_variable_context = { 0 };
+	Program* program;
+	FunctionTable* functions;
+	LocalVariableContext* local_variable_contexts; // Per worker.
+	DiagnosticBuffer* diagnostics; // Per function.
+	b32* results; // Per function.
+};
+typedef struct ParallelAnalysis ParallelAnalysis;
+
+static void analyze_task(void* data, i64 function_index, i32 worker_index)
+{
+	ParallelAnalysis* analysis = data;
+	Function* function = program_get_function(analysis->program, function_index);
+
+	analysis->results[function_index] = analyze_function(analysis->program, function, analysis->functions,
+		&analysis->local_variable_contexts[worker_index], &analysis->diagnostics[function_index]);
+}
+
+b32 analyze(Program* program, i32 thread_count)
+{
+	FunctionTable function_table = build_function_table(program);
+
+	i64 function_count = program->functions.count;
+	i32 worker_count = (i32)max(min(thread_count, function_count), 1);
+
+	ParallelAnalysis analysis =
+	{
+		.program = program,
+		.functions = &function_table,
+		.local_variable_contexts = calloc(worker_count, sizeof(LocalVariableContext)),
+		.diagnostics = calloc(max(function_count, 1), sizeof(DiagnosticBuffer)),
+		.results = calloc(max(function_count, 1), sizeof(b32)),
+	};
+
+	i64 symbol_count = program->symbols.names.count;
+	for (i32 i = 0; i < worker_count; ++i)
+	{
+		LocalVariableContext* local_variable_context = &analysis.local_variable_contexts[i];
+		local_variable_context->latest_by_name = malloc(sizeof(i32) * max(symbol_count, 1));
+		memset(local_variable_context->latest_by_name, 0xFF, sizeof(i32) * symbol_count); // -1
+	}
+
+	parallel_for(function_count, worker_count, analyze_task, &analysis);
 
 	b32 result = true;
 
-	for (i64 i = 0; i < program->functions.count; ++i)
+	for (i64 i = 0; i < function_count; ++i)
 	{
-		local_variable_context.count = 0;
+		DiagnosticBuffer* diagnostics = &analysis.diagnostics[i];
+		if (diagnostics->count)
+		{
+			fwrite(diagnostics->items, 1, diagnostics->count, stderr);
+			program->reported_diagnostics = true;
+		}
+		array_free(diagnostics);
+
+		result &= analysis.results[i];
+	}
 
-		b32 success = analyze_function(program, &program->functions.items[i], &local_variable_context);
-		result &= success;
+	for (i32 i = 0; i < worker_count; ++i)
+	{
+		LocalVariableContext* local_variable_context = &analysis.local_variable_contexts[i];
+		array_free(&local_variable_context->variables);
+		array_free(&local_variable_context->shadowed);
+		free(local_variable_context->latest_by_name);
 	}
 
-	array_free(&local_variable_context);
+	free(analysis.local_variable_contexts);
+	free(analysis.diagnostics);
+	free(analysis.results);
+	free_function_table(&function_table);
 
 	return result;
 }
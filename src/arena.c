@@ -0,0 +1,58 @@
+#include "arena.h"
+
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MINIMUM_BLOCK_SIZE (1024 * 1024)
+
+static i64 align_up(i64 value)
+{
+	return (value + ARENA_ALIGNMENT - 1) & ~(i64)(ARENA_ALIGNMENT - 1);
+}
+
+static i64 block_header_size()
+{
+	return align_up(sizeof(ArenaBlock));
+}
+
+static void push_block(Arena* arena, i64 size)
+{
+	i64 capacity = max(align_up(size), ARENA_MINIMUM_BLOCK_SIZE);
+
+	ArenaBlock* block = malloc(block_header_size() + capacity);
+	block->previous = arena->current;
+	block->capacity = capacity;
+	block->used = 0;
+
+	arena->current = block;
+}
+
+void arena_reserve(Arena* arena, i64 size)
+{
+	if (!arena->current || arena->current->capacity - arena->current->used < size)
+	{
+		push_block(arena, size);
+	}
+}
+
+void* arena_allocate(Arena* arena, i64 size)
+{
+	size = align_up(size);
+	arena_reserve(arena, size);
+
+	ArenaBlock* block = arena->current;
+	void* result = (u8*)block + block_header_size() + block->used;
+	block->used += size;
+	return result;
+}
+
+void arena_free(Arena* arena)
+{
+	ArenaBlock* block = arena->current;
+	while (block)
+	{
+		ArenaBlock* previous = block->previous;
+		free(block);
+		block = previous;
+	}
+	arena->current = 0;
+}
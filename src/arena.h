@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+
+
+// Bump allocator for data that lives as long as the compilation. Allocations never move and are released all at once.
+struct ArenaBlock
+{
+	struct ArenaBlock* previous;
+	i64 capacity;
+	i64 used;
+};
+typedef struct ArenaBlock ArenaBlock;
+
+struct Arena
+{
+	ArenaBlock* current;
+};
+typedef struct Arena Arena;
+
+// Makes sure the next size bytes can be allocated without another call to malloc.
+void arena_reserve(Arena* arena, i64 size);
+void* arena_allocate(Arena* arena, i64 size);
+void arena_free(Arena* arena);
+
+
+// Array whose items are stored in fixed-size chunks taken from an arena. Growing it only appends chunk pointers, so
+// items are never copied and pointers to them stay valid.
+#define CHUNK_SHIFT 12
+#define CHUNK_ITEM_COUNT (1 << CHUNK_SHIFT)
+
+#define ChunkedArray(ItemType)																		\
+	struct																							\
+	{																								\
+		DynamicArray(ItemType*) chunks;																\
+		i64 count;																					\
+	}
+
+#define chunked_array_get(a, index) (&(a)->chunks.items[(index) >> CHUNK_SHIFT][(index) & (CHUNK_ITEM_COUNT - 1)])
+
+#define chunked_array_push(arena, a, item)															\
+	do																								\
+	{																								\
+		if ((a)->count == (a)->chunks.count * CHUNK_ITEM_COUNT)										\
+		{																							\
+			array_push(&(a)->chunks, arena_allocate(arena, sizeof(**(a)->chunks.items) * CHUNK_ITEM_COUNT));	\
+		}																							\
+		*chunked_array_get(a, (a)->count) = item;													\
+		++(a)->count;																				\
+	} while (0)
+
+// Grows the array to item_count items. The new items are left uninitialized.
+#define chunked_array_resize(arena, a, item_count)													\
+	do																								\
+	{																								\
+		while ((a)->chunks.count * CHUNK_ITEM_COUNT < (item_count))									\
+		{																							\
+			array_push(&(a)->chunks, arena_allocate(arena, sizeof(**(a)->chunks.items) * CHUNK_ITEM_COUNT));	\
+		}																							\
+		(a)->count = (item_count);																	\
+	} while (0)
+
+#define chunked_array_chunk_count(item_count) (((item_count) + CHUNK_ITEM_COUNT - 1) / CHUNK_ITEM_COUNT)
+
+// Bytes needed to hold item_count items, rounded up to whole chunks.
+#define chunked_array_bytes(a, item_count) (chunked_array_chunk_count(item_count) * CHUNK_ITEM_COUNT * (i64)sizeof(**(a)->chunks.items))
@@ -0,0 +1,281 @@
+#include "program.h"
+#include "platform.h"
+
+#include <assert.h>
+
+
+// Layout: A CacheHeader, followed by the sections it points to. Nodes are stored as raw structs, so that a loaded file can
+// be used in place. This only works with the same build of the compiler, which the compiler hash makes sure of: It
+// covers the executable itself, so any rebuild invalidates existing caches.
+
+#define CACHE_MAGIC 0x4843324F // "O2CH"
+#define CACHE_ALIGNMENT 64
+
+struct CacheSection
+{
+	i64 offset;
+	i64 count;
+};
+typedef struct CacheSection CacheSection;
+
+struct CacheHeader
+{
+	u32 magic;
+	u32 header_size;
+	u64 compiler_hash;
+	u64 source_hash;
+	i64 source_size;
+	i64 file_size;
+
+	CacheSection functions;
+	CacheSection function_parameters;
+	CacheSection statements;
+	CacheSection expressions;
+	CacheSection name_offsets; // name_count + 1 offsets into name_data.
+	CacheSection name_data;
+};
+typedef struct CacheHeader CacheHeader;
+
+
+static u64 hash_bytes(u64 hash, const void* data, i64 size)
+{
+	// FNV-1a.
+	const u8* bytes = data;
+	for (i64 i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static u64 mix(u64 value)
+{
+	value ^= value >> 32;
+	value *= 0xD6E8FEB86659FD93ull;
+	value ^= value >> 32;
+	return value;
+}
+
+u64 hash_source(String source_code)
+{
+	// Four independent lanes of 8-byte words, so that the multiplies overlap. Not cryptographic; this only has to notice
+	// edits.
+	u64 lanes[4] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull };
+
+	i64 i = 0;
+	for (; i + 32 <= source_code.len; i += 32)
+	{
+		for (i32 lane = 0; lane < 4; ++lane)
+		{
+			u64 word;
+			memcpy(&word, source_code.str + i + lane * 8, sizeof(word));
+			lanes[lane] = mix(lanes[lane] ^ word) + word;
+		}
+	}
+
+	u64 hash = hash_bytes(14695981039346656037ull, source_code.str + i, source_code.len - i);
+	for (i32 lane = 0; lane < 4; ++lane)
+	{
+		hash = mix(hash ^ lanes[lane]);
+	}
+	return mix(hash ^ (u64)source_code.len);
+}
+
+static u64 compiler_hash()
+{
+	// Node layouts are part of the file format.
+	i64 sizes[] = { sizeof(CacheHeader), sizeof(Function), sizeof(FunctionParameter), sizeof(Statement), sizeof(Expression) };
+
+	u64 hash = hash_bytes(14695981039346656037ull, COMPILER_VERSION, sizeof(COMPILER_VERSION));
+	hash = hash_bytes(hash, sizes, sizeof(sizes));
+
+	// If the executable cannot be read, only the version and the layouts are left to tell builds apart.
+	String executable = map_executable();
+	if (executable.str)
+	{
+		hash = mix(hash ^ hash_source(executable));
+		unmap_file(&executable);
+	}
+
+	return hash;
+}
+
+static i64 align_offset(i64 offset)
+{
+	return (offset + CACHE_ALIGNMENT - 1) & ~(i64)(CACHE_ALIGNMENT - 1);
+}
+
+static CacheSection add_section(i64* file_size, i64 count, i64 item_size)
+{
+	CacheSection section = { .offset = align_offset(*file_size), .count = count };
+	*file_size = section.offset + count * item_size;
+	return section;
+}
+
+b32 program_save_cache(Program* program, const char* path, u64 source_hash)
+{
+	SymbolTable* symbols = &program->symbols;
+
+	i64 name_data_size = 0;
+	for (i64 i = 0; i < symbols->names.count; ++i)
+	{
+		name_data_size += symbols->names.items[i].len;
+	}
+
+	CacheHeader header =
+	{
+		.magic = CACHE_MAGIC,
+		.header_size = sizeof(CacheHeader),
+		.compiler_hash = compiler_hash(),
+		.source_hash = source_hash,
+		.source_size = program->source_code.len,
+	};
+
+	i64 file_size = sizeof(CacheHeader);
+	header.functions = add_section(&file_size, program->functions.count, sizeof(Function));
+	header.function_parameters = add_section(&file_size, program->function_parameters.count, sizeof(FunctionParameter));
+	header.statements = add_section(&file_size, program->statements.count, sizeof(Statement));
+	header.expressions = add_section(&file_size, program->expressions.count, sizeof(Expression));
+	header.name_offsets = add_section(&file_size, symbols->names.count + 1, sizeof(i64));
+	header.name_data = add_section(&file_size, name_data_size, 1);
+	header.file_size = file_size;
+
+	u8* data = calloc(file_size, 1);
+	if (!data)
+	{
+		return false;
+	}
+
+	memcpy(data, &header, sizeof(header));
+
+	Function* functions = (Function*)(data + header.functions.offset);
+	for (i64 i = 0; i < program->functions.count; ++i)
+	{
+		functions[i] = *program_get_function(program, i);
+	}
+
+	if (program->function_parameters.count)
+	{
+		memcpy(data + header.function_parameters.offset, program->function_parameters.items, sizeof(FunctionParameter) * program->function_parameters.count);
+	}
+
+	Statement* statements = (Statement*)(data + header.statements.offset);
+	for (i64 i = 0; i < program->statements.count; ++i)
+	{
+		statements[i] = *program_get_statement(program, (i32)i);
+	}
+
+	Expression* expressions = (Expression*)(data + header.expressions.offset);
+	for (i64 i = 0; i < program->expressions.count; ++i)
+	{
+		expressions[i] = *program_get_expression(program, (ExpressionHandle)i);
+		assert(expressions[i].type != ExpressionType_StringLiteral); // Points into the source.
+	}
+
+	i64* name_offsets = (i64*)(data + header.name_offsets.offset);
+	char* name_data = (char*)(data + header.name_data.offset);
+	i64 name_offset = 0;
+	for (i64 i = 0; i < symbols->names.count; ++i)
+	{
+		String name = symbols->names.items[i];
+		memcpy(name_data + name_offset, name.str, name.len);
+		name_offsets[i] = name_offset;
+		name_offset += name.len;
+	}
+	name_offsets[symbols->names.count] = name_offset;
+
+	b32 result = write_binary_file(path, (String){ .str = (char*)data, .len = file_size });
+
+	free(data);
+	return result;
+}
+
+static b32 section_is_valid(CacheSection section, i64 item_size, i64 file_size)
+{
+	return section.offset % CACHE_ALIGNMENT == 0 && section.count >= 0 &&
+		section.offset <= file_size && section.count <= (file_size - section.offset) / item_size;
+}
+
+#define chunked_array_from_items(a, first_item, item_count)									\
+	do																						\
+	{																						\
+		for (i64 chunk = 0; chunk < chunked_array_chunk_count(item_count); ++chunk)			\
+		{																					\
+			array_push(&(a)->chunks, (first_item) + chunk * CHUNK_ITEM_COUNT);				\
+		}																					\
+		(a)->count = (item_count);															\
+	} while (0)
+
+b32 program_load_cache(Program* program, const char* path, u64 source_hash, String* cache_file)
+{
+	String file = map_file_copy_on_write(path);
+	if (!file.str)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	b32 valid = file.len >= (i64)sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, file.str, sizeof(header));
+
+		valid =
+			header.magic == CACHE_MAGIC &&
+			header.header_size == sizeof(CacheHeader) &&
+			header.compiler_hash == compiler_hash() &&
+			header.source_hash == source_hash &&
+			header.source_size == program->source_code.len &&
+			header.file_size == file.len &&
+			section_is_valid(header.functions, sizeof(Function), file.len) &&
+			section_is_valid(header.function_parameters, sizeof(FunctionParameter), file.len) &&
+			section_is_valid(header.statements, sizeof(Statement), file.len) &&
+			section_is_valid(header.expressions, sizeof(Expression), file.len) &&
+			section_is_valid(header.name_offsets, sizeof(i64), file.len) &&
+			section_is_valid(header.name_data, 1, file.len) &&
+			header.name_offsets.count > 0 && header.expressions.count > 0;
+	}
+
+	for (i64 i = 0; valid && i < header.name_offsets.count; ++i)
+	{
+		i64 offset = ((i64*)(file.str + header.name_offsets.offset))[i];
+		i64 previous_offset = i ? ((i64*)(file.str + header.name_offsets.offset))[i - 1] : 0;
+		valid = offset >= previous_offset && offset <= header.name_data.count;
+	}
+
+	if (!valid)
+	{
+		unmap_file(&file);
+		return false;
+	}
+
+	u8* data = (u8*)file.str;
+
+	// The chunks point straight into the file. Only the chunk tables are allocated.
+	chunked_array_from_items(&program->functions, (Function*)(data + header.functions.offset), header.functions.count);
+	chunked_array_from_items(&program->statements, (Statement*)(data + header.statements.offset), header.statements.count);
+	chunked_array_from_items(&program->expressions, (Expression*)(data + header.expressions.offset), header.expressions.count);
+
+	// Parameters are few, and free_program expects to own them.
+	array_reserve(&program->function_parameters, header.function_parameters.count);
+	if (header.function_parameters.count)
+	{
+		memcpy(program->function_parameters.items, data + header.function_parameters.offset, sizeof(FunctionParameter) * header.function_parameters.count);
+	}
+	program->function_parameters.count = header.function_parameters.count;
+
+	i64* name_offsets = (i64*)(data + header.name_offsets.offset);
+	char* name_data = (char*)(data + header.name_data.offset);
+	i64 name_count = header.name_offsets.count - 1;
+
+	array_reserve(&program->symbols.names, name_count);
+	for (i64 i = 0; i < name_count; ++i)
+	{
+		String name = { .str = name_data + name_offsets[i], .len = name_offsets[i + 1] - name_offsets[i] };
+		array_push(&program->symbols.names, name);
+	}
+
+	*cache_file = file;
+	return true;
+}
@@ -22,6 +22,10 @@ typedef double f64;
 
 typedef u32 b32;
 
+// Part of the key of cached programs (see cache.c), next to a hash of the executable. Bump whenever lexing, parsing or
+// analysis produce different output, for builds that cannot read their own executable.
+#define COMPILER_VERSION "0.4.0"
+
 #define arraysize(arr) (i64)(sizeof(arr) / sizeof((arr)[0]))
 
 
@@ -46,14 +50,6 @@ static b32 string_equal(String s1, String s2)
 	return s1.len == s2.len && strncmp(s1.str, s2.str, s1.len) == 0;
 }
 
-static void string_push(String* string, const char* format, ...)
-{
-	va_list args;
-	va_start(args, format);
-	string->len += vsprintf(string->str + string->len, format, args);
-	va_end(args);
-}
-
 
 #define DynamicArray(ItemType)														\
 	struct																			\
@@ -74,6 +70,16 @@ static void string_push(String* string, const char* format, ...)
 		(a)->items[(a)->count++] = item;											\
 	} while (0)
 
+#define array_reserve(a, item_count)												\
+	do																				\
+	{																				\
+		if ((a)->capacity < (item_count))											\
+		{																			\
+			(a)->capacity = (item_count);											\
+			(a)->items = realloc((a)->items, sizeof(*(a)->items) * (a)->capacity);	\
+		}																			\
+	} while (0)
+
 #define array_free(a)																\
 	do																				\
 	{																				\
@@ -84,6 +90,35 @@ static void string_push(String* string, const char* format, ...)
 	} while (0)
 
 
+// Growable text, appended to with printf-style formats. Always zero-terminated once anything has been pushed.
+typedef DynamicArray(char) StringBuffer;
+
+static void string_buffer_push_va(StringBuffer* buffer, const char* format, va_list args)
+{
+	va_list copy;
+	va_copy(copy, args);
+	i32 length = vsnprintf(0, 0, format, copy);
+	va_end(copy);
+
+	if (buffer->count + length + 1 > buffer->capacity)
+	{
+		buffer->capacity = max(buffer->capacity * 2, buffer->count + length + 1);
+		buffer->items = realloc(buffer->items, buffer->capacity);
+	}
+
+	vsnprintf(buffer->items + buffer->count, length + 1, format, args);
+	buffer->count += length;
+}
+
+static void string_buffer_push(StringBuffer* buffer, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	string_buffer_push_va(buffer, format, args);
+	va_end(args);
+}
+
+
 #if 0
 #define HashMap(KeyType, ValueType, capacity)										\
 	struct																			\
@@ -136,10 +171,10 @@ static void test()
 #endif
 
 
+// Line numbers are not stored. Look them up with program_get_line_number when needed.
 struct SourceLocation
 {
-	i32 line;
-	i32 global_character_index;
+	i64 global_character_index;
 };
 typedef struct SourceLocation SourceLocation;
 
@@ -0,0 +1,505 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+struct FoldContext
+{
+	IrFunction* function;
+	DynamicArray(i32) use_counts; // Per value, kept up to date while operands are rewritten.
+	DynamicArray(u32) visited; // Per value: visit_stamp once seen by the current phi search.
+	DynamicArray(IrValue) phi_stack;
+	u32 visit_stamp;
+	i32 block;
+	i64 index; // Of the instruction being folded, within its block. Insertions in front of it advance it.
+	b32 changed;
+};
+typedef struct FoldContext FoldContext;
+
+
+static b32 get_constant(IrFunction* function, IrValue value, NumericLiteral* constant)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	if (instruction->opcode != IrOpcode_Constant)
+	{
+		return false;
+	}
+	*constant = instruction->constant;
+	return true;
+}
+
+static b32 is_nan(NumericLiteral constant)
+{
+	return (constant.data_u32 & 0x7FFFFFFF) > 0x7F800000;
+}
+
+// Integer operations that can be regrouped and reordered freely, since they wrap around.
+static b32 is_reassociable(IrOpcode opcode, NumericDatatype data_type)
+{
+	if (data_type == NumericDatatype_F32)
+	{
+		return false;
+	}
+
+	switch (opcode)
+	{
+		case IrOpcode_BitwiseOr:
+		case IrOpcode_BitwiseXor:
+		case IrOpcode_BitwiseAnd:
+		case IrOpcode_Addition:
+		case IrOpcode_Multiplication:
+			return true;
+	}
+	return false;
+}
+
+static b32 evaluate_binary(IrOpcode opcode, NumericDatatype operand_type, NumericLiteral lhs, NumericLiteral rhs, NumericLiteral* result)
+{
+	*result = (NumericLiteral){ .type = ir_is_comparison(opcode) ? NumericDatatype_B32 : operand_type };
+
+	if (operand_type == NumericDatatype_F32)
+	{
+		f32 a = lhs.data_f32;
+		f32 b = rhs.data_f32;
+
+		// Unordered comparisons are false, except for not equal. Checked on the bits, which fast floating point math
+		// does not touch.
+		b32 unordered = is_nan(lhs) || is_nan(rhs);
+
+		switch (opcode)
+		{
+			case IrOpcode_Equal:			result->data_b32 = !unordered && a == b; break;
+			case IrOpcode_NotEqual:			result->data_b32 = unordered || a != b; break;
+			case IrOpcode_Less:				result->data_b32 = !unordered && a < b; break;
+			case IrOpcode_Greater:			result->data_b32 = !unordered && a > b; break;
+			case IrOpcode_LessEqual:		result->data_b32 = !unordered && a <= b; break;
+			case IrOpcode_GreaterEqual:		result->data_b32 = !unordered && a >= b; break;
+			case IrOpcode_Addition:			result->data_f32 = a + b; break;
+			case IrOpcode_Subtraction:		result->data_f32 = a - b; break;
+			case IrOpcode_Multiplication:	result->data_f32 = a * b; break;
+			case IrOpcode_Division:			result->data_f32 = a / b; break; // Infinity or NaN for zero, like divss.
+			default:						return false;
+		}
+		return true;
+	}
+
+	u32 a = lhs.data_u32;
+	u32 b = rhs.data_u32;
+	b32 is_signed = (operand_type == NumericDatatype_I32);
+
+	switch (opcode)
+	{
+		case IrOpcode_BitwiseOr:		result->data_u32 = a | b; break;
+		case IrOpcode_BitwiseXor:		result->data_u32 = a ^ b; break;
+		case IrOpcode_BitwiseAnd:		result->data_u32 = a & b; break;
+		case IrOpcode_Equal:			result->data_b32 = (a == b); break;
+		case IrOpcode_NotEqual:			result->data_b32 = (a != b); break;
+		case IrOpcode_Less:				result->data_b32 = is_signed ? (lhs.data_i32 < rhs.data_i32) : (a < b); break;
+		case IrOpcode_Greater:			result->data_b32 = is_signed ? (lhs.data_i32 > rhs.data_i32) : (a > b); break;
+		case IrOpcode_LessEqual:		result->data_b32 = is_signed ? (lhs.data_i32 <= rhs.data_i32) : (a <= b); break;
+		case IrOpcode_GreaterEqual:		result->data_b32 = is_signed ? (lhs.data_i32 >= rhs.data_i32) : (a >= b); break;
+		case IrOpcode_Addition:			result->data_u32 = a + b; break;
+		case IrOpcode_Subtraction:		result->data_u32 = a - b; break;
+		case IrOpcode_Multiplication:	result->data_u32 = a * b; break;
+
+		// The shift instructions only look at the low 5 bits of the count.
+		case IrOpcode_LeftShift:
+			result->data_u32 = a << (b & 31);
+			break;
+		case IrOpcode_RightShift:
+			result->data_u32 = (is_signed && (a >> 31)) ? ~(~a >> (b & 31)) : (a >> (b & 31));
+			break;
+
+		// Division by zero, and the one signed division that overflows, trap at run time.
+		case IrOpcode_Division:
+		case IrOpcode_Modulo:
+			if (b == 0 || (is_signed && a == 0x80000000 && b == 0xFFFFFFFF))
+			{
+				return false;
+			}
+			if (opcode == IrOpcode_Division)
+			{
+				result->data_u32 = is_signed ? (u32)(lhs.data_i32 / rhs.data_i32) : (a / b);
+			}
+			else
+			{
+				result->data_u32 = is_signed ? (u32)(lhs.data_i32 % rhs.data_i32) : (a % b);
+			}
+			break;
+
+		default:
+			return false;
+	}
+	return true;
+}
+
+static b32 evaluate_unary(IrOpcode opcode, NumericDatatype data_type, NumericLiteral operand, NumericLiteral* result)
+{
+	*result = (NumericLiteral){ .type = data_type };
+
+	switch (opcode)
+	{
+		case IrOpcode_Negate:		result->data_u32 = (data_type == NumericDatatype_F32) ? (operand.data_u32 ^ 0x80000000) : (0 - operand.data_u32); break;
+		case IrOpcode_BitwiseNot:	result->data_u32 = ~operand.data_u32; break;
+		case IrOpcode_Not:			result->data_b32 = (operand.data_u32 == 0); break;
+		default:					return false;
+	}
+	return true;
+}
+
+// Same results as the conversion instructions the generator emits. Floats that do not fit are left alone.
+static b32 evaluate_conversion(NumericDatatype to, NumericLiteral operand, NumericLiteral* result)
+{
+	NumericDatatype from = operand.type;
+	*result = (NumericLiteral){ .type = to, .data_u32 = operand.data_u32 };
+
+	if (to == NumericDatatype_B32)
+	{
+		result->data_b32 = (from == NumericDatatype_F32) ? (is_nan(operand) || operand.data_f32 != 0.f) : (operand.data_u32 != 0);
+	}
+	else if (to == NumericDatatype_F32 && from != NumericDatatype_F32)
+	{
+		result->data_f32 = (from == NumericDatatype_U32) ? (f32)operand.data_u32 : (f32)operand.data_i32;
+	}
+	else if (from == NumericDatatype_F32 && to != NumericDatatype_F32)
+	{
+		f32 value = operand.data_f32;
+		if (to == NumericDatatype_I32)
+		{
+			if (is_nan(operand) || value < -2147483648.f || value >= 2147483648.f)
+			{
+				return false;
+			}
+			result->data_i32 = (i32)value;
+		}
+		else
+		{
+			// Truncated to 64 bits, of which the low half is kept.
+			if (is_nan(operand) || value <= -9223372036854775808.f || value >= 9223372036854775808.f)
+			{
+				return false;
+			}
+			result->data_u32 = (u32)(i64)value;
+		}
+	}
+
+	return true;
+}
+
+
+static void set_operand(FoldContext* context, IrValue* operand, IrValue value)
+{
+	--context->use_counts.items[*operand];
+	++context->use_counts.items[value];
+	*operand = value;
+}
+
+static void release_operands(FoldContext* context, IrInstruction* instruction)
+{
+	i32 operand_count;
+	IrValue* operands = ir_get_operands(context->function, instruction, &operand_count);
+	for (i32 i = 0; i < operand_count; ++i)
+	{
+		--context->use_counts.items[operands[i]];
+	}
+}
+
+// Right in front of the instruction being folded, where everything it uses is available.
+static IrValue insert_instruction(FoldContext* context, IrInstruction instruction)
+{
+	IrValue value = ir_insert_instruction(context->function, context->block, context->index++, instruction);
+	array_push(&context->use_counts, 0);
+	array_push(&context->visited, 0);
+
+	i32 operand_count;
+	IrValue* operands = ir_get_operands(context->function, ir_get_instruction(context->function, value), &operand_count);
+	for (i32 i = 0; i < operand_count; ++i)
+	{
+		++context->use_counts.items[operands[i]];
+	}
+	return value;
+}
+
+static IrValue insert_constant(FoldContext* context, NumericLiteral constant)
+{
+	IrInstruction instruction = { .opcode = IrOpcode_Constant, .data_type = constant.type, .constant = constant };
+	return insert_instruction(context, instruction);
+}
+
+static void remove_instruction(FoldContext* context, IrValue value)
+{
+	release_operands(context, ir_get_instruction(context->function, value));
+	ir_remove_instruction(context->function, value);
+}
+
+// Turns the instruction being folded into a constant, in place, so its uses do not have to change.
+static void make_constant(FoldContext* context, IrValue value, NumericLiteral constant)
+{
+	IrFunction* function = context->function;
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	assert(instruction->data_type == constant.type);
+
+	b32 was_phi = (instruction->opcode == IrOpcode_Phi);
+	i64 phi_end = ir_get_first_non_phi(function, context->block);
+
+	release_operands(context, instruction);
+	instruction->opcode = IrOpcode_Constant;
+	instruction->constant = constant;
+
+	if (was_phi)
+	{
+		// Constants go after the phis, so it moves to the end of them. The next phi moves up into the current position.
+		IrBlock* block = ir_get_block(function, context->block);
+		memmove(block->instructions.items + context->index, block->instructions.items + context->index + 1, sizeof(IrValue) * (phi_end - context->index - 1));
+		block->instructions.items[phi_end - 1] = value;
+		--context->index;
+	}
+
+	context->changed = true;
+}
+
+// A phi folds if everything that flows into it is the same constant, which is how constant locals propagate through
+// branches and loops. Phis that feed each other, like those of a variable assigned the same constant inside a loop,
+// are looked through.
+static void fold_phi(FoldContext* context, IrValue value)
+{
+	IrFunction* function = context->function;
+
+	++context->visit_stamp;
+	context->visited.items[value] = context->visit_stamp;
+	context->phi_stack.count = 0;
+	array_push(&context->phi_stack, value);
+
+	b32 found = false;
+	NumericLiteral same = { 0 };
+
+	while (context->phi_stack.count)
+	{
+		IrOperandList phi = ir_get_instruction(function, context->phi_stack.items[--context->phi_stack.count])->phi;
+
+		for (i32 i = 0; i < phi.operand_count; ++i)
+		{
+			IrValue operand = function->operands.items[phi.first_operand + i];
+
+			if (ir_get_instruction(function, operand)->opcode == IrOpcode_Phi)
+			{
+				if (context->visited.items[operand] != context->visit_stamp)
+				{
+					context->visited.items[operand] = context->visit_stamp;
+					array_push(&context->phi_stack, operand);
+				}
+				continue;
+			}
+
+			NumericLiteral constant;
+			if (!get_constant(function, operand, &constant) || (found && constant.data_u32 != same.data_u32))
+			{
+				return;
+			}
+			same = constant;
+			found = true;
+		}
+	}
+
+	if (found)
+	{
+		make_constant(context, value, same);
+	}
+}
+
+// For a chain of one reassociable operation, moves constants outwards one step at a time, until they meet:
+// (a + c1) + c2 -> a + (c1 + c2), (a + c) + b -> (a + b) + c, and a + (b + c) -> (a + b) + c. Only when the inner
+// operation has no other uses, so nothing is computed twice.
+static void reassociate(FoldContext* context, IrValue value)
+{
+	IrFunction* function = context->function;
+	IrInstruction instruction = *ir_get_instruction(function, value);
+	IrValue lhs = instruction.binary.lhs;
+	IrValue rhs = instruction.binary.rhs;
+
+	for (i32 side = 0; side < 2; ++side)
+	{
+		IrValue inner_value = side ? rhs : lhs;
+		IrValue other = side ? lhs : rhs;
+		IrInstruction inner = *ir_get_instruction(function, inner_value);
+
+		if (inner.opcode != instruction.opcode || inner.data_type != instruction.data_type || context->use_counts.items[inner_value] != 1)
+		{
+			continue;
+		}
+
+		NumericLiteral inner_constant;
+		if (!get_constant(function, inner.binary.rhs, &inner_constant))
+		{
+			continue;
+		}
+
+		NumericLiteral other_constant;
+		if (get_constant(function, other, &other_constant))
+		{
+			assert(side == 0); // Constants were moved to the right.
+
+			NumericLiteral combined;
+			b32 evaluated = evaluate_binary(instruction.opcode, instruction.data_type, inner_constant, other_constant, &combined);
+			assert(evaluated);
+
+			IrValue constant = insert_constant(context, combined);
+			IrInstruction* current = ir_get_instruction(function, value);
+			set_operand(context, &current->binary.lhs, inner.binary.lhs);
+			set_operand(context, &current->binary.rhs, constant);
+		}
+		else
+		{
+			IrInstruction combined = { .opcode = instruction.opcode, .data_type = instruction.data_type, .binary = { .lhs = inner.binary.lhs, .rhs = other } };
+			if (side)
+			{
+				combined.binary = (IrBinary){ .lhs = other, .rhs = inner.binary.lhs };
+			}
+
+			IrValue combined_value = insert_instruction(context, combined);
+			IrInstruction* current = ir_get_instruction(function, value);
+			set_operand(context, &current->binary.lhs, combined_value);
+			set_operand(context, &current->binary.rhs, inner.binary.rhs);
+		}
+
+		remove_instruction(context, inner_value);
+		context->changed = true;
+		return;
+	}
+}
+
+static void fold_binary(FoldContext* context, IrValue value)
+{
+	IrFunction* function = context->function;
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	NumericDatatype operand_type = ir_get_instruction(function, instruction->binary.lhs)->data_type;
+
+	NumericLiteral lhs;
+	NumericLiteral rhs;
+	b32 lhs_is_constant = get_constant(function, instruction->binary.lhs, &lhs);
+	b32 rhs_is_constant = get_constant(function, instruction->binary.rhs, &rhs);
+
+	if (lhs_is_constant && rhs_is_constant)
+	{
+		NumericLiteral result;
+		if (evaluate_binary(instruction->opcode, operand_type, lhs, rhs, &result))
+		{
+			make_constant(context, value, result);
+		}
+		return;
+	}
+
+	if (!is_reassociable(instruction->opcode, instruction->data_type) && !(instruction->opcode == IrOpcode_Subtraction && operand_type != NumericDatatype_F32))
+	{
+		return;
+	}
+
+	// x - c is x + -c, which can take part in chains of additions.
+	if (instruction->opcode == IrOpcode_Subtraction)
+	{
+		if (!rhs_is_constant)
+		{
+			return;
+		}
+
+		NumericLiteral negated;
+		evaluate_unary(IrOpcode_Negate, operand_type, rhs, &negated);
+		IrValue constant = insert_constant(context, negated);
+
+		instruction = ir_get_instruction(function, value);
+		instruction->opcode = IrOpcode_Addition;
+		set_operand(context, &instruction->binary.rhs, constant);
+		context->changed = true;
+	}
+
+	// Constants to the right.
+	if (lhs_is_constant)
+	{
+		IrValue swap = instruction->binary.lhs;
+		instruction->binary.lhs = instruction->binary.rhs;
+		instruction->binary.rhs = swap;
+		context->changed = true;
+	}
+
+	reassociate(context, value);
+}
+
+static void fold_instruction(FoldContext* context, IrValue value)
+{
+	IrFunction* function = context->function;
+	IrInstruction* instruction = ir_get_instruction(function, value);
+
+	NumericLiteral operand;
+	NumericLiteral result;
+
+	if (instruction->opcode == IrOpcode_Phi)
+	{
+		fold_phi(context, value);
+	}
+	else if (instruction->opcode == IrOpcode_Convert)
+	{
+		if (get_constant(function, instruction->convert.operand, &operand) && evaluate_conversion(instruction->data_type, operand, &result))
+		{
+			make_constant(context, value, result);
+		}
+	}
+	else if (ir_is_unary_operation(instruction->opcode))
+	{
+		if (get_constant(function, instruction->unary.operand, &operand) && evaluate_unary(instruction->opcode, instruction->data_type, operand, &result))
+		{
+			make_constant(context, value, result);
+		}
+	}
+	else if (ir_is_binary_operation(instruction->opcode))
+	{
+		fold_binary(context, value);
+	}
+}
+
+b32 fold_constants(IrFunction* function)
+{
+	FoldContext context = { .function = function };
+
+	array_reserve(&context.use_counts, function->instructions.count);
+	context.use_counts.count = function->instructions.count;
+	ir_count_uses(function, context.use_counts.items);
+
+	array_reserve(&context.visited, function->instructions.count);
+	context.visited.count = function->instructions.count;
+	memset(context.visited.items, 0, sizeof(u32) * function->instructions.count);
+
+	i32* order = malloc(sizeof(i32) * function->blocks.count);
+	i32 order_count = ir_compute_reverse_postorder(function, order);
+
+	// Operands come before their uses in reverse postorder, except for phis at loop headers, which only fold once the
+	// values coming around the back edge have.
+	b32 result = false;
+	do
+	{
+		context.changed = false;
+
+		for (i32 i = 0; i < order_count; ++i)
+		{
+			context.block = order[i];
+			for (context.index = 0; context.index < ir_get_block(function, context.block)->instructions.count; ++context.index)
+			{
+				IrValue value = ir_get_block(function, context.block)->instructions.items[context.index];
+				if (ir_get_instruction(function, value)->opcode != IrOpcode_Removed)
+				{
+					fold_instruction(&context, value);
+				}
+			}
+		}
+
+		result |= context.changed;
+	} while (context.changed);
+
+	ir_compact_blocks(function);
+
+	free(order);
+	array_free(&context.use_counts);
+	array_free(&context.visited);
+	array_free(&context.phi_stack);
+
+	return result;
+}
@@ -25,6 +25,11 @@ static b32 numeric_converts_to_b32(NumericDatatype type)
 	return type == NumericDatatype_B32 || numeric_is_integral(type);
 }
 
+static i32 numeric_size(NumericDatatype type)
+{
+	return 4; // All of them are 32 bits wide so far.
+}
+
 
 struct NumericLiteral
 {
@@ -0,0 +1,315 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+static i64 count_instructions(IrFunction* function)
+{
+	i64 count = 0;
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		count += ir_get_block(function, (i32)i)->instructions.count;
+	}
+	return count;
+}
+
+// Drops one edge from -> to, together with the phi operands that belong to it.
+static void remove_edge(IrFunction* function, i32 from, i32 to)
+{
+	IrBlock* block = ir_get_block(function, to);
+
+	i64 index = 0;
+	while (block->predecessors.items[index] != from)
+	{
+		++index;
+	}
+
+	for (i64 i = 0; i < block->instructions.count; ++i)
+	{
+		IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[i]);
+		if (instruction->opcode != IrOpcode_Phi)
+		{
+			break;
+		}
+
+		IrValue* operands = function->operands.items + instruction->phi.first_operand;
+		memmove(operands + index, operands + index + 1, sizeof(IrValue) * (instruction->phi.operand_count - 1 - index));
+		--instruction->phi.operand_count;
+	}
+
+	memmove(block->predecessors.items + index, block->predecessors.items + index + 1, sizeof(i32) * (block->predecessors.count - 1 - index));
+	--block->predecessors.count;
+}
+
+// Branches on a constant, or to the same block either way, become jumps. Whatever only the other side reached is then
+// unreachable, which covers both arms of an if and loops whose condition is known.
+static b32 fold_branches(IrFunction* function)
+{
+	b32 changed = false;
+
+	for (i32 block = 0; block < function->blocks.count; ++block)
+	{
+		IrInstruction* terminator = ir_get_terminator(function, block);
+		if (terminator->opcode != IrOpcode_Branch)
+		{
+			continue;
+		}
+
+		IrBranch branch = terminator->branch;
+		IrInstruction* condition = ir_get_instruction(function, branch.condition);
+
+		i32 target;
+		if (branch.then_block == branch.else_block)
+		{
+			target = branch.then_block;
+		}
+		else if (condition->opcode == IrOpcode_Constant)
+		{
+			target = condition->constant.data_b32 ? branch.then_block : branch.else_block;
+		}
+		else
+		{
+			continue;
+		}
+
+		remove_edge(function, block, (target == branch.then_block) ? branch.else_block : branch.then_block);
+
+		terminator->opcode = IrOpcode_Jump;
+		terminator->jump.target = target;
+		changed = true;
+	}
+
+	return changed;
+}
+
+static IrValue resolve(i32* forward, IrValue value)
+{
+	while (forward[value] != IR_NO_VALUE)
+	{
+		value = forward[value];
+	}
+	return value;
+}
+
+// Phis that select the same value on every edge, which is what remains of a merge once all but one way into it is
+// gone, are replaced by that value.
+static b32 remove_trivial_phis(IrFunction* function)
+{
+	i64 instruction_count = function->instructions.count;
+
+	i32* forward = malloc(sizeof(i32) * instruction_count);
+	for (i64 i = 0; i < instruction_count; ++i)
+	{
+		forward[i] = IR_NO_VALUE;
+	}
+
+	b32 result = false;
+	b32 changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (i64 i = 0; i < instruction_count; ++i)
+		{
+			IrInstruction* instruction = &function->instructions.items[i];
+			if (instruction->opcode != IrOpcode_Phi || forward[i] != IR_NO_VALUE)
+			{
+				continue;
+			}
+
+			IrValue same = IR_NO_VALUE;
+			b32 trivial = true;
+			for (i32 j = 0; j < instruction->phi.operand_count && trivial; ++j)
+			{
+				IrValue operand = resolve(forward, function->operands.items[instruction->phi.first_operand + j]);
+				if (operand != (IrValue)i && operand != same)
+				{
+					trivial = (same == IR_NO_VALUE);
+					same = operand;
+				}
+			}
+
+			if (trivial && same != IR_NO_VALUE)
+			{
+				forward[i] = same;
+				changed = true;
+			}
+		}
+		result |= changed;
+	}
+
+	if (result)
+	{
+		for (i64 i = 0; i < instruction_count; ++i)
+		{
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &operand_count);
+			for (i32 j = 0; j < operand_count; ++j)
+			{
+				operands[j] = resolve(forward, operands[j]);
+			}
+		}
+
+		for (i64 i = 0; i < instruction_count; ++i)
+		{
+			if (forward[i] != IR_NO_VALUE)
+			{
+				ir_remove_instruction(function, (IrValue)i);
+			}
+		}
+		ir_compact_blocks(function);
+	}
+
+	free(forward);
+
+	return result;
+}
+
+// A block that is the only way into its successor absorbs it. The successor is left without predecessors, to be
+// removed as unreachable. Expects trivial phis to be gone already, since the successor's phis would be.
+static b32 merge_blocks(IrFunction* function)
+{
+	b32 changed = false;
+
+	for (i32 block = 0; block < function->blocks.count; ++block)
+	{
+		while (true)
+		{
+			IrInstruction* terminator = ir_get_terminator(function, block);
+			if (!terminator || terminator->opcode != IrOpcode_Jump)
+			{
+				break;
+			}
+
+			i32 target = terminator->jump.target;
+			IrBlock* successor = ir_get_block(function, target);
+			if (target == block || target == 0 || successor->predecessors.count != 1)
+			{
+				break;
+			}
+			assert(ir_get_first_non_phi(function, target) == 0);
+
+			IrBlock* b = ir_get_block(function, block);
+			ir_remove_instruction(function, b->instructions.items[--b->instructions.count]);
+
+			for (i64 i = 0; i < successor->instructions.count; ++i)
+			{
+				IrValue value = successor->instructions.items[i];
+				ir_get_instruction(function, value)->block = block;
+				array_push(&b->instructions, value);
+			}
+			successor->instructions.count = 0;
+			successor->predecessors.count = 0;
+
+			// Successors of the absorbed block are now reached from this one.
+			i32 successors[2];
+			i32 successor_count = ir_get_successors(function, block, successors);
+			for (i32 i = 0; i < successor_count; ++i)
+			{
+				if (i > 0 && successors[i] == successors[0])
+				{
+					continue;
+				}
+
+				IrBlock* next = ir_get_block(function, successors[i]);
+				for (i64 j = 0; j < next->predecessors.count; ++j)
+				{
+					if (next->predecessors.items[j] == target)
+					{
+						next->predecessors.items[j] = block;
+					}
+				}
+			}
+
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// Marks everything that side effects depend on, then removes the rest. Unlike counting uses, this also catches cycles
+// of phis that only feed each other, as left behind by locals that are written in a loop but never read after it.
+static b32 remove_dead_instructions(IrProgram* ir, IrFunction* function)
+{
+	i64 instruction_count = function->instructions.count;
+
+	b32* live = calloc(instruction_count, sizeof(b32));
+	IrValue* worklist = malloc(sizeof(IrValue) * instruction_count);
+	i64 worklist_count = 0;
+
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrValue value = block->instructions.items[j];
+			if (has_side_effects(ir, function, ir_get_instruction(function, value)))
+			{
+				live[value] = true;
+				worklist[worklist_count++] = value;
+			}
+		}
+	}
+
+	while (worklist_count)
+	{
+		IrValue value = worklist[--worklist_count];
+
+		i32 operand_count;
+		IrValue* operands = ir_get_operands(function, ir_get_instruction(function, value), &operand_count);
+		for (i32 i = 0; i < operand_count; ++i)
+		{
+			if (!live[operands[i]])
+			{
+				live[operands[i]] = true;
+				worklist[worklist_count++] = operands[i];
+			}
+		}
+	}
+
+	b32 changed = false;
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrValue value = block->instructions.items[j];
+			if (!live[value])
+			{
+				ir_remove_instruction(function, value);
+				changed = true;
+			}
+		}
+	}
+	ir_compact_blocks(function);
+
+	free(worklist);
+	free(live);
+
+	return changed;
+}
+
+b32 eliminate_dead_code(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics)
+{
+	i64 block_count = function->blocks.count;
+	i64 instruction_count = count_instructions(function);
+
+	if (fold_branches(function))
+	{
+		ir_remove_unreachable_blocks(function);
+	}
+	remove_trivial_phis(function);
+	if (merge_blocks(function))
+	{
+		ir_remove_unreachable_blocks(function);
+	}
+	remove_dead_instructions(ir, function);
+
+	i64 removed_blocks = block_count - function->blocks.count;
+	i64 removed_instructions = instruction_count - count_instructions(function);
+
+	statistics->removed_blocks += removed_blocks;
+	statistics->removed_instructions += removed_instructions;
+
+	return (removed_blocks + removed_instructions) > 0;
+}
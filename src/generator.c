@@ -1,29 +1,39 @@
-#include "program.h"
+#include "ir.h"
 
 #include <assert.h>
 
 
 // https://sonictk.github.io/asm_tutorial/#hello,worldrevisted/callingfunctionsinassembly
 
-static void stack_push(const char* from, String* assembly)
+typedef StringBuffer AssemblyBuffer;
+
+static void assembly_push(AssemblyBuffer* assembly, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	string_buffer_push_va(assembly, format, args);
+	va_end(args);
+}
+
+static void stack_push(const char* from, AssemblyBuffer* assembly)
 {
-	string_push(assembly, "    push %s\n", from);
+	assembly_push(assembly, "    push %s\n", from);
 }
 
-static void stack_pop(const char* reg, String* assembly)
+static void stack_pop(const char* reg, AssemblyBuffer* assembly)
 {
-	string_push(assembly, "    pop %s\n", reg);
+	assembly_push(assembly, "    pop %s\n", reg);
 }
 
-static void generate_exit(String* assembly)
+static void generate_exit(AssemblyBuffer* assembly)
 {
 	stack_pop("rcx", assembly);
-	string_push(assembly, "    call ExitProcess\n");
+	assembly_push(assembly, "    call ExitProcess\n");
 }
 
-static void generate_function_header(String name, i64 stack_size, String* assembly)
+static void generate_function_header(String name, i64 stack_size, AssemblyBuffer* assembly)
 {
-	string_push(assembly,
+	assembly_push(assembly,
 		"_%.*s:\n"
 		"    push rbp\n"
 		"    mov rbp, rsp\n"
@@ -31,270 +41,1060 @@ static void generate_function_header(String name, i64 stack_size, String* assemb
 		(i32)name.len, name.str, (i32)stack_size);
 }
 
-static void generate_return(String* assembly)
+static void generate_return(AssemblyBuffer* assembly)
 {
-	string_push(assembly, 
+	assembly_push(assembly,
 		"    leave\n"
 		"    ret\n"
 	);
 }
 
-static void generate_expression(Program* program, ExpressionHandle expression_handle, String* assembly)
+
+// Every value lives in a stack slot of its own size, except for constants and undefined values, which are materialized
+// at each use, and parameters, which stay where the caller and the header spill them. Slots are shared between values
+// whose live intervals do not overlap. Positions are instruction indices in the order in which blocks are emitted, and
+// an interval spans everything from the first to the last position at which the value is live.
+struct LiveInterval
+{
+	i32 start;
+	i32 end;
+};
+typedef struct LiveInterval LiveInterval;
+
+// Scratch space for the function being generated, reused across functions.
+struct GeneratorContext
 {
-	Expression* expression = program_get_expression(program, expression_handle);
+	Program* program;
+	IrFunction* function;
+	AssemblyBuffer* assembly;
+
+	DynamicArray(i32) order; // Reachable blocks, in the order in which they are emitted.
+	DynamicArray(i32) order_index; // Per block, -1 if unreachable.
+	DynamicArray(i32) block_start; // Per block: Position of the first instruction.
+	DynamicArray(i32) block_end; // Per block: Position of the terminator.
+
+	DynamicArray(u64) live_in; // Per block, one bit per value.
+	DynamicArray(u64) live_out;
+	i64 words_per_set;
 
-	if (expression->type == ExpressionType_Identifier)
+	DynamicArray(LiveInterval) intervals; // Per value.
+	DynamicArray(i32) offsets; // Per value: Offset of its slot from the frame pointer, 0 if it has none.
+	DynamicArray(i32) by_start; // Values with a slot, sorted by start.
+	DynamicArray(i32) by_end; // Values with a slot, sorted by end.
+	DynamicArray(i32) buckets;
+	DynamicArray(i32) free_slots[4]; // Offsets of unused slots, by log2 of their size.
+};
+typedef struct GeneratorContext GeneratorContext;
+
+
+static b32 needs_slot(IrInstruction* instruction)
+{
+	switch (instruction->opcode)
 	{
-		char from[32];
-		snprintf(from, sizeof(from), "QWORD [rbp%+d]", expression->identifier.offset_from_frame_pointer);
+		case IrOpcode_Removed:
+		case IrOpcode_Constant:
+		case IrOpcode_Undefined:
+		case IrOpcode_Parameter:
+			return false;
+	}
+	return !ir_is_terminator(instruction->opcode);
+}
 
-		stack_push(from, assembly);
+static i32 predecessor_index(IrFunction* function, i32 block, i32 predecessor)
+{
+	IrBlock* b = ir_get_block(function, block);
+	for (i32 i = 0; i < b->predecessors.count; ++i)
+	{
+		if (b->predecessors.items[i] == predecessor)
+		{
+			return i;
+		}
 	}
-	else if (expression->type == ExpressionType_NumericLiteral)
+	assert(false);
+	return -1;
+}
+
+static void set_bit(u64* set, IrValue value) { set[value >> 6] |= 1ull << (value & 63); }
+static void clear_bit(u64* set, IrValue value) { set[value >> 6] &= ~(1ull << (value & 63)); }
+static b32 test_bit(u64* set, IrValue value) { return (set[value >> 6] >> (value & 63)) & 1; }
+
+static void extend_interval(GeneratorContext* context, IrValue value, i32 position)
+{
+	LiveInterval* interval = &context->intervals.items[value];
+	interval->start = min(interval->start, position);
+	interval->end = max(interval->end, position);
+}
+
+// Backwards dataflow over the reachable blocks. A phi is live into its own block, and its operands are live out of the
+// corresponding predecessors.
+static void compute_liveness(GeneratorContext* context)
+{
+	IrFunction* function = context->function;
+	i64 block_count = function->blocks.count;
+	i64 words = context->words_per_set = (function->instructions.count + 63) / 64;
+
+	array_reserve(&context->live_in, block_count * words);
+	array_reserve(&context->live_out, block_count * words);
+	memset(context->live_in.items, 0, sizeof(u64) * block_count * words);
+	memset(context->live_out.items, 0, sizeof(u64) * block_count * words);
+
+	// Live in = (live out - definitions) + uses, walking the block backwards.
+	u64* live = malloc(sizeof(u64) * max(words, 1));
+	u64* edge = malloc(sizeof(u64) * max(words, 1));
+
+	b32 changed = true;
+	while (changed)
 	{
-		string_push(assembly, "    mov rax, %s\n", serialize_numeric_literal(expression->numeric_literal));
-		stack_push("rax", assembly);
+		changed = false;
+
+		for (i32 i = (i32)context->order.count - 1; i >= 0; --i)
+		{
+			i32 block = context->order.items[i];
+			IrBlock* b = ir_get_block(function, block);
+			u64* live_in = context->live_in.items + block * words;
+			u64* live_out = context->live_out.items + block * words;
+
+			// Each edge separately, since a phi of one successor may be live into the other.
+			i32 successors[2];
+			i32 successor_count = ir_get_successors(function, block, successors);
+			for (i32 j = 0; j < successor_count; ++j)
+			{
+				i32 successor = successors[j];
+				IrBlock* s = ir_get_block(function, successor);
+				memcpy(edge, context->live_in.items + successor * words, sizeof(u64) * words);
+
+				i32 operand_index = predecessor_index(function, successor, block);
+				for (i64 k = 0; k < s->instructions.count; ++k)
+				{
+					IrInstruction* phi = ir_get_instruction(function, s->instructions.items[k]);
+					if (phi->opcode != IrOpcode_Phi)
+					{
+						break;
+					}
+					clear_bit(edge, s->instructions.items[k]);
+					set_bit(edge, function->operands.items[phi->phi.first_operand + operand_index]);
+				}
+
+				for (i64 k = 0; k < words; ++k)
+				{
+					live_out[k] |= edge[k];
+				}
+			}
+
+			memcpy(live, live_out, sizeof(u64) * words);
+
+			for (i64 k = b->instructions.count - 1; k >= 0; --k)
+			{
+				IrValue value = b->instructions.items[k];
+				IrInstruction* instruction = ir_get_instruction(function, value);
+
+				if (instruction->opcode == IrOpcode_Phi)
+				{
+					set_bit(live, value);
+					continue;
+				}
+
+				clear_bit(live, value);
+
+				i32 operand_count;
+				IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+				for (i32 j = 0; j < operand_count; ++j)
+				{
+					set_bit(live, operands[j]);
+				}
+			}
+
+			if (memcmp(live, live_in, sizeof(u64) * words) != 0)
+			{
+				memcpy(live_in, live, sizeof(u64) * words);
+				changed = true;
+			}
+		}
 	}
-	else if (expression_is_binary_operation(expression->type))
+
+	free(live);
+	free(edge);
+}
+
+static void compute_intervals(GeneratorContext* context)
+{
+	IrFunction* function = context->function;
+	i64 words = context->words_per_set;
+
+	array_reserve(&context->intervals, function->instructions.count);
+	context->intervals.count = function->instructions.count;
+	for (i64 i = 0; i < function->instructions.count; ++i)
 	{
-		BinaryExpression e = expression->binary;
+		context->intervals.items[i] = (LiveInterval){ .start = INT32_MAX, .end = -1 };
+	}
 
-		generate_expression(program, e.lhs, assembly);
-		generate_expression(program, e.rhs, assembly);
+	for (i64 i = 0; i < context->order.count; ++i)
+	{
+		i32 block = context->order.items[i];
+		IrBlock* b = ir_get_block(function, block);
+		i32 start = context->block_start.items[block];
+		i32 end = context->block_end.items[block];
 
-		stack_pop("rbx", assembly);
-		stack_pop("rax", assembly);
+		u64* live_in = context->live_in.items + block * words;
+		u64* live_out = context->live_out.items + block * words;
+		for (i64 w = 0; w < words; ++w)
+		{
+			if (!(live_in[w] | live_out[w]))
+			{
+				continue;
+			}
+			for (IrValue k = (IrValue)w * 64; k < min((w + 1) * 64, function->instructions.count); ++k)
+			{
+				if (test_bit(live_in, k)) { extend_interval(context, k, start); }
+				if (test_bit(live_out, k)) { extend_interval(context, k, end); }
+			}
+		}
 
-		switch (expression->type)
+		for (i64 k = 0; k < b->instructions.count; ++k)
 		{
-			case ExpressionType_LogicalOr:		break;
-			case ExpressionType_LogicalAnd:		break;
-			case ExpressionType_BitwiseOr:		string_push(assembly, "    or rax, rbx\n"); break; // https://www.felixcloutier.com/x86/or
-			case ExpressionType_BitwiseXor:		string_push(assembly, "    xor rax, rbx\n"); break; // https://www.felixcloutier.com/x86/xor
-			case ExpressionType_BitwiseAnd:		string_push(assembly, "    and rax, rbx\n"); break; // https://www.felixcloutier.com/x86/and
-			case ExpressionType_Equal:			string_push(assembly, "    cmp rax, rbx\n    sete al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_NotEqual:		string_push(assembly, "    cmp rax, rbx\n    setne al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_Less:			string_push(assembly, "    cmp rax, rbx\n    setl al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_Greater:		string_push(assembly, "    cmp rax, rbx\n    setg al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_LessEqual:		string_push(assembly, "    cmp rax, rbx\n    setle al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_GreaterEqual:	string_push(assembly, "    cmp rax, rbx\n    setge al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			case ExpressionType_LeftShift:		string_push(assembly, "    shlx rax, rax, rbx\n"); break; // https://www.felixcloutier.com/x86/sarx:shlx:shrx
-			case ExpressionType_RightShift:		string_push(assembly, "    shrx rax, rax, rbx\n"); break; // https://www.felixcloutier.com/x86/sarx:shlx:shrx
-			case ExpressionType_Addition:		string_push(assembly, "    add rax, rbx\n"); break; // https://www.felixcloutier.com/x86/add
-			case ExpressionType_Subtraction:	string_push(assembly, "    sub rax, rbx\n"); break; // https://www.felixcloutier.com/x86/sub
-			case ExpressionType_Multiplication: string_push(assembly, "    imul rax, rbx\n"); break; // https://www.felixcloutier.com/x86/imul
-			case ExpressionType_Division:		string_push(assembly, "    cqo\n    idiv rbx\n"); break; // https://www.felixcloutier.com/x86/idiv
-			case ExpressionType_Modulo:			string_push(assembly, "    cqo\n    idiv rbx\n    mov rax, rdx\n"); break; // https://www.felixcloutier.com/x86/idiv
-			default:							assert(false);
+			IrValue value = b->instructions.items[k];
+			IrInstruction* instruction = ir_get_instruction(function, value);
+			i32 position = start + (i32)k;
+
+			extend_interval(context, value, position);
+
+			if (instruction->opcode == IrOpcode_Phi)
+			{
+				// Written by the copies at the end of each predecessor.
+				for (i64 j = 0; j < b->predecessors.count; ++j)
+				{
+					i32 predecessor = b->predecessors.items[j];
+					if (context->order_index.items[predecessor] >= 0)
+					{
+						extend_interval(context, value, context->block_end.items[predecessor]);
+					}
+				}
+				continue;
+			}
+
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+			for (i32 j = 0; j < operand_count; ++j)
+			{
+				extend_interval(context, operands[j], position);
+			}
 		}
+	}
+}
 
-		stack_push("rax", assembly);
+// Counting sort, since positions are instruction indices from 0 to position_count.
+static void sort_intervals(GeneratorContext* context, i32 position_count, b32 by_end, i32* sorted)
+{
+	LiveInterval* intervals = context->intervals.items;
+	i32* values = context->by_start.items; // Both lists hold the same values.
+	i64 value_count = context->by_start.count;
+	if (!value_count)
+	{
+		return;
 	}
-	else if (expression_is_unary_operation(expression->type))
+
+	i32 bucket_count = position_count + 1;
+	array_reserve(&context->buckets, bucket_count);
+	i32* buckets = context->buckets.items;
+	memset(buckets, 0, sizeof(i32) * bucket_count);
+
+	for (i64 i = 0; i < value_count; ++i)
 	{
-		UnaryExpression e = expression->unary;
+		i32 position = by_end ? intervals[values[i]].end : intervals[values[i]].start;
+		++buckets[position + 1];
+	}
+
+	for (i32 i = 1; i < bucket_count; ++i)
+	{
+		buckets[i] += buckets[i - 1];
+	}
+
+	i32* unsorted = malloc(sizeof(i32) * value_count);
+	memcpy(unsorted, values, sizeof(i32) * value_count);
+	for (i64 i = 0; i < value_count; ++i)
+	{
+		i32 position = by_end ? intervals[unsorted[i]].end : intervals[unsorted[i]].start;
+		sorted[buckets[position]++] = unsorted[i];
+	}
+	free(unsorted);
+}
+
+static i32 slot_size_class(i32 size)
+{
+	assert(size == 1 || size == 2 || size == 4 || size == 8);
+	return (size >= 4) * 2 + (size == 2 || size == 8);
+}
 
-		generate_expression(program, e.rhs, assembly);
+// Linear scan over the intervals in order of their start, releasing slots in order of their end. Returns the frame size
+// in bytes. Every slot is aligned to its size. A new slot is only added when none of its size is free, so the frame
+// never holds more slots of a size than there are values of that size live at one position.
+static i32 assign_stack_slots(GeneratorContext* context, i32 position_count)
+{
+	IrFunction* function = context->function;
+	LiveInterval* intervals = context->intervals.items;
 
-		stack_pop("rax", assembly);
+	array_reserve(&context->offsets, function->instructions.count);
+	context->offsets.count = function->instructions.count;
+	memset(context->offsets.items, 0, sizeof(i32) * function->instructions.count);
 
-		switch (expression->type)
+	context->by_start.count = 0;
+	for (i64 i = 0; i < function->instructions.count; ++i)
+	{
+		IrInstruction* instruction = ir_get_instruction(function, (IrValue)i);
+		if (needs_slot(instruction) && intervals[i].end >= 0)
 		{
-			case ExpressionType_Negate:			string_push(assembly, "    neg rax\n"); break; // https://www.felixcloutier.com/x86/neg
-			case ExpressionType_BitwiseNot:		string_push(assembly, "    not rax\n"); break; // https://www.felixcloutier.com/x86/not
-			case ExpressionType_Not:			string_push(assembly, "    cmp rax, 0\nsete al\nmovzx eax, al\n"); break; // https://www.felixcloutier.com/x86/cmp
-			default:							assert(false);
+			array_push(&context->by_start, (i32)i);
 		}
+	}
+	i64 value_count = context->by_start.count;
+
+	array_reserve(&context->by_end, value_count);
+	context->by_end.count = value_count;
+	sort_intervals(context, position_count, true, context->by_end.items);
+	sort_intervals(context, position_count, false, context->by_start.items);
 
-		stack_push("rax", assembly);
+	for (i32 i = 0; i < arraysize(context->free_slots); ++i)
+	{
+		context->free_slots[i].count = 0;
 	}
-	else if (expression->type == ExpressionType_Assignment)
+
+	i32 frame_size = 0;
+	i64 next_end = 0;
+
+	for (i64 i = 0; i < value_count; ++i)
 	{
-		AssignmentExpression e = expression->assignment;
+		IrValue value = context->by_start.items[i];
 
-		Expression* lhs = program_get_expression(program, e.lhs);
-		assert(lhs->type == ExpressionType_Identifier); // Temporary.
+		// A slot is only reused once its interval has ended strictly before this one starts.
+		for (; next_end < value_count; ++next_end)
+		{
+			IrValue ended = context->by_end.items[next_end];
+			if (intervals[ended].end >= intervals[value].start)
+			{
+				break;
+			}
 
-		generate_expression(program, e.rhs, assembly);
+			i32 size_class = slot_size_class(numeric_size(ir_get_instruction(function, ended)->data_type));
+			array_push(&context->free_slots[size_class], context->offsets.items[ended]);
+		}
+
+		i32 size = numeric_size(ir_get_instruction(function, value)->data_type);
+		i32 size_class = slot_size_class(size);
 
-		stack_pop("rax", assembly);
-		string_push(assembly, "    mov [rbp%+d], rax\n", lhs->identifier.offset_from_frame_pointer);
-		stack_push("rax", assembly);
+		if (context->free_slots[size_class].count)
+		{
+			context->offsets.items[value] = context->free_slots[size_class].items[--context->free_slots[size_class].count];
+		}
+		else
+		{
+			frame_size = (frame_size + size + size - 1) & ~(size - 1);
+			context->offsets.items[value] = -frame_size;
+		}
 	}
-	else if (expression->type == ExpressionType_FunctionCall)
+
+	return frame_size;
+}
+
+
+static const char* register_names[][2] =
+{
+	{ "eax", "rax" },
+	{ "ecx", "rcx" },
+	{ "edx", "rdx" },
+	{ "r8d", "r8" },
+	{ "r9d", "r9" },
+};
+
+enum Register
+{
+	Register_A,
+	Register_C,
+	Register_D,
+	Register_R8,
+	Register_R9,
+};
+typedef enum Register Register;
+
+// All values are 32 bits wide. Floats travel through general purpose registers as their bit pattern.
+static void generate_load(GeneratorContext* context, IrValue value, Register reg)
+{
+	IrInstruction* instruction = ir_get_instruction(context->function, value);
+	const char* name = register_names[reg][0];
+
+	if (instruction->opcode == IrOpcode_Constant)
 	{
-		FunctionCallExpression e = expression->function_call;
-		Function* function = &program->functions.items[e.function_index];
-		assert(function->calling_convention == CallingConvention_Windows_x64);
+		assembly_push(context->assembly, "    mov %s, 0x%08X\n", name, instruction->constant.data_u32);
+	}
+	else if (instruction->opcode == IrOpcode_Undefined)
+	{
+		assembly_push(context->assembly, "    xor %s, %s\n", name, name);
+	}
+	else if (instruction->opcode == IrOpcode_Parameter)
+	{
+		assembly_push(context->assembly, "    mov %s, DWORD [rbp%+d]\n", name, 16 + instruction->parameter_index * 8);
+	}
+	else
+	{
+		assert(context->offsets.items[value] < 0);
+		assembly_push(context->assembly, "    mov %s, DWORD [rbp%+d]\n", name, context->offsets.items[value]);
+	}
+}
 
-		const char* argument_registers[] = { "rcx", "rdx", "r8", "r9" };
+static void generate_store(GeneratorContext* context, IrValue value)
+{
+	assert(context->offsets.items[value] < 0);
+	assembly_push(context->assembly, "    mov DWORD [rbp%+d], eax\n", context->offsets.items[value]);
+}
+
+static void generate_float_operands(AssemblyBuffer* assembly)
+{
+	assembly_push(assembly, "    movd xmm0, eax\n    movd xmm1, ecx\n");
+}
 
-		// Arguments: rcx, rdx, r8, r9
-		// Stack	: [ Shadow space ] arg4 arg5 ...
+// Sets eax to 1 if the comparison of eax with ecx holds, 0 otherwise. Unordered float comparisons are false, except for
+// not equal.
+static void generate_comparison(IrOpcode opcode, NumericDatatype data_type, AssemblyBuffer* assembly)
+{
+	if (data_type == NumericDatatype_F32)
+	{
+		generate_float_operands(assembly);
+		switch (opcode)
+		{
+			case IrOpcode_Equal:		assembly_push(assembly, "    ucomiss xmm0, xmm1\n    sete al\n    setnp cl\n    and al, cl\n"); break; // https://www.felixcloutier.com/x86/ucomiss
+			case IrOpcode_NotEqual:		assembly_push(assembly, "    ucomiss xmm0, xmm1\n    setne al\n    setp cl\n    or al, cl\n"); break;
+			case IrOpcode_Less:			assembly_push(assembly, "    ucomiss xmm1, xmm0\n    seta al\n"); break;
+			case IrOpcode_Greater:		assembly_push(assembly, "    ucomiss xmm0, xmm1\n    seta al\n"); break;
+			case IrOpcode_LessEqual:	assembly_push(assembly, "    ucomiss xmm1, xmm0\n    setae al\n"); break;
+			case IrOpcode_GreaterEqual:	assembly_push(assembly, "    ucomiss xmm0, xmm1\n    setae al\n"); break;
+			default:					assert(false);
+		}
+	}
+	else
+	{
+		b32 is_signed = (data_type == NumericDatatype_I32);
+		const char* condition = 0;
+		switch (opcode)
+		{
+			case IrOpcode_Equal:		condition = "e"; break;
+			case IrOpcode_NotEqual:		condition = "ne"; break;
+			case IrOpcode_Less:			condition = is_signed ? "l" : "b"; break;
+			case IrOpcode_Greater:		condition = is_signed ? "g" : "a"; break;
+			case IrOpcode_LessEqual:	condition = is_signed ? "le" : "be"; break;
+			case IrOpcode_GreaterEqual:	condition = is_signed ? "ge" : "ae"; break;
+			default:					assert(false);
+		}
+		assembly_push(assembly, "    cmp eax, ecx\n    set%s al\n", condition); // https://www.felixcloutier.com/x86/cmp
+	}
 
-		i32 parameter_count = (i32)function->parameter_count;
+	assembly_push(assembly, "    movzx eax, al\n");
+}
 
-		ExpressionHandle argument = e.first_argument;
-		i32 argument_index = 0;
-		while (argument)
+// Smallest s with 2^s >= value.
+static i32 ceil_log2(u32 value)
+{
+	i32 s = 0;
+	while (s < 32 && (1ull << s) < value)
+	{
+		++s;
+	}
+	return s;
+}
+
+static b32 is_power_of_two(u32 value)
+{
+	return value && !(value & (value - 1));
+}
+
+// eax *= factor. Wraps around the same way for signed and unsigned operands.
+static void generate_multiplication_by_constant(AssemblyBuffer* assembly, u32 factor)
+{
+	if (factor == 0)
+	{
+		assembly_push(assembly, "    xor eax, eax\n");
+		return;
+	}
+	if (factor == 0xFFFFFFFF)
+	{
+		assembly_push(assembly, "    neg eax\n");
+		return;
+	}
+
+	i32 shift = 0;
+	while (!(factor & (1u << shift)))
+	{
+		++shift;
+	}
+	u32 odd = factor >> shift;
+
+	if (odd == 1 || odd == 3 || odd == 5 || odd == 9)
+	{
+		if (odd > 1)
+		{
+			assembly_push(assembly, "    lea eax, [rax+rax*%u]\n", odd - 1); // https://www.felixcloutier.com/x86/lea
+		}
+		if (shift)
 		{
-			generate_expression(program, argument, assembly);
+			assembly_push(assembly, "    shl eax, %d\n", shift);
+		}
+	}
+	else if (is_power_of_two(factor - 1))
+	{
+		assembly_push(assembly, "    mov ecx, eax\n    shl eax, %d\n    add eax, ecx\n", ceil_log2(factor - 1));
+	}
+	else if (is_power_of_two(factor + 1))
+	{
+		assembly_push(assembly, "    mov ecx, eax\n    shl eax, %d\n    sub eax, ecx\n", ceil_log2(factor + 1));
+	}
+	else if (is_power_of_two(0u - factor))
+	{
+		assembly_push(assembly, "    shl eax, %d\n    neg eax\n", ceil_log2(0u - factor));
+	}
+	else
+	{
+		assembly_push(assembly, "    imul eax, eax, %d\n", (i32)factor);
+	}
+}
 
-			if (argument_index < arraysize(argument_registers))
-			{
-				stack_pop(argument_registers[argument_index], assembly);
-			}
-			else
+// eax /= divisor, without div. Divisors of 0 and, for i32, -1 must trap like div does, so they are not handled here.
+// Other divisors that are not powers of two multiply by a fixed point reciprocal m = floor(2^p / d) + 1, with p chosen
+// so that the rounding error stays below 1/d for every 32-bit dividend (Granlund and Montgomery, "Division by Invariant
+// Integers using Multiplication"). The 64-bit product makes the extra bit of m that some divisors need free.
+static b32 generate_division_by_constant(AssemblyBuffer* assembly, u32 divisor, b32 is_signed)
+{
+	if (divisor == 0 || (is_signed && divisor == 0xFFFFFFFF))
+	{
+		return false;
+	}
+
+	if (!is_signed)
+	{
+		if (is_power_of_two(divisor))
+		{
+			if (divisor > 1)
 			{
-				// Remaining arguments are pushed to the stack in reverse order.
-				stack_pop("rax", assembly);
-				i32 offset = (parameter_count - 1 - argument_index) * 8 + 8;
-				string_push(assembly, "    mov [rsp-%d], rax\n", offset);
+				assembly_push(assembly, "    shr eax, %d\n", ceil_log2(divisor));
 			}
-
-			++argument_index;
-			argument = program_get_expression(program, argument)->next;
 		}
+		else if (divisor > 0x80000000)
+		{
+			// The quotient is 0 or 1.
+			assembly_push(assembly, "    cmp eax, 0x%08X\n    setae al\n    movzx eax, al\n", divisor);
+		}
+		else
+		{
+			i32 p = 32 + ceil_log2(divisor);
+			u64 m = ((1ull << p) / divisor) + 1;
 
-		i32 parameter_stack_size = max(32, parameter_count * 8);
+			// Loads zero extend into rax.
+			assembly_push(assembly, "    mov rcx, 0x%llX\n", (unsigned long long)m);
+			assembly_push(assembly, "    mul rcx\n"); // https://www.felixcloutier.com/x86/mul
+			assembly_push(assembly, "    shrd rax, rdx, %d\n", p); // https://www.felixcloutier.com/x86/shrd
+		}
+		return true;
+	}
 
-		string_push(assembly, "    sub rsp, %d\n", parameter_stack_size);
-		string_push(assembly, "    call _%.*s\n", (i32)e.function_name.len, e.function_name.str);
-		string_push(assembly, "    add rsp, %d\n", parameter_stack_size);
+	b32 is_negative = (i32)divisor < 0;
+	u32 magnitude = is_negative ? 0u - divisor : divisor;
 
-		stack_push("rax", assembly);
+	if (is_power_of_two(magnitude))
+	{
+		// Shifting rounds down, so negative dividends are biased by 2^k - 1 to round towards zero.
+		i32 k = ceil_log2(magnitude);
+		if (k > 0)
+		{
+			assembly_push(assembly, "    mov ecx, eax\n    sar ecx, 31\n    shr ecx, %d\n    add eax, ecx\n    sar eax, %d\n", 32 - k, k);
+		}
 	}
 	else
 	{
-		assert(false);
+		// Rounds down as well, so 1 is added for negative dividends.
+		i32 p = 31 + ceil_log2(magnitude);
+		u64 m = ((1ull << p) / magnitude) + 1;
+
+		assembly_push(assembly, "    movsxd rdx, eax\n"); // https://www.felixcloutier.com/x86/movsx:movsxd
+		assembly_push(assembly, "    mov rax, 0x%llX\n", (unsigned long long)m);
+		assembly_push(assembly, "    imul rax, rdx\n");
+		assembly_push(assembly, "    sar rax, %d\n", p);
+		assembly_push(assembly, "    shr rdx, 63\n    add eax, edx\n");
+	}
+
+	if (is_negative)
+	{
+		assembly_push(assembly, "    neg eax\n");
 	}
+	return true;
 }
 
-static i32 generate_label()
+// eax %= divisor, as eax - (eax / divisor) * divisor. The remainder takes the sign of the dividend, like idiv's does.
+static b32 generate_modulo_by_constant(AssemblyBuffer* assembly, u32 divisor, b32 is_signed)
 {
-	static i32 label = 1;
-	return label++;
+	if (divisor == 0 || (is_signed && divisor == 0xFFFFFFFF))
+	{
+		return false;
+	}
+
+	u32 magnitude = (is_signed && (i32)divisor < 0) ? 0u - divisor : divisor;
+	if (is_power_of_two(magnitude))
+	{
+		if (!is_signed)
+		{
+			assembly_push(assembly, "    and eax, 0x%08X\n", magnitude - 1);
+		}
+		else
+		{
+			// Biased like the division, masked, and the bias taken away again.
+			i32 k = ceil_log2(magnitude);
+			assembly_push(assembly, (k > 0) ? "    mov ecx, eax\n    sar ecx, 31\n    shr ecx, %d\n    add eax, ecx\n    and eax, 0x%08X\n    sub eax, ecx\n" : "    xor eax, eax\n", 32 - k, magnitude - 1);
+		}
+		return true;
+	}
+
+	assembly_push(assembly, "    mov r8d, eax\n");
+	generate_division_by_constant(assembly, divisor, is_signed);
+	generate_multiplication_by_constant(assembly, divisor);
+	assembly_push(assembly, "    sub r8d, eax\n    mov eax, r8d\n");
+	return true;
 }
 
-static void generate_statements(Program* program, i32 first_statement, i32 statement_count, String* assembly)
+// Integer multiplication, division and modulo by a constant, with cheaper sequences than imul and div. Returns false if
+// the operation has to be generated in general.
+static b32 generate_constant_operation(GeneratorContext* context, IrInstruction* instruction, NumericDatatype operand_type)
 {
-	for (i32 i = 0; i < statement_count; ++i)
+	IrFunction* function = context->function;
+	AssemblyBuffer* assembly = context->assembly;
+
+	IrOpcode opcode = instruction->opcode;
+	if (operand_type == NumericDatatype_F32 || (opcode != IrOpcode_Multiplication && opcode != IrOpcode_Division && opcode != IrOpcode_Modulo))
 	{
-		i32 statement_index = first_statement + i;
+		return false;
+	}
+
+	IrValue operand = instruction->binary.lhs;
+	IrInstruction* constant = ir_get_instruction(function, instruction->binary.rhs);
+	if (constant->opcode != IrOpcode_Constant && opcode == IrOpcode_Multiplication)
+	{
+		operand = instruction->binary.rhs;
+		constant = ir_get_instruction(function, instruction->binary.lhs);
+	}
+	if (constant->opcode != IrOpcode_Constant)
+	{
+		return false;
+	}
+
+	u32 value = constant->constant.data_u32;
+	b32 is_signed = (operand_type == NumericDatatype_I32);
+
+	if ((opcode == IrOpcode_Division || opcode == IrOpcode_Modulo) && (value == 0 || (is_signed && value == 0xFFFFFFFF)))
+	{
+		return false;
+	}
+
+	generate_load(context, operand, Register_A);
+	switch (opcode)
+	{
+		case IrOpcode_Multiplication:	generate_multiplication_by_constant(assembly, value); break;
+		case IrOpcode_Division:			generate_division_by_constant(assembly, value, is_signed); break;
+		case IrOpcode_Modulo:			generate_modulo_by_constant(assembly, value, is_signed); break;
+	}
+	return true;
+}
 
-		Statement* statement = program_get_statement(program, statement_index);
+static void generate_binary_operation(GeneratorContext* context, IrInstruction* instruction)
+{
+	AssemblyBuffer* assembly = context->assembly;
+	NumericDatatype operand_type = ir_get_instruction(context->function, instruction->binary.lhs)->data_type;
+
+	if (generate_constant_operation(context, instruction, operand_type))
+	{
+		return;
+	}
+
+	generate_load(context, instruction->binary.lhs, Register_A);
+	generate_load(context, instruction->binary.rhs, Register_C);
+
+	if (ir_is_comparison(instruction->opcode))
+	{
+		generate_comparison(instruction->opcode, operand_type, assembly);
+		return;
+	}
 
-		if (statement->type == StatementType_Simple)
+	if (operand_type == NumericDatatype_F32)
+	{
+		generate_float_operands(assembly);
+		switch (instruction->opcode)
 		{
-			generate_expression(program, statement->simple.expression, assembly);
+			case IrOpcode_Addition:			assembly_push(assembly, "    addss xmm0, xmm1\n"); break; // https://www.felixcloutier.com/x86/addss
+			case IrOpcode_Subtraction:		assembly_push(assembly, "    subss xmm0, xmm1\n"); break; // https://www.felixcloutier.com/x86/subss
+			case IrOpcode_Multiplication:	assembly_push(assembly, "    mulss xmm0, xmm1\n"); break; // https://www.felixcloutier.com/x86/mulss
+			case IrOpcode_Division:			assembly_push(assembly, "    divss xmm0, xmm1\n"); break; // https://www.felixcloutier.com/x86/divss
+			default:						assert(false);
 		}
-		else if (statement->type == StatementType_Declaration)
-		{
+		assembly_push(assembly, "    movd eax, xmm0\n");
+		return;
+	}
+
+	b32 is_signed = (operand_type == NumericDatatype_I32);
+
+	switch (instruction->opcode)
+	{
+		case IrOpcode_BitwiseOr:		assembly_push(assembly, "    or eax, ecx\n"); break; // https://www.felixcloutier.com/x86/or
+		case IrOpcode_BitwiseXor:		assembly_push(assembly, "    xor eax, ecx\n"); break; // https://www.felixcloutier.com/x86/xor
+		case IrOpcode_BitwiseAnd:		assembly_push(assembly, "    and eax, ecx\n"); break; // https://www.felixcloutier.com/x86/and
+		case IrOpcode_LeftShift:		assembly_push(assembly, "    shl eax, cl\n"); break; // https://www.felixcloutier.com/x86/sal:sar:shl:shr
+		case IrOpcode_RightShift:		assembly_push(assembly, is_signed ? "    sar eax, cl\n" : "    shr eax, cl\n"); break; // https://www.felixcloutier.com/x86/sal:sar:shl:shr
+		case IrOpcode_Addition:			assembly_push(assembly, "    add eax, ecx\n"); break; // https://www.felixcloutier.com/x86/add
+		case IrOpcode_Subtraction:		assembly_push(assembly, "    sub eax, ecx\n"); break; // https://www.felixcloutier.com/x86/sub
+		case IrOpcode_Multiplication:	assembly_push(assembly, "    imul eax, ecx\n"); break; // https://www.felixcloutier.com/x86/imul
+		case IrOpcode_Division:			assembly_push(assembly, is_signed ? "    cdq\n    idiv ecx\n" : "    xor edx, edx\n    div ecx\n"); break; // https://www.felixcloutier.com/x86/idiv
+		case IrOpcode_Modulo:			assembly_push(assembly, is_signed ? "    cdq\n    idiv ecx\n    mov eax, edx\n" : "    xor edx, edx\n    div ecx\n    mov eax, edx\n"); break; // https://www.felixcloutier.com/x86/div
+		default:						assert(false);
+	}
+}
+
+static void generate_unary_operation(GeneratorContext* context, IrInstruction* instruction)
+{
+	AssemblyBuffer* assembly = context->assembly;
+
+	generate_load(context, instruction->unary.operand, Register_A);
 
+	switch (instruction->opcode)
+	{
+		case IrOpcode_Negate:
+			// Floats flip their sign bit.
+			assembly_push(assembly, (instruction->data_type == NumericDatatype_F32) ? "    xor eax, 0x80000000\n" : "    neg eax\n"); // https://www.felixcloutier.com/x86/neg
+			break;
+		case IrOpcode_BitwiseNot:	assembly_push(assembly, "    not eax\n"); break; // https://www.felixcloutier.com/x86/not
+		case IrOpcode_Not:			assembly_push(assembly, "    test eax, eax\n    sete al\n    movzx eax, al\n"); break; // https://www.felixcloutier.com/x86/test
+		default:					assert(false);
+	}
+}
+
+static void generate_conversion(GeneratorContext* context, IrInstruction* instruction)
+{
+	AssemblyBuffer* assembly = context->assembly;
+	NumericDatatype from = ir_get_instruction(context->function, instruction->convert.operand)->data_type;
+	NumericDatatype to = instruction->data_type;
+
+	generate_load(context, instruction->convert.operand, Register_A);
+
+	if (to == NumericDatatype_B32)
+	{
+		if (from == NumericDatatype_F32)
+		{
+			assembly_push(assembly, "    movd xmm0, eax\n    xorps xmm1, xmm1\n    ucomiss xmm0, xmm1\n    setne al\n    setp cl\n    or al, cl\n");
 		}
-		else if (statement->type == StatementType_DeclarationAssignment)
+		else
 		{
-			DeclarationAssignmentStatement e = statement->declaration_assignment;
+			assembly_push(assembly, "    test eax, eax\n    setne al\n");
+		}
+		assembly_push(assembly, "    movzx eax, al\n");
+	}
+	else if (to == NumericDatatype_F32)
+	{
+		// Loads zero extend into rax, so unsigned values convert exactly as 64-bit integers.
+		assembly_push(assembly, (from == NumericDatatype_U32) ? "    cvtsi2ss xmm0, rax\n" : "    cvtsi2ss xmm0, eax\n"); // https://www.felixcloutier.com/x86/cvtsi2ss
+		assembly_push(assembly, "    movd eax, xmm0\n");
+	}
+	else if (from == NumericDatatype_F32)
+	{
+		assembly_push(assembly, "    movd xmm0, eax\n");
+		assembly_push(assembly, (to == NumericDatatype_U32) ? "    cvttss2si rax, xmm0\n" : "    cvttss2si eax, xmm0\n"); // https://www.felixcloutier.com/x86/cvttss2si
+	}
+
+	// Between b32, i32 and u32, the bits stay the same.
+}
+
+static void generate_call(GeneratorContext* context, IrInstruction* instruction)
+{
+	Program* program = context->program;
+	AssemblyBuffer* assembly = context->assembly;
+
+	Function* callee = program_get_function(program, instruction->call.function_index);
+	assert(callee->calling_convention == CallingConvention_Windows_x64);
+
+	// Arguments: rcx, rdx, r8, r9
+	// Stack	: [ Shadow space ] arg4 arg5 ...
+
+	i32 argument_count = instruction->call.operand_count;
+	i32 parameter_stack_size = (max(32, argument_count * 8) + 15) & ~15; // Keeps rsp 16-byte aligned at the call.
 
-			Expression* lhs = program_get_expression(program, e.lhs);
-			assert(lhs->type == ExpressionType_Identifier); // Temporary.
+	assembly_push(assembly, "    sub rsp, %d\n", parameter_stack_size);
 
-			generate_expression(program, e.rhs, assembly);
+	IrValue* arguments = context->function->operands.items + instruction->call.first_operand;
+	for (i32 i = 4; i < argument_count; ++i)
+	{
+		generate_load(context, arguments[i], Register_A);
+		assembly_push(assembly, "    mov [rsp+%d], rax\n", i * 8);
+	}
+
+	Register argument_registers[] = { Register_C, Register_D, Register_R8, Register_R9 };
+	for (i32 i = 0; i < min(argument_count, 4); ++i)
+	{
+		generate_load(context, arguments[i], argument_registers[i]);
+	}
+
+	String function_name = program_get_name(program, callee->name);
+	assembly_push(assembly, "    call _%.*s\n", (i32)function_name.len, function_name.str);
+	assembly_push(assembly, "    add rsp, %d\n", parameter_stack_size);
+}
+
+// A call to the function itself whose result is returned right away reuses the frame: The arguments overwrite the
+// parameters where the header spilled them, and control goes back to the entry block. They go through the stack first,
+// since they may read the parameters they replace.
+static b32 is_self_tail_call(GeneratorContext* context, IrBlock* block, i64 index)
+{
+	IrFunction* function = context->function;
+	IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[index]);
+	if (instruction->opcode != IrOpcode_Call || instruction->call.function_index != function->function_index || index + 1 == block->instructions.count)
+	{
+		return false;
+	}
 
-			stack_pop("rax", assembly);
-			string_push(assembly, "    mov [rbp%+d], rax\n", lhs->identifier.offset_from_frame_pointer);
+	IrInstruction* next = ir_get_instruction(function, block->instructions.items[index + 1]);
+	return next->opcode == IrOpcode_Return && next->ret.value == block->instructions.items[index];
+}
+
+static void generate_tail_call(GeneratorContext* context, IrInstruction* instruction)
+{
+	IrValue* arguments = context->function->operands.items + instruction->call.first_operand;
+	i32 argument_count = instruction->call.operand_count;
+
+	for (i32 i = 0; i < argument_count; ++i)
+	{
+		generate_load(context, arguments[i], Register_A);
+		stack_push("rax", context->assembly);
+	}
+	for (i32 i = argument_count - 1; i >= 0; --i)
+	{
+		stack_pop("rax", context->assembly);
+		assembly_push(context->assembly, "    mov DWORD [rbp%+d], eax\n", 16 + i * 8);
+	}
+
+	assembly_push(context->assembly, "    jmp .L0\n");
+}
+
+// Phis of the target read their operands for this edge all at once, so the values go through the stack before any phi
+// slot is written.
+static void generate_phi_copies(GeneratorContext* context, i32 block, i32 target)
+{
+	IrFunction* function = context->function;
+	IrBlock* t = ir_get_block(function, target);
+	i32 operand_index = predecessor_index(function, target, block);
+
+	i64 phi_count = 0;
+	while (phi_count < t->instructions.count && ir_get_instruction(function, t->instructions.items[phi_count])->opcode == IrOpcode_Phi)
+	{
+		++phi_count;
+	}
+
+	for (i64 i = 0; i < phi_count; ++i)
+	{
+		IrInstruction* phi = ir_get_instruction(function, t->instructions.items[i]);
+		generate_load(context, function->operands.items[phi->phi.first_operand + operand_index], Register_A);
+		if (phi_count > 1)
+		{
+			stack_push("rax", context->assembly);
 		}
-		else if (statement->type == StatementType_Return)
+	}
+
+	for (i64 i = phi_count - 1; i >= 0; --i)
+	{
+		if (phi_count > 1)
 		{
-			generate_expression(program, statement->ret.rhs, assembly);
+			stack_pop("rax", context->assembly);
+		}
+		generate_store(context, t->instructions.items[i]);
+	}
+}
+
+static b32 block_has_phis(IrFunction* function, i32 block)
+{
+	IrBlock* b = ir_get_block(function, block);
+	return b->instructions.count && ir_get_instruction(function, b->instructions.items[0])->opcode == IrOpcode_Phi;
+}
 
-			stack_pop("rax", assembly);
-			generate_return(assembly);
+static b32 is_next_block(GeneratorContext* context, i32 block, i32 target)
+{
+	i32 index = context->order_index.items[block] + 1;
+	return index < context->order.count && context->order.items[index] == target;
+}
+
+static void generate_terminator(GeneratorContext* context, i32 block, IrInstruction* instruction)
+{
+	IrFunction* function = context->function;
+	AssemblyBuffer* assembly = context->assembly;
+
+	if (instruction->opcode == IrOpcode_Return)
+	{
+		generate_load(context, instruction->ret.value, Register_A);
+		generate_return(assembly);
+	}
+	else if (instruction->opcode == IrOpcode_Jump)
+	{
+		i32 target = instruction->jump.target;
+		generate_phi_copies(context, block, target);
+		if (!is_next_block(context, block, target))
+		{
+			assembly_push(assembly, "    jmp .L%d\n", target);
 		}
-		else if (statement->type == StatementType_Block)
+	}
+	else if (instruction->opcode == IrOpcode_Branch)
+	{
+		IrBranch branch = instruction->branch;
+
+		generate_load(context, branch.condition, Register_A);
+		assembly_push(assembly, "    test eax, eax\n");
+
+		// Copies for the else edge go behind a label of their own, past the then edge.
+		b32 else_has_phis = block_has_phis(function, branch.else_block);
+		if (else_has_phis)
 		{
-			generate_statements(program, statement_index + 1, statement->block.statement_count, assembly);
-			i += statement->block.statement_count;
+			assembly_push(assembly, "    jz .E%d\n", block);
 		}
-		else if (statement->type == StatementType_Branch)
+		else
 		{
-			BranchStatement e = statement->branch;
-
-			i32 else_label = generate_label();
-			i32 end_label = generate_label();
+			assembly_push(assembly, "    jz .L%d\n", branch.else_block);
+		}
 
-			generate_expression(program, e.condition, assembly);
-			stack_pop("rax", assembly);
-			string_push(assembly, "    cmp rax, 0\n    je .L%d\n", else_label);
+		generate_phi_copies(context, block, branch.then_block);
+		if (else_has_phis || !is_next_block(context, block, branch.then_block))
+		{
+			assembly_push(assembly, "    jmp .L%d\n", branch.then_block);
+		}
 
-			generate_statements(program, statement_index + 1, e.then_statement_count, assembly);
-			if (e.else_statement_count)
+		if (else_has_phis)
+		{
+			assembly_push(assembly, "    .E%d:\n", block);
+			generate_phi_copies(context, block, branch.else_block);
+			if (!is_next_block(context, block, branch.else_block))
 			{
-				string_push(assembly, "    jmp .L%d\n", end_label);
+				assembly_push(assembly, "    jmp .L%d\n", branch.else_block);
 			}
+		}
+	}
+	else
+	{
+		assert(false);
+	}
+}
 
-			string_push(assembly, "    .L%d:\n", else_label);
+static void generate_block(GeneratorContext* context, i32 block)
+{
+	IrFunction* function = context->function;
+	IrBlock* b = ir_get_block(function, block);
 
-			if (e.else_statement_count)
-			{
-				generate_statements(program, statement_index + e.then_statement_count + 1, e.else_statement_count, assembly);
-				string_push(assembly, "    .L%d:\n", end_label);
-			}
+	assembly_push(context->assembly, "    .L%d:\n", block);
 
-			i += e.then_statement_count + e.else_statement_count;
-		}
-		else if (statement->type == StatementType_Loop)
+	for (i64 i = 0; i < b->instructions.count; ++i)
+	{
+		IrValue value = b->instructions.items[i];
+		IrInstruction* instruction = ir_get_instruction(function, value);
+
+		if (ir_is_terminator(instruction->opcode))
 		{
-			LoopStatement e = statement->loop;
+			generate_terminator(context, block, instruction);
+			continue;
+		}
 
-			i32 start_label = generate_label();
-			i32 condition_label = generate_label();
+		if (is_self_tail_call(context, b, i))
+		{
+			generate_tail_call(context, instruction);
+			break;
+		}
 
-			string_push(assembly, "    jmp .L%d\n", condition_label);
-			string_push(assembly, "    .L%d:\n", start_label);
-			generate_statements(program, statement_index + 1, e.then_statement_count, assembly);
+		if (!needs_slot(instruction) || instruction->opcode == IrOpcode_Phi)
+		{
+			continue;
+		}
 
-			string_push(assembly, "    .L%d:\n", condition_label);
-			generate_expression(program, e.condition, assembly);
-			stack_pop("rax", assembly);
-			string_push(assembly, "    cmp rax, 0\n    jne .L%d\n", start_label);
+		if (ir_is_binary_operation(instruction->opcode))
+		{
+			generate_binary_operation(context, instruction);
+		}
+		else if (ir_is_unary_operation(instruction->opcode))
+		{
+			generate_unary_operation(context, instruction);
+		}
+		else if (instruction->opcode == IrOpcode_Convert)
+		{
+			generate_conversion(context, instruction);
+		}
+		else if (instruction->opcode == IrOpcode_Call)
+		{
+			generate_call(context, instruction);
 		}
 		else
 		{
 			assert(false);
 		}
+
+		generate_store(context, value);
 	}
 }
 
-static void generate_function(Program* program, Function function, String* assembly)
+static void generate_function(GeneratorContext* context, Function* source, IrFunction* function)
 {
-	generate_function_header(function.name, function.stack_size, assembly);
+	context->function = function;
+	i64 block_count = function->blocks.count;
+
+	array_reserve(&context->order, block_count);
+	context->order.count = ir_compute_reverse_postorder(function, context->order.items);
+
+	array_reserve(&context->order_index, block_count);
+	array_reserve(&context->block_start, block_count);
+	array_reserve(&context->block_end, block_count);
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		context->order_index.items[i] = -1;
+	}
+
+	i32 position_count = 0;
+	for (i32 i = 0; i < context->order.count; ++i)
+	{
+		i32 block = context->order.items[i];
+		context->order_index.items[block] = i;
+		context->block_start.items[block] = position_count;
+		position_count += (i32)ir_get_block(function, block)->instructions.count;
+		context->block_end.items[block] = position_count - 1;
+	}
+
+	compute_liveness(context);
+	compute_intervals(context);
+
+	// Pushes and pops are 8 bytes wide, and calls need rsp 16-byte aligned, which it is again after pushing rbp.
+	i32 frame_size = (assign_stack_slots(context, position_count) + 15) & ~15;
 
-	assert(function.calling_convention == CallingConvention_Windows_x64);
+	generate_function_header(program_get_name(context->program, source->name), frame_size, context->assembly);
+
+	assert(source->calling_convention == CallingConvention_Windows_x64);
 	const char* argument_registers[] = { "rcx", "rdx", "r8", "r9" };
-	for (i64 i = 0; i < min(function.parameter_count, 4); ++i)
+	for (i64 i = 0; i < min(source->parameter_count, 4); ++i)
 	{
-		string_push(assembly, "    mov QWORD[rbp%+d], %s\n", 16 + i * 8, argument_registers[i]);
+		assembly_push(context->assembly, "    mov QWORD[rbp%+d], %s\n", 16 + i * 8, argument_registers[i]);
 	}
 
-	generate_statements(program, function.body_first_statement, function.body_statement_count, assembly);
-	string_push(assembly, "\n");
+	// Unreachable blocks are not emitted at all.
+	for (i32 i = 0; i < context->order.count; ++i)
+	{
+		generate_block(context, context->order.items[i]);
+	}
+	assembly_push(context->assembly, "\n");
 }
 
-static void generate_start_function(String* assembly)
+static void generate_start_function(AssemblyBuffer* assembly)
 {
 	generate_function_header(string_from_cstr("_main"), 0, assembly);
-	string_push(assembly, "    call _main\n");
+	assembly_push(assembly, "    call _main\n");
 	stack_push("rax", assembly);
 	generate_exit(assembly);
 }
 
-String generate(Program program)
+String generate(Program* program, IrProgram* ir)
 {
-	u64 max_len = 1024 * 10;
-	String assembly = { malloc(max_len), 0 };
+	AssemblyBuffer assembly = { 0 };
+	array_reserve(&assembly, 1024 * 64);
 
-	string_push(&assembly,
+	assembly_push(&assembly,
 		"bits 64\n"
 		"default rel\n"
 		"\n"
@@ -305,14 +1105,31 @@ String generate(Program program)
 		"\n"
 	);
 
-	for (i64 i = 0; i < program.functions.count; ++i)
+	GeneratorContext context = { .program = program, .assembly = &assembly };
+
+	for (i64 i = 0; i < ir->function_count; ++i)
 	{
-		Function function = program.functions.items[i];
-		generate_function(&program, function, &assembly);
+		IrFunction* function = &ir->functions[i];
+		generate_function(&context, program_get_function(program, function->function_index), function);
 	}
 
 	generate_start_function(&assembly);
 
-	return assembly;
-}
+	array_free(&context.order);
+	array_free(&context.order_index);
+	array_free(&context.block_start);
+	array_free(&context.block_end);
+	array_free(&context.live_in);
+	array_free(&context.live_out);
+	array_free(&context.intervals);
+	array_free(&context.offsets);
+	array_free(&context.by_start);
+	array_free(&context.by_end);
+	array_free(&context.buckets);
+	for (i32 i = 0; i < arraysize(context.free_slots); ++i)
+	{
+		array_free(&context.free_slots[i]);
+	}
 
+	return (String){ assembly.items, assembly.count };
+}
@@ -0,0 +1,326 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+// What a call costs beyond the callee's body: the stack adjustment before and after, the call and return, and moving
+// the arguments into place.
+#define CALL_OVERHEAD 4
+// Constant arguments usually fold away parts of the inlined body.
+#define CONSTANT_ARGUMENT_BENEFIT 2
+
+struct InlineContext
+{
+	Program* program;
+	IrProgram* ir;
+	OptimizationOptions options;
+	b32* is_recursive; // Per function.
+
+	IrFunction* function;
+	DynamicArray(IrValue) value_map; // Per callee value: Its copy in the caller.
+	DynamicArray(b32) is_done_block; // Per caller block: Whether its calls were already considered.
+	DynamicArray(IrValue) replacements; // Per caller value: What replaces an inlined call, IR_NO_VALUE for the rest.
+};
+typedef struct InlineContext InlineContext;
+
+
+// Uses of inlined calls are only rewritten once all of them are inlined. A returned value can be an argument, which can
+// itself be an earlier call, so replacements are followed until one is left.
+static IrValue get_replacement(InlineContext* context, IrValue value)
+{
+	while (value >= 0 && value < context->replacements.count && context->replacements.items[value] != IR_NO_VALUE)
+	{
+		value = context->replacements.items[value];
+	}
+	return value;
+}
+
+// Instructions that turn into code. Constants are materialized at their uses, and parameters already have their home.
+static i32 estimate_size(IrFunction* function)
+{
+	i32 size = 0;
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrOpcode opcode = ir_get_instruction(function, block->instructions.items[j])->opcode;
+			size += (opcode != IrOpcode_Constant && opcode != IrOpcode_Undefined && opcode != IrOpcode_Parameter);
+		}
+	}
+	return size;
+}
+
+static b32 should_inline(InlineContext* context, IrInstruction* call)
+{
+	i32 callee_index = call->call.function_index;
+	Function* callee = program_get_function(context->program, callee_index);
+
+	if (context->is_recursive[callee_index] || callee->inlining == InliningHint_Never)
+	{
+		return false;
+	}
+	if (callee->inlining == InliningHint_Always)
+	{
+		return true;
+	}
+
+	i32 benefit = CALL_OVERHEAD + call->call.operand_count;
+	for (i32 i = 0; i < call->call.operand_count; ++i)
+	{
+		IrValue argument = get_replacement(context, context->function->operands.items[call->call.first_operand + i]);
+		if (ir_get_instruction(context->function, argument)->opcode == IrOpcode_Constant)
+		{
+			benefit += CONSTANT_ARGUMENT_BENEFIT;
+		}
+	}
+
+	return estimate_size(&context->ir->functions[callee_index]) <= context->options.inline_threshold + benefit;
+}
+
+static i32 push_block(InlineContext* context)
+{
+	array_push(&context->function->blocks, (IrBlock){ 0 });
+	array_push(&context->is_done_block, false);
+	return (i32)context->function->blocks.count - 1;
+}
+
+// Moves the instructions after index into a new block, which takes over the block's successors.
+static i32 split_block(InlineContext* context, i32 block, i64 index)
+{
+	IrFunction* function = context->function;
+	i32 tail = push_block(context);
+
+	IrBlock* b = ir_get_block(function, block);
+	IrBlock* t = ir_get_block(function, tail);
+	for (i64 i = index; i < b->instructions.count; ++i)
+	{
+		IrValue value = b->instructions.items[i];
+		ir_get_instruction(function, value)->block = tail;
+		array_push(&t->instructions, value);
+	}
+	b->instructions.count = index;
+
+	i32 successors[2];
+	i32 successor_count = ir_get_successors(function, tail, successors);
+	for (i32 i = 0; i < successor_count; ++i)
+	{
+		if (i > 0 && successors[i] == successors[0])
+		{
+			continue;
+		}
+
+		IrBlock* successor = ir_get_block(function, successors[i]);
+		for (i64 j = 0; j < successor->predecessors.count; ++j)
+		{
+			if (successor->predecessors.items[j] == block)
+			{
+				successor->predecessors.items[j] = tail;
+			}
+		}
+	}
+
+	return tail;
+}
+
+// Replaces the call at the given position with a copy of the callee's blocks. The block is split after the call; the
+// copied entry block follows the part before it, and the copied returns jump to the part after it, where a phi merges
+// the returned values if there is more than one.
+static void inline_call(InlineContext* context, i32 block, i64 index)
+{
+	IrFunction* function = context->function;
+	IrValue call_value = ir_get_block(function, block)->instructions.items[index];
+	IrInstruction call = *ir_get_instruction(function, call_value);
+	IrFunction* callee = &context->ir->functions[call.call.function_index];
+
+	i32 tail = split_block(context, block, index + 1);
+	context->is_done_block.items[tail] = true;
+
+	i32 block_base = (i32)function->blocks.count;
+	for (i64 i = 0; i < callee->blocks.count; ++i)
+	{
+		i32 copy = push_block(context);
+		context->is_done_block.items[copy] = true;
+	}
+
+	// Values first, so that operands can refer to values that come later, like phis do around loops.
+	context->value_map.count = 0;
+	for (i64 i = 0; i < callee->instructions.count; ++i)
+	{
+		array_push(&context->value_map, IR_NO_VALUE);
+	}
+
+	DynamicArray(IrValue) returned = { 0 };
+	DynamicArray(i32) return_blocks = { 0 };
+
+	for (i32 i = 0; i < callee->blocks.count; ++i)
+	{
+		IrBlock* source = ir_get_block(callee, i);
+		for (i64 j = 0; j < source->instructions.count; ++j)
+		{
+			IrValue value = source->instructions.items[j];
+			IrInstruction instruction = *ir_get_instruction(callee, value);
+
+			if (instruction.opcode == IrOpcode_Parameter)
+			{
+				context->value_map.items[value] = function->operands.items[call.call.first_operand + instruction.parameter_index];
+				continue;
+			}
+			// Phi and call operands get their own range in the caller.
+			if (instruction.opcode == IrOpcode_Phi || instruction.opcode == IrOpcode_Call)
+			{
+				i32 operand_count;
+				IrValue* operands = ir_get_operands(callee, &instruction, &operand_count);
+				i32 first_operand = (i32)function->operands.count;
+				for (i32 k = 0; k < operand_count; ++k)
+				{
+					array_push(&function->operands, operands[k]);
+				}
+				if (instruction.opcode == IrOpcode_Phi)
+				{
+					instruction.phi.first_operand = first_operand;
+				}
+				else
+				{
+					instruction.call.first_operand = first_operand;
+				}
+			}
+
+			context->value_map.items[value] = ir_insert_instruction(function, block_base + i, -1, instruction);
+		}
+
+		IrBlock* copy = ir_get_block(function, block_base + i);
+		for (i64 j = 0; j < source->predecessors.count; ++j)
+		{
+			array_push(&copy->predecessors, block_base + source->predecessors.items[j]);
+		}
+	}
+
+	for (i32 i = 0; i < callee->blocks.count; ++i)
+	{
+		IrBlock* copy = ir_get_block(function, block_base + i);
+		for (i64 j = 0; j < copy->instructions.count; ++j)
+		{
+			IrInstruction* instruction = ir_get_instruction(function, copy->instructions.items[j]);
+
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+			for (i32 k = 0; k < operand_count; ++k)
+			{
+				operands[k] = context->value_map.items[operands[k]];
+			}
+
+			if (instruction->opcode == IrOpcode_Jump)
+			{
+				instruction->jump.target += block_base;
+			}
+			else if (instruction->opcode == IrOpcode_Branch)
+			{
+				instruction->branch.then_block += block_base;
+				instruction->branch.else_block += block_base;
+			}
+			else if (instruction->opcode == IrOpcode_Return)
+			{
+				array_push(&returned, instruction->ret.value);
+				array_push(&return_blocks, block_base + i);
+				*instruction = (IrInstruction){ .opcode = IrOpcode_Jump, .block = block_base + i, .jump = { .target = tail } };
+			}
+		}
+	}
+
+	// The returned value replaces the call. With several returns, a phi at the start of the tail selects it.
+	IrValue result;
+	if (returned.count == 1)
+	{
+		result = returned.items[0];
+	}
+	else
+	{
+		IrInstruction phi = { .opcode = IrOpcode_Phi, .data_type = call.data_type, .phi = { .first_operand = (i32)function->operands.count, .operand_count = (i32)returned.count } };
+		if (returned.count == 0)
+		{
+			// The callee never returns, which leaves the tail unreachable. It still needs a value for the uses there.
+			phi = (IrInstruction){ .opcode = IrOpcode_Undefined, .data_type = call.data_type };
+		}
+		for (i64 i = 0; i < returned.count; ++i)
+		{
+			array_push(&function->operands, returned.items[i]);
+		}
+		result = ir_insert_instruction(function, tail, 0, phi);
+	}
+
+	IrBlock* t = ir_get_block(function, tail);
+	for (i64 i = 0; i < return_blocks.count; ++i)
+	{
+		array_push(&t->predecessors, return_blocks.items[i]);
+	}
+
+	while (context->replacements.count < function->instructions.count)
+	{
+		array_push(&context->replacements, IR_NO_VALUE);
+	}
+	context->replacements.items[call_value] = result;
+
+	// The call is last in its block now, and becomes the jump into the copied entry.
+	IrInstruction* jump = ir_get_instruction(function, call_value);
+	*jump = (IrInstruction){ .opcode = IrOpcode_Jump, .block = block, .jump = { .target = block_base } };
+	array_push(&ir_get_block(function, block_base)->predecessors, block);
+
+	array_free(&returned);
+	array_free(&return_blocks);
+}
+
+b32 inline_calls(Program* program, IrProgram* ir, IrFunction* function, b32* is_recursive, OptimizationOptions options, OptimizationStatistics* statistics)
+{
+	InlineContext context = { .program = program, .ir = ir, .options = options, .is_recursive = is_recursive, .function = function };
+
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		array_push(&context.is_done_block, false);
+	}
+
+	// Copied blocks are not looked at again: Their calls were already considered when the callee itself was inlined
+	// into, and the callee is done before its callers. Calls are inlined from the end of their block, so the rest that a
+	// split moves out has already been looked at, and only reaches up to the previous inlined call.
+	i32 inlined = 0;
+	for (i32 block = 0; block < function->blocks.count; ++block)
+	{
+		if (context.is_done_block.items[block])
+		{
+			continue;
+		}
+
+		for (i64 i = ir_get_block(function, block)->instructions.count - 1; i >= 0; --i)
+		{
+			IrInstruction* instruction = ir_get_instruction(function, ir_get_block(function, block)->instructions.items[i]);
+			if (instruction->opcode == IrOpcode_Call && should_inline(&context, instruction))
+			{
+				inline_call(&context, block, i);
+				++inlined;
+			}
+		}
+	}
+
+	if (inlined)
+	{
+		for (i64 i = 0; i < function->instructions.count; ++i)
+		{
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &operand_count);
+			for (i32 k = 0; k < operand_count; ++k)
+			{
+				operands[k] = get_replacement(&context, operands[k]);
+			}
+		}
+
+		ir_remove_unreachable_blocks(function);
+	}
+
+	statistics->inlined_calls += inlined;
+
+	array_free(&context.value_map);
+	array_free(&context.is_done_block);
+	array_free(&context.replacements);
+
+	return inlined > 0;
+}
@@ -0,0 +1,1601 @@
+#include "ir.h"
+#include "platform.h"
+
+#include <assert.h>
+
+
+// SSA construction follows Braun et al., "Simple and Efficient Construction of Static Single Assignment Form". Variables
+// are looked up per block; a block is sealed once all of its predecessors are known, and reads in unsealed blocks get
+// placeholder phis that are completed when the block is sealed. Phis that turn out to select a single value are
+// forwarded to that value and removed at the end.
+
+// Current value of a variable in a block. Entries from earlier functions are recognized by their generation, so the
+// table does not have to be cleared between functions.
+struct IrDefinition
+{
+	u64 key; // (block << 32) | variable
+	IrValue value;
+	u32 generation;
+};
+typedef struct IrDefinition IrDefinition;
+
+struct IrIncompletePhi
+{
+	i32 block;
+	i32 variable;
+	IrValue phi;
+};
+typedef struct IrIncompletePhi IrIncompletePhi;
+
+// Scratch space of one worker, reused across functions.
+struct IrBuilder
+{
+	Program* program;
+	Function* source;
+	IrFunction* function;
+	i32 current_block;
+
+	IrDefinition* definitions;
+	i64 definition_slot_count;
+	i64 definition_count;
+	u32 generation;
+
+	DynamicArray(NumericDatatype) variable_types;
+	DynamicArray(b32) sealed; // Per block.
+	DynamicArray(IrIncompletePhi) incomplete_phis;
+	DynamicArray(IrValue) forward; // Per instruction: The value a removed trivial phi stands for, or IR_NO_VALUE.
+	IrValue undefined[NumericDatatype_Count];
+};
+typedef struct IrBuilder IrBuilder;
+
+
+static IrValue resolve(IrBuilder* builder, IrValue value)
+{
+	while (builder->forward.items[value] != IR_NO_VALUE)
+	{
+		value = builder->forward.items[value];
+	}
+	return value;
+}
+
+static u64 definition_hash(u64 key)
+{
+	key *= 0x9E3779B97F4A7C15ull;
+	return key ^ (key >> 29);
+}
+
+static IrDefinition* find_definition_slot(IrBuilder* builder, u64 key)
+{
+	u64 mask = builder->definition_slot_count - 1;
+	for (u64 slot = definition_hash(key) & mask;; slot = (slot + 1) & mask)
+	{
+		IrDefinition* definition = &builder->definitions[slot];
+		if (definition->generation != builder->generation || definition->key == key)
+		{
+			return definition;
+		}
+	}
+}
+
+static void write_variable(IrBuilder* builder, i32 variable, i32 block, IrValue value)
+{
+	if ((builder->definition_count + 1) * 2 > builder->definition_slot_count)
+	{
+		IrDefinition* old_definitions = builder->definitions;
+		i64 old_slot_count = builder->definition_slot_count;
+
+		builder->definition_slot_count = max(old_slot_count * 2, 1024);
+		builder->definitions = calloc(builder->definition_slot_count, sizeof(IrDefinition));
+
+		for (i64 i = 0; i < old_slot_count; ++i)
+		{
+			if (old_definitions[i].generation == builder->generation)
+			{
+				*find_definition_slot(builder, old_definitions[i].key) = old_definitions[i];
+			}
+		}
+		free(old_definitions);
+	}
+
+	u64 key = ((u64)block << 32) | (u32)variable;
+	IrDefinition* definition = find_definition_slot(builder, key);
+	if (definition->generation != builder->generation)
+	{
+		++builder->definition_count;
+	}
+	*definition = (IrDefinition){ .key = key, .value = value, .generation = builder->generation };
+}
+
+static IrValue lookup_variable(IrBuilder* builder, i32 variable, i32 block)
+{
+	if (!builder->definition_count)
+	{
+		return IR_NO_VALUE;
+	}
+
+	IrDefinition* definition = find_definition_slot(builder, ((u64)block << 32) | (u32)variable);
+	return (definition->generation == builder->generation) ? definition->value : IR_NO_VALUE;
+}
+
+static i32 push_block(IrBuilder* builder)
+{
+	IrBlock block = { 0 };
+	array_push(&builder->function->blocks, block);
+	array_push(&builder->sealed, false);
+	return (i32)builder->function->blocks.count - 1;
+}
+
+static void add_predecessor(IrBuilder* builder, i32 block, i32 predecessor)
+{
+	array_push(&ir_get_block(builder->function, block)->predecessors, predecessor);
+}
+
+static IrValue insert_instruction(IrBuilder* builder, i32 block, i64 index, IrInstruction instruction)
+{
+	array_push(&builder->forward, IR_NO_VALUE);
+	return ir_insert_instruction(builder->function, block, index, instruction);
+}
+
+static IrValue push_instruction(IrBuilder* builder, IrInstruction instruction)
+{
+	return insert_instruction(builder, builder->current_block, -1, instruction);
+}
+
+static IrValue push_phi(IrBuilder* builder, i32 block, NumericDatatype data_type)
+{
+	IrInstruction phi = { .opcode = IrOpcode_Phi, .data_type = data_type };
+	return insert_instruction(builder, block, ir_get_first_non_phi(builder->function, block), phi);
+}
+
+static IrValue get_undefined(IrBuilder* builder, NumericDatatype data_type)
+{
+	if (builder->undefined[data_type] == IR_NO_VALUE)
+	{
+		// At the start of the entry block, so it dominates every use.
+		IrInstruction undefined = { .opcode = IrOpcode_Undefined, .data_type = data_type };
+		builder->undefined[data_type] = insert_instruction(builder, 0, 0, undefined);
+	}
+	return builder->undefined[data_type];
+}
+
+static IrValue try_remove_trivial_phi(IrBuilder* builder, IrValue phi)
+{
+	IrFunction* function = builder->function;
+	IrOperandList operands = ir_get_instruction(function, phi)->phi;
+
+	IrValue same = IR_NO_VALUE;
+	for (i32 i = 0; i < operands.operand_count; ++i)
+	{
+		IrValue operand = resolve(builder, function->operands.items[operands.first_operand + i]);
+		if (operand == same || operand == phi)
+		{
+			continue;
+		}
+		if (same != IR_NO_VALUE)
+		{
+			return phi;
+		}
+		same = operand;
+	}
+
+	if (same == IR_NO_VALUE)
+	{
+		// Only reachable through itself, or not at all.
+		same = get_undefined(builder, ir_get_instruction(function, phi)->data_type);
+	}
+
+	builder->forward.items[phi] = same;
+	return same;
+}
+
+static IrValue read_variable(IrBuilder* builder, i32 variable, i32 block);
+
+static IrValue add_phi_operands(IrBuilder* builder, i32 variable, IrValue phi)
+{
+	IrFunction* function = builder->function;
+	IrBlock* block = ir_get_block(function, ir_get_instruction(function, phi)->block);
+
+	i32 predecessor_count = (i32)block->predecessors.count;
+	i32 first_operand = (i32)function->operands.count;
+	for (i32 i = 0; i < predecessor_count; ++i)
+	{
+		array_push(&function->operands, IR_NO_VALUE);
+	}
+	ir_get_instruction(function, phi)->phi = (IrOperandList){ .first_operand = first_operand, .operand_count = predecessor_count };
+
+	for (i32 i = 0; i < predecessor_count; ++i)
+	{
+		// Reading may add blocks and operands, so nothing is held across the call.
+		i32 predecessor = ir_get_block(function, ir_get_instruction(function, phi)->block)->predecessors.items[i];
+		IrValue value = read_variable(builder, variable, predecessor);
+		function->operands.items[first_operand + i] = value;
+	}
+
+	return try_remove_trivial_phi(builder, phi);
+}
+
+static IrValue read_variable_recursive(IrBuilder* builder, i32 variable, i32 block)
+{
+	IrBlock* b = ir_get_block(builder->function, block);
+	NumericDatatype data_type = builder->variable_types.items[variable];
+
+	IrValue value;
+	if (!builder->sealed.items[block])
+	{
+		value = push_phi(builder, block, data_type);
+		IrIncompletePhi incomplete_phi = { .block = block, .variable = variable, .phi = value };
+		array_push(&builder->incomplete_phis, incomplete_phi);
+	}
+	else if (b->predecessors.count == 0)
+	{
+		value = get_undefined(builder, data_type);
+	}
+	else if (b->predecessors.count == 1)
+	{
+		value = read_variable(builder, variable, b->predecessors.items[0]);
+	}
+	else
+	{
+		// Written before the operands are read, so that loops find the phi instead of recursing forever.
+		value = push_phi(builder, block, data_type);
+		write_variable(builder, variable, block, value);
+		value = add_phi_operands(builder, variable, value);
+	}
+
+	write_variable(builder, variable, block, value);
+	return value;
+}
+
+static IrValue read_variable(IrBuilder* builder, i32 variable, i32 block)
+{
+	IrValue value = lookup_variable(builder, variable, block);
+	if (value != IR_NO_VALUE)
+	{
+		return resolve(builder, value);
+	}
+	return read_variable_recursive(builder, variable, block);
+}
+
+static void seal_block(IrBuilder* builder, i32 block)
+{
+	// Completing a phi can create incomplete phis in other blocks, so the list is walked by index.
+	for (i64 i = 0; i < builder->incomplete_phis.count;)
+	{
+		IrIncompletePhi incomplete_phi = builder->incomplete_phis.items[i];
+		if (incomplete_phi.block == block)
+		{
+			builder->incomplete_phis.items[i] = builder->incomplete_phis.items[--builder->incomplete_phis.count];
+			add_phi_operands(builder, incomplete_phi.variable, incomplete_phi.phi);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	builder->sealed.items[block] = true;
+}
+
+static void push_jump(IrBuilder* builder, i32 target)
+{
+	IrInstruction jump = { .opcode = IrOpcode_Jump, .jump = { .target = target } };
+	push_instruction(builder, jump);
+	add_predecessor(builder, target, builder->current_block);
+}
+
+static void push_branch(IrBuilder* builder, IrValue condition, i32 then_block, i32 else_block)
+{
+	IrInstruction branch = { .opcode = IrOpcode_Branch, .branch = { .condition = condition, .then_block = then_block, .else_block = else_block } };
+	push_instruction(builder, branch);
+	add_predecessor(builder, then_block, builder->current_block);
+	add_predecessor(builder, else_block, builder->current_block);
+}
+
+static IrValue push_constant(IrBuilder* builder, NumericLiteral literal)
+{
+	IrInstruction constant = { .opcode = IrOpcode_Constant, .data_type = literal.type, .constant = literal };
+	return push_instruction(builder, constant);
+}
+
+static IrValue push_conversion(IrBuilder* builder, IrValue value, NumericDatatype data_type)
+{
+	if (ir_get_instruction(builder->function, value)->data_type == data_type)
+	{
+		return value;
+	}
+
+	IrInstruction convert = { .opcode = IrOpcode_Convert, .data_type = data_type, .convert = { .operand = value } };
+	return push_instruction(builder, convert);
+}
+
+static IrValue build_expression(IrBuilder* builder, ExpressionHandle expression_handle);
+
+// a && b and a || b only evaluate b if a does not decide the result already.
+static IrValue build_short_circuit(IrBuilder* builder, Expression* expression)
+{
+	b32 is_or = (expression->type == ExpressionType_LogicalOr);
+	BinaryExpression e = expression->binary;
+
+	IrValue lhs = push_conversion(builder, build_expression(builder, e.lhs), NumericDatatype_B32);
+	IrValue decided = push_constant(builder, (NumericLiteral){ .type = NumericDatatype_B32, .data_b32 = is_or });
+
+	i32 rhs_block = push_block(builder);
+	i32 merge_block = push_block(builder);
+
+	i32 lhs_end_block = builder->current_block;
+	push_branch(builder, lhs, is_or ? merge_block : rhs_block, is_or ? rhs_block : merge_block);
+	seal_block(builder, rhs_block);
+
+	builder->current_block = rhs_block;
+	IrValue rhs = push_conversion(builder, build_expression(builder, e.rhs), NumericDatatype_B32);
+	push_jump(builder, merge_block);
+	seal_block(builder, merge_block);
+
+	// Operands in the order in which the predecessors were added.
+	IrFunction* function = builder->function;
+	assert(ir_get_block(function, merge_block)->predecessors.items[0] == lhs_end_block);
+
+	builder->current_block = merge_block;
+	IrValue phi = push_phi(builder, merge_block, NumericDatatype_B32);
+	ir_get_instruction(function, phi)->phi = (IrOperandList){ .first_operand = (i32)function->operands.count, .operand_count = 2 };
+	array_push(&function->operands, decided);
+	array_push(&function->operands, rhs);
+
+	return phi;
+}
+
+static IrValue build_expression(IrBuilder* builder, ExpressionHandle expression_handle)
+{
+	Program* program = builder->program;
+	Expression* expression = program_get_expression(program, expression_handle);
+
+	IrValue result = IR_NO_VALUE;
+
+	if (expression->type == ExpressionType_NumericLiteral)
+	{
+		result = push_constant(builder, expression->numeric_literal);
+	}
+	else if (expression->type == ExpressionType_Identifier)
+	{
+		result = read_variable(builder, expression->identifier.variable_index, builder->current_block);
+	}
+	else if (expression->type == ExpressionType_LogicalOr || expression->type == ExpressionType_LogicalAnd)
+	{
+		result = build_short_circuit(builder, expression);
+	}
+	else if (expression_is_binary_operation(expression->type))
+	{
+		BinaryExpression e = expression->binary;
+
+		IrValue lhs = build_expression(builder, e.lhs);
+		IrValue rhs = build_expression(builder, e.rhs);
+
+		// Same order as the expression types.
+		IrOpcode opcode = IrOpcode_BitwiseOr + (expression->type - ExpressionType_BitwiseOr);
+
+		// Comparisons convert both sides to the wider of the two, everything else to the type of the result.
+		NumericDatatype operand_type = expression->result_data_type;
+		if (ir_is_comparison(opcode))
+		{
+			operand_type = max(ir_get_instruction(builder->function, lhs)->data_type, ir_get_instruction(builder->function, rhs)->data_type);
+		}
+
+		IrInstruction instruction =
+		{
+			.opcode = opcode,
+			.data_type = expression->result_data_type,
+			.binary = { .lhs = push_conversion(builder, lhs, operand_type), .rhs = push_conversion(builder, rhs, operand_type) },
+		};
+		result = push_instruction(builder, instruction);
+	}
+	else if (expression_is_unary_operation(expression->type))
+	{
+		IrOpcode opcode = IrOpcode_Negate + (expression->type - ExpressionType_Negate);
+
+		IrValue operand = build_expression(builder, expression->unary.rhs);
+
+		IrInstruction instruction =
+		{
+			.opcode = opcode,
+			.data_type = expression->result_data_type,
+			.unary = { .operand = push_conversion(builder, operand, expression->result_data_type) },
+		};
+		result = push_instruction(builder, instruction);
+	}
+	else if (expression->type == ExpressionType_Assignment)
+	{
+		AssignmentExpression e = expression->assignment;
+		Expression* lhs = program_get_expression(program, e.lhs);
+		assert(lhs->type == ExpressionType_Identifier); // Temporary.
+
+		result = push_conversion(builder, build_expression(builder, e.rhs), lhs->result_data_type);
+		write_variable(builder, lhs->identifier.variable_index, builder->current_block, result);
+	}
+	else if (expression->type == ExpressionType_FunctionCall)
+	{
+		FunctionCallExpression e = expression->function_call;
+		Function* callee = program_get_function(program, e.function_index);
+
+		IrValue arguments[64];
+		DynamicArray(IrValue) argument_overflow = { 0 };
+		IrValue* argument_values = (callee->parameter_count <= arraysize(arguments)) ? arguments : 0;
+		if (!argument_values)
+		{
+			array_reserve(&argument_overflow, callee->parameter_count);
+			argument_values = argument_overflow.items;
+		}
+
+		i32 argument_count = 0;
+		for (ExpressionHandle argument = e.first_argument; argument; argument = program_get_expression(program, argument)->next)
+		{
+			NumericDatatype parameter_type = program->function_parameters.items[callee->first_parameter + argument_count].data_type;
+			argument_values[argument_count++] = push_conversion(builder, build_expression(builder, argument), parameter_type);
+		}
+
+		IrFunction* function = builder->function;
+		IrInstruction call =
+		{
+			.opcode = IrOpcode_Call,
+			.data_type = callee->return_data_type,
+			.call = { .function_index = e.function_index, .first_operand = (i32)function->operands.count, .operand_count = argument_count },
+		};
+		for (i32 i = 0; i < argument_count; ++i)
+		{
+			array_push(&function->operands, argument_values[i]);
+		}
+		array_free(&argument_overflow);
+
+		result = push_instruction(builder, call);
+	}
+	else
+	{
+		assert(false);
+	}
+
+	return result;
+}
+
+static void build_statements(IrBuilder* builder, i32 first_statement, i32 statement_count)
+{
+	Program* program = builder->program;
+
+	for (i32 i = 0; i < statement_count; ++i)
+	{
+		i32 statement_index = first_statement + i;
+		Statement* statement = program_get_statement(program, statement_index);
+
+		if (statement->type == StatementType_Simple)
+		{
+			build_expression(builder, statement->simple.expression);
+		}
+		else if (statement->type == StatementType_Declaration)
+		{
+			DeclarationStatement e = statement->declaration;
+			i32 variable = program_get_expression(program, e.lhs)->identifier.variable_index;
+
+			builder->variable_types.items[variable] = e.data_type;
+			write_variable(builder, variable, builder->current_block, get_undefined(builder, e.data_type));
+		}
+		else if (statement->type == StatementType_DeclarationAssignment)
+		{
+			DeclarationAssignmentStatement e = statement->declaration_assignment;
+			i32 variable = program_get_expression(program, e.lhs)->identifier.variable_index;
+
+			IrValue value = push_conversion(builder, build_expression(builder, e.rhs), e.data_type);
+			builder->variable_types.items[variable] = e.data_type;
+			write_variable(builder, variable, builder->current_block, value);
+		}
+		else if (statement->type == StatementType_Return)
+		{
+			IrValue value = push_conversion(builder, build_expression(builder, statement->ret.rhs), builder->source->return_data_type);
+
+			IrInstruction ret = { .opcode = IrOpcode_Return, .ret = { .value = value } };
+			push_instruction(builder, ret);
+
+			// Anything after the return is unreachable, but still gets a block of its own.
+			builder->current_block = push_block(builder);
+			seal_block(builder, builder->current_block);
+		}
+		else if (statement->type == StatementType_Block)
+		{
+			build_statements(builder, statement_index + 1, statement->block.statement_count);
+			i += statement->block.statement_count;
+		}
+		else if (statement->type == StatementType_Branch)
+		{
+			BranchStatement e = statement->branch;
+
+			IrValue condition = push_conversion(builder, build_expression(builder, e.condition), NumericDatatype_B32);
+
+			i32 then_block = push_block(builder);
+			i32 else_block = e.else_statement_count ? push_block(builder) : -1;
+			i32 merge_block = push_block(builder);
+
+			push_branch(builder, condition, then_block, e.else_statement_count ? else_block : merge_block);
+
+			seal_block(builder, then_block);
+			builder->current_block = then_block;
+			build_statements(builder, statement_index + 1, e.then_statement_count);
+			push_jump(builder, merge_block);
+
+			if (e.else_statement_count)
+			{
+				seal_block(builder, else_block);
+				builder->current_block = else_block;
+				build_statements(builder, statement_index + e.then_statement_count + 1, e.else_statement_count);
+				push_jump(builder, merge_block);
+			}
+
+			seal_block(builder, merge_block);
+			builder->current_block = merge_block;
+
+			i += e.then_statement_count + e.else_statement_count;
+		}
+		else if (statement->type == StatementType_Loop)
+		{
+			LoopStatement e = statement->loop;
+
+			// The header is sealed once the back edge from the end of the body is known.
+			i32 header_block = push_block(builder);
+			push_jump(builder, header_block);
+			builder->current_block = header_block;
+
+			IrValue condition = push_conversion(builder, build_expression(builder, e.condition), NumericDatatype_B32);
+
+			i32 body_block = push_block(builder);
+			i32 exit_block = push_block(builder);
+			push_branch(builder, condition, body_block, exit_block);
+
+			seal_block(builder, body_block);
+			builder->current_block = body_block;
+			build_statements(builder, statement_index + 1, e.then_statement_count);
+			push_jump(builder, header_block);
+
+			seal_block(builder, header_block);
+			seal_block(builder, exit_block);
+			builder->current_block = exit_block;
+
+			i += e.then_statement_count;
+		}
+		else
+		{
+			assert(false);
+		}
+	}
+}
+
+// Forwards phis that only became trivial after their operands were completed, then rewrites all operands to the
+// forwarded values and drops the forwarded phis from their blocks.
+static void remove_trivial_phis(IrBuilder* builder)
+{
+	IrFunction* function = builder->function;
+
+	b32 changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (i64 i = 0; i < function->instructions.count; ++i)
+		{
+			if (function->instructions.items[i].opcode == IrOpcode_Phi && builder->forward.items[i] == IR_NO_VALUE)
+			{
+				changed |= (try_remove_trivial_phi(builder, (IrValue)i) != (IrValue)i);
+			}
+		}
+	}
+
+	for (i64 i = 0; i < function->instructions.count; ++i)
+	{
+		i32 operand_count;
+		IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &operand_count);
+		for (i32 j = 0; j < operand_count; ++j)
+		{
+			operands[j] = resolve(builder, operands[j]);
+		}
+	}
+
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+
+		i64 kept = 0;
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrValue value = block->instructions.items[j];
+			if (builder->forward.items[value] == IR_NO_VALUE)
+			{
+				block->instructions.items[kept++] = value;
+			}
+			else
+			{
+				function->instructions.items[value].opcode = IrOpcode_Removed;
+				function->instructions.items[value].block = -1;
+			}
+		}
+		block->instructions.count = kept;
+	}
+}
+
+static void build_function(IrBuilder* builder, Function* source, IrFunction* function)
+{
+	Program* program = builder->program;
+
+	builder->source = source;
+	builder->function = function;
+	builder->definition_count = 0;
+	++builder->generation;
+
+	builder->sealed.count = 0;
+	builder->incomplete_phis.count = 0;
+	builder->forward.count = 0;
+	builder->variable_types.count = 0;
+	for (i32 i = 0; i < NumericDatatype_Count; ++i)
+	{
+		builder->undefined[i] = IR_NO_VALUE;
+	}
+
+	array_reserve(&builder->variable_types, source->variable_count);
+	builder->variable_types.count = source->variable_count;
+
+	builder->current_block = push_block(builder);
+	seal_block(builder, builder->current_block);
+
+	for (i32 i = 0; i < source->parameter_count; ++i)
+	{
+		NumericDatatype data_type = program->function_parameters.items[source->first_parameter + i].data_type;
+		builder->variable_types.items[i] = data_type;
+
+		IrInstruction parameter = { .opcode = IrOpcode_Parameter, .data_type = data_type, .parameter_index = i };
+		write_variable(builder, i, builder->current_block, push_instruction(builder, parameter));
+	}
+
+	build_statements(builder, source->body_first_statement, source->body_statement_count);
+
+	// Falling off the end returns whatever.
+	IrInstruction* terminator = ir_get_terminator(function, builder->current_block);
+	if (!terminator || !ir_is_terminator(terminator->opcode))
+	{
+		IrInstruction ret = { .opcode = IrOpcode_Return, .ret = { .value = get_undefined(builder, source->return_data_type) } };
+		push_instruction(builder, ret);
+	}
+
+	assert(builder->incomplete_phis.count == 0);
+	ir_remove_unreachable_blocks(function);
+	remove_trivial_phis(builder);
+}
+
+struct ParallelBuild
+{
+	Program* program;
+	IrProgram* ir;
+	IrBuilder* builders; // Per worker.
+};
+typedef struct ParallelBuild ParallelBuild;
+
+static void build_task(void* data, i64 function_index, i32 worker_index)
+{
+	ParallelBuild* build = data;
+
+	IrFunction* function = &build->ir->functions[function_index];
+	function->function_index = (i32)function_index;
+
+	build_function(&build->builders[worker_index], program_get_function(build->program, function_index), function);
+}
+
+IrProgram build_ir(Program* program, i32 thread_count)
+{
+	IrProgram ir = { 0 };
+	ir.function_count = program->functions.count;
+	ir.functions = calloc(max(ir.function_count, 1), sizeof(IrFunction));
+
+	i32 worker_count = (i32)max(min(thread_count, ir.function_count), 1);
+
+	ParallelBuild build = { .program = program, .ir = &ir, .builders = calloc(worker_count, sizeof(IrBuilder)) };
+	for (i32 i = 0; i < worker_count; ++i)
+	{
+		build.builders[i].program = program;
+	}
+
+	parallel_for(ir.function_count, worker_count, build_task, &build);
+
+	for (i32 i = 0; i < worker_count; ++i)
+	{
+		IrBuilder* builder = &build.builders[i];
+		free(builder->definitions);
+		array_free(&builder->variable_types);
+		array_free(&builder->sealed);
+		array_free(&builder->incomplete_phis);
+		array_free(&builder->forward);
+	}
+	free(build.builders);
+
+	return ir;
+}
+
+void free_ir(IrProgram* ir)
+{
+	for (i64 i = 0; i < ir->function_count; ++i)
+	{
+		IrFunction* function = &ir->functions[i];
+		for (i64 j = 0; j < function->blocks.count; ++j)
+		{
+			array_free(&function->blocks.items[j].instructions);
+			array_free(&function->blocks.items[j].predecessors);
+		}
+		array_free(&function->blocks);
+		array_free(&function->instructions);
+		array_free(&function->operands);
+	}
+
+	free(ir->functions);
+	ir->functions = 0;
+	ir->function_count = 0;
+}
+
+
+IrValue ir_insert_instruction(IrFunction* function, i32 block, i64 index, IrInstruction instruction)
+{
+	instruction.block = block;
+	array_push(&function->instructions, instruction);
+
+	IrValue value = (IrValue)function->instructions.count - 1;
+
+	IrBlock* b = ir_get_block(function, block);
+	array_push(&b->instructions, value);
+	if (index >= 0)
+	{
+		memmove(b->instructions.items + index + 1, b->instructions.items + index, sizeof(IrValue) * (b->instructions.count - 1 - index));
+		b->instructions.items[index] = value;
+	}
+
+	return value;
+}
+
+void ir_remove_instruction(IrFunction* function, IrValue value)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	instruction->opcode = IrOpcode_Removed;
+}
+
+void ir_compact_blocks(IrFunction* function)
+{
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+
+		i64 kept = 0;
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrValue value = block->instructions.items[j];
+			IrInstruction* instruction = ir_get_instruction(function, value);
+			if (instruction->opcode == IrOpcode_Removed)
+			{
+				instruction->block = -1;
+			}
+			else
+			{
+				block->instructions.items[kept++] = value;
+			}
+		}
+		block->instructions.count = kept;
+	}
+}
+
+// Unreachable blocks may still jump to where control flow merges, like statements after a return do. Those edges are
+// dropped together with their phi operands, and the remaining blocks are renumbered in their original order.
+i32 ir_remove_unreachable_blocks(IrFunction* function)
+{
+	i64 block_count = function->blocks.count;
+
+	i32* new_index = malloc(sizeof(i32) * block_count);
+	i32 reachable_count = ir_compute_reverse_postorder(function, new_index);
+	if (reachable_count == block_count)
+	{
+		free(new_index);
+		return 0;
+	}
+
+	b32* reachable = calloc(block_count, sizeof(b32));
+	for (i32 i = 0; i < reachable_count; ++i)
+	{
+		reachable[new_index[i]] = true;
+	}
+
+	i32 kept_blocks = 0;
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		new_index[i] = reachable[i] ? kept_blocks++ : -1;
+	}
+
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		IrBlock* block = ir_get_block(function, (i32)i);
+
+		if (!reachable[i])
+		{
+			for (i64 j = 0; j < block->instructions.count; ++j)
+			{
+				IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[j]);
+				instruction->opcode = IrOpcode_Removed;
+				instruction->block = -1;
+			}
+			array_free(&block->instructions);
+			array_free(&block->predecessors);
+			continue;
+		}
+
+		// Phis are first in the block and have one operand per predecessor.
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[j]);
+			instruction->block = new_index[i];
+
+			if (instruction->opcode == IrOpcode_Phi)
+			{
+				IrValue* operands = function->operands.items + instruction->phi.first_operand;
+				i32 kept = 0;
+				for (i32 k = 0; k < instruction->phi.operand_count; ++k)
+				{
+					if (reachable[block->predecessors.items[k]])
+					{
+						operands[kept++] = operands[k];
+					}
+				}
+				instruction->phi.operand_count = kept;
+			}
+			else if (instruction->opcode == IrOpcode_Jump)
+			{
+				instruction->jump.target = new_index[instruction->jump.target];
+			}
+			else if (instruction->opcode == IrOpcode_Branch)
+			{
+				instruction->branch.then_block = new_index[instruction->branch.then_block];
+				instruction->branch.else_block = new_index[instruction->branch.else_block];
+			}
+		}
+
+		i64 kept = 0;
+		for (i64 j = 0; j < block->predecessors.count; ++j)
+		{
+			i32 predecessor = block->predecessors.items[j];
+			if (reachable[predecessor])
+			{
+				block->predecessors.items[kept++] = new_index[predecessor];
+			}
+		}
+		block->predecessors.count = kept;
+
+		function->blocks.items[new_index[i]] = *block;
+	}
+	function->blocks.count = kept_blocks;
+
+	free(reachable);
+	free(new_index);
+
+	return (i32)block_count - kept_blocks;
+}
+
+i64 ir_get_first_non_phi(IrFunction* function, i32 block)
+{
+	IrBlock* b = ir_get_block(function, block);
+
+	i64 index = 0;
+	while (index < b->instructions.count && ir_get_instruction(function, b->instructions.items[index])->opcode == IrOpcode_Phi)
+	{
+		++index;
+	}
+	return index;
+}
+
+void ir_count_uses(IrFunction* function, i32* use_counts)
+{
+	memset(use_counts, 0, sizeof(i32) * function->instructions.count);
+
+	for (i64 i = 0; i < function->instructions.count; ++i)
+	{
+		i32 operand_count;
+		IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &operand_count);
+		for (i32 j = 0; j < operand_count; ++j)
+		{
+			++use_counts[operands[j]];
+		}
+	}
+}
+
+i32 ir_get_successors(IrFunction* function, i32 block, i32 successors[2])
+{
+	IrInstruction* terminator = ir_get_terminator(function, block);
+	if (!terminator)
+	{
+		return 0;
+	}
+
+	switch (terminator->opcode)
+	{
+		case IrOpcode_Jump:
+			successors[0] = terminator->jump.target;
+			return 1;
+		case IrOpcode_Branch:
+			successors[0] = terminator->branch.then_block;
+			successors[1] = terminator->branch.else_block;
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+IrValue* ir_get_operands(IrFunction* function, IrInstruction* instruction, i32* operand_count)
+{
+	IrOpcode opcode = instruction->opcode;
+
+	if (opcode == IrOpcode_Phi || opcode == IrOpcode_Call)
+	{
+		i32 first_operand = (opcode == IrOpcode_Phi) ? instruction->phi.first_operand : instruction->call.first_operand;
+		*operand_count = (opcode == IrOpcode_Phi) ? instruction->phi.operand_count : instruction->call.operand_count;
+		return *operand_count ? function->operands.items + first_operand : 0;
+	}
+
+	if (ir_is_binary_operation(opcode))
+	{
+		*operand_count = 2;
+		return &instruction->binary.lhs;
+	}
+
+	*operand_count = 1;
+	switch (opcode)
+	{
+		case IrOpcode_Convert:	return &instruction->convert.operand;
+		case IrOpcode_Negate:
+		case IrOpcode_BitwiseNot:
+		case IrOpcode_Not:		return &instruction->unary.operand;
+		case IrOpcode_Branch:	return &instruction->branch.condition;
+		case IrOpcode_Return:	return &instruction->ret.value;
+	}
+
+	*operand_count = 0;
+	return 0;
+}
+
+i32 ir_compute_reverse_postorder(IrFunction* function, i32* order)
+{
+	i64 block_count = function->blocks.count;
+
+	// Depth first, with the index of the next successor to visit kept next to each block on the stack.
+	b32* visited = calloc(block_count, sizeof(b32));
+	i32* stack = malloc(sizeof(i32) * 2 * block_count);
+	i32 stack_count = 0;
+	i32 postorder_count = 0;
+
+	visited[0] = true;
+	stack[stack_count++] = 0;
+	stack[stack_count++] = 0;
+
+	while (stack_count)
+	{
+		i32 block = stack[stack_count - 2];
+		i32 next_successor = stack[stack_count - 1];
+
+		i32 successors[2];
+		i32 successor_count = ir_get_successors(function, block, successors);
+
+		if (next_successor < successor_count)
+		{
+			++stack[stack_count - 1];
+
+			// Last successor first, so that the first one ends up right after the block in reverse postorder.
+			i32 successor = successors[successor_count - 1 - next_successor];
+			if (!visited[successor])
+			{
+				visited[successor] = true;
+				stack[stack_count++] = successor;
+				stack[stack_count++] = 0;
+			}
+		}
+		else
+		{
+			// Postorder, reversed below.
+			order[postorder_count++] = block;
+			stack_count -= 2;
+		}
+	}
+
+	for (i32 i = 0; i < postorder_count / 2; ++i)
+	{
+		i32 swap = order[i];
+		order[i] = order[postorder_count - 1 - i];
+		order[postorder_count - 1 - i] = swap;
+	}
+
+	free(stack);
+	free(visited);
+
+	return postorder_count;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+void ir_compute_dominators(IrFunction* function, i32* order, i32 order_count, i32* immediate_dominators)
+{
+	i64 block_count = function->blocks.count;
+
+	i32* order_index = malloc(sizeof(i32) * block_count);
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		order_index[i] = -1;
+		immediate_dominators[i] = -1;
+	}
+	for (i32 i = 0; i < order_count; ++i)
+	{
+		order_index[order[i]] = i;
+	}
+
+	immediate_dominators[order[0]] = order[0];
+
+	b32 changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (i32 i = 1; i < order_count; ++i)
+		{
+			i32 block = order[i];
+			IrBlock* b = ir_get_block(function, block);
+
+			i32 new_dominator = -1;
+			for (i64 j = 0; j < b->predecessors.count; ++j)
+			{
+				i32 predecessor = b->predecessors.items[j];
+				if (order_index[predecessor] < 0 || immediate_dominators[predecessor] < 0)
+				{
+					continue;
+				}
+
+				if (new_dominator < 0)
+				{
+					new_dominator = predecessor;
+					continue;
+				}
+
+				// Intersect: walk both up the tree until they meet.
+				i32 a = predecessor;
+				i32 c = new_dominator;
+				while (a != c)
+				{
+					while (order_index[a] > order_index[c]) { a = immediate_dominators[a]; }
+					while (order_index[c] > order_index[a]) { c = immediate_dominators[c]; }
+				}
+				new_dominator = a;
+			}
+
+			if (immediate_dominators[block] != new_dominator)
+			{
+				immediate_dominators[block] = new_dominator;
+				changed = true;
+			}
+		}
+	}
+
+	immediate_dominators[order[0]] = -1;
+
+	free(order_index);
+}
+
+
+static const char* ir_opcode_names[IrOpcode_Count] =
+{
+	[IrOpcode_Removed]			= "removed",
+	[IrOpcode_Constant]			= "constant",
+	[IrOpcode_Undefined]		= "undefined",
+	[IrOpcode_Parameter]		= "parameter",
+	[IrOpcode_Phi]				= "phi",
+	[IrOpcode_Convert]			= "convert",
+	[IrOpcode_Call]				= "call",
+	[IrOpcode_BitwiseOr]		= "or",
+	[IrOpcode_BitwiseXor]		= "xor",
+	[IrOpcode_BitwiseAnd]		= "and",
+	[IrOpcode_Equal]			= "equal",
+	[IrOpcode_NotEqual]			= "not_equal",
+	[IrOpcode_Less]				= "less",
+	[IrOpcode_Greater]			= "greater",
+	[IrOpcode_LessEqual]		= "less_equal",
+	[IrOpcode_GreaterEqual]		= "greater_equal",
+	[IrOpcode_LeftShift]		= "shift_left",
+	[IrOpcode_RightShift]		= "shift_right",
+	[IrOpcode_Addition]			= "add",
+	[IrOpcode_Subtraction]		= "subtract",
+	[IrOpcode_Multiplication]	= "multiply",
+	[IrOpcode_Division]			= "divide",
+	[IrOpcode_Modulo]			= "modulo",
+	[IrOpcode_Negate]			= "negate",
+	[IrOpcode_BitwiseNot]		= "not",
+	[IrOpcode_Not]				= "logical_not",
+	[IrOpcode_Jump]				= "jump",
+	[IrOpcode_Branch]			= "branch",
+	[IrOpcode_Return]			= "return",
+};
+
+static void print_instruction(Program* program, IrFunction* function, IrValue value, StringBuffer* output)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+
+	string_buffer_push(output, "    ");
+	if (instruction->data_type != NumericDatatype_Unknown)
+	{
+		string_buffer_push(output, "%%%d = %s ", value, numeric_to_string(instruction->data_type));
+	}
+	string_buffer_push(output, "%s", ir_opcode_names[instruction->opcode]);
+
+	switch (instruction->opcode)
+	{
+		case IrOpcode_Constant:
+			string_buffer_push(output, " %s", serialize_numeric_literal(instruction->constant));
+			break;
+		case IrOpcode_Parameter:
+			string_buffer_push(output, " %d", instruction->parameter_index);
+			break;
+		case IrOpcode_Phi:
+		{
+			IrBlock* block = ir_get_block(function, instruction->block);
+			for (i32 i = 0; i < instruction->phi.operand_count; ++i)
+			{
+				string_buffer_push(output, "%s [%%%d, L%d]", i ? "," : "", function->operands.items[instruction->phi.first_operand + i], block->predecessors.items[i]);
+			}
+			break;
+		}
+		case IrOpcode_Call:
+		{
+			String name = program_get_name(program, program_get_function(program, instruction->call.function_index)->name);
+			string_buffer_push(output, " %.*s(", (i32)name.len, name.str);
+			for (i32 i = 0; i < instruction->call.operand_count; ++i)
+			{
+				string_buffer_push(output, "%s%%%d", i ? ", " : "", function->operands.items[instruction->call.first_operand + i]);
+			}
+			string_buffer_push(output, ")");
+			break;
+		}
+		case IrOpcode_Jump:
+			string_buffer_push(output, " L%d", instruction->jump.target);
+			break;
+		case IrOpcode_Branch:
+			string_buffer_push(output, " %%%d, L%d, L%d", instruction->branch.condition, instruction->branch.then_block, instruction->branch.else_block);
+			break;
+		default:
+		{
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+			for (i32 i = 0; i < operand_count; ++i)
+			{
+				string_buffer_push(output, "%s %%%d", i ? "," : "", operands[i]);
+			}
+			break;
+		}
+	}
+
+	string_buffer_push(output, "\n");
+}
+
+void ir_print(Program* program, IrProgram* ir, StringBuffer* output)
+{
+	for (i64 i = 0; i < ir->function_count; ++i)
+	{
+		IrFunction* function = &ir->functions[i];
+		Function* source = program_get_function(program, function->function_index);
+
+		String name = program_get_name(program, source->name);
+		string_buffer_push(output, "fn %.*s :: (", (i32)name.len, name.str);
+		for (i64 j = 0; j < source->parameter_count; ++j)
+		{
+			FunctionParameter parameter = program->function_parameters.items[source->first_parameter + j];
+			String parameter_name = program_get_name(program, parameter.name);
+			string_buffer_push(output, "%s%.*s : %s", j ? ", " : "", (i32)parameter_name.len, parameter_name.str, numeric_to_string(parameter.data_type));
+		}
+		string_buffer_push(output, ") -> (%s)\n", numeric_to_string(source->return_data_type));
+
+		for (i64 j = 0; j < function->blocks.count; ++j)
+		{
+			IrBlock* block = ir_get_block(function, (i32)j);
+
+			string_buffer_push(output, "  L%d:", (i32)j);
+			for (i64 k = 0; k < block->predecessors.count; ++k)
+			{
+				string_buffer_push(output, "%s L%d", k ? "," : " ; from", block->predecessors.items[k]);
+			}
+			string_buffer_push(output, "\n");
+
+			for (i64 k = 0; k < block->instructions.count; ++k)
+			{
+				print_instruction(program, function, block->instructions.items[k], output);
+			}
+		}
+
+		string_buffer_push(output, "\n");
+	}
+}
+
+
+struct IrVerifier
+{
+	Program* program;
+	IrFunction* function;
+	i32* immediate_dominators;
+	i32* positions; // Per instruction: Index within its block.
+	b32 result;
+};
+typedef struct IrVerifier IrVerifier;
+
+static void verify_error(IrVerifier* verifier, i32 block, IrValue value, const char* format, ...)
+{
+	String name = program_get_name(verifier->program, program_get_function(verifier->program, verifier->function->function_index)->name);
+
+	fprintf(stderr, "IR ERROR in '%.*s', L%d", (i32)name.len, name.str, block);
+	if (value != IR_NO_VALUE)
+	{
+		fprintf(stderr, ", %%%d", value);
+	}
+	fprintf(stderr, ": ");
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+
+	fprintf(stderr, "\n");
+	verifier->result = false;
+}
+
+static b32 block_dominates(IrVerifier* verifier, i32 dominator, i32 block)
+{
+	for (; block >= 0; block = verifier->immediate_dominators[block])
+	{
+		if (block == dominator)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static b32 is_reachable(IrVerifier* verifier, i32 block)
+{
+	return block == 0 || verifier->immediate_dominators[block] >= 0;
+}
+
+// The operand must be a live value defined where it is available at the end of block, or before position if the use
+// is in block itself.
+static void verify_operand(IrVerifier* verifier, i32 block, IrValue user, IrValue operand, i32 position)
+{
+	IrFunction* function = verifier->function;
+
+	if (operand < 0 || operand >= function->instructions.count)
+	{
+		verify_error(verifier, block, user, "operand %%%d does not exist", operand);
+		return;
+	}
+
+	IrInstruction* definition = ir_get_instruction(function, operand);
+	if (definition->opcode == IrOpcode_Removed || definition->block < 0)
+	{
+		verify_error(verifier, block, user, "operand %%%d was removed", operand);
+		return;
+	}
+	if (definition->data_type == NumericDatatype_Unknown)
+	{
+		verify_error(verifier, block, user, "operand %%%d has no value", operand);
+		return;
+	}
+
+	if (!is_reachable(verifier, block))
+	{
+		return;
+	}
+
+	if (definition->block == block)
+	{
+		if (verifier->positions[operand] >= position)
+		{
+			verify_error(verifier, block, user, "operand %%%d is defined after its use", operand);
+		}
+	}
+	else if (!block_dominates(verifier, definition->block, block))
+	{
+		verify_error(verifier, block, user, "definition of operand %%%d in L%d does not dominate its use", operand, definition->block);
+	}
+}
+
+static void verify_types(IrVerifier* verifier, i32 block, IrValue value)
+{
+	IrFunction* function = verifier->function;
+	IrInstruction* instruction = ir_get_instruction(function, value);
+
+	i32 operand_count;
+	IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+	for (i32 i = 0; i < operand_count; ++i)
+	{
+		if (operands[i] < 0 || operands[i] >= function->instructions.count)
+		{
+			return; // Reported as a missing operand.
+		}
+	}
+
+	NumericDatatype data_type = instruction->data_type;
+	NumericDatatype expected_operand_type = NumericDatatype_Unknown;
+
+	if (ir_is_binary_operation(instruction->opcode))
+	{
+		NumericDatatype lhs_type = ir_get_instruction(function, operands[0])->data_type;
+		NumericDatatype rhs_type = ir_get_instruction(function, operands[1])->data_type;
+		if (lhs_type != rhs_type)
+		{
+			verify_error(verifier, block, value, "operand types %s and %s differ", numeric_to_string(lhs_type), numeric_to_string(rhs_type));
+		}
+		if (ir_is_comparison(instruction->opcode) && data_type != NumericDatatype_B32)
+		{
+			verify_error(verifier, block, value, "comparison does not produce b32");
+		}
+		expected_operand_type = ir_is_comparison(instruction->opcode) ? lhs_type : data_type;
+	}
+	else if (ir_is_unary_operation(instruction->opcode) || instruction->opcode == IrOpcode_Phi)
+	{
+		expected_operand_type = data_type;
+	}
+	else if (instruction->opcode == IrOpcode_Branch)
+	{
+		expected_operand_type = NumericDatatype_B32;
+	}
+	else if (instruction->opcode == IrOpcode_Return)
+	{
+		expected_operand_type = program_get_function(verifier->program, function->function_index)->return_data_type;
+	}
+	else if (instruction->opcode == IrOpcode_Call)
+	{
+		Function* callee = program_get_function(verifier->program, instruction->call.function_index);
+		if (callee->parameter_count != operand_count || callee->return_data_type != data_type)
+		{
+			verify_error(verifier, block, value, "call does not match the signature of its callee");
+			return;
+		}
+		for (i32 i = 0; i < operand_count; ++i)
+		{
+			NumericDatatype parameter_type = verifier->program->function_parameters.items[callee->first_parameter + i].data_type;
+			if (ir_get_instruction(function, operands[i])->data_type != parameter_type)
+			{
+				verify_error(verifier, block, value, "argument %d is not %s", i, numeric_to_string(parameter_type));
+			}
+		}
+		return;
+	}
+	else if (instruction->opcode == IrOpcode_Constant && instruction->constant.type != data_type)
+	{
+		verify_error(verifier, block, value, "constant is not %s", numeric_to_string(data_type));
+	}
+
+	if (expected_operand_type == NumericDatatype_Unknown)
+	{
+		return;
+	}
+
+	for (i32 i = 0; i < operand_count; ++i)
+	{
+		NumericDatatype operand_type = ir_get_instruction(function, operands[i])->data_type;
+		if (operand_type != expected_operand_type)
+		{
+			verify_error(verifier, block, value, "operand %%%d is %s instead of %s", operands[i], numeric_to_string(operand_type), numeric_to_string(expected_operand_type));
+		}
+	}
+}
+
+static void verify_function(IrVerifier* verifier)
+{
+	IrFunction* function = verifier->function;
+	i64 block_count = function->blocks.count;
+
+	if (block_count == 0)
+	{
+		verify_error(verifier, 0, IR_NO_VALUE, "function has no blocks");
+		return;
+	}
+	if (ir_get_block(function, 0)->predecessors.count)
+	{
+		verify_error(verifier, 0, IR_NO_VALUE, "entry block has predecessors");
+	}
+
+	// Structure first; dominance can only be computed on a well formed graph.
+	for (i64 i = 0; i < function->instructions.count; ++i)
+	{
+		verifier->positions[i] = -1;
+	}
+
+	for (i32 block = 0; block < block_count; ++block)
+	{
+		IrBlock* b = ir_get_block(function, block);
+
+		if (b->instructions.count == 0)
+		{
+			verify_error(verifier, block, IR_NO_VALUE, "block is empty");
+			return;
+		}
+
+		b32 phis_allowed = true;
+		for (i32 i = 0; i < b->instructions.count; ++i)
+		{
+			IrValue value = b->instructions.items[i];
+			if (value < 0 || value >= function->instructions.count)
+			{
+				verify_error(verifier, block, IR_NO_VALUE, "instruction %%%d does not exist", value);
+				return;
+			}
+
+			IrInstruction* instruction = ir_get_instruction(function, value);
+			if (verifier->positions[value] >= 0 || instruction->block != block)
+			{
+				verify_error(verifier, block, value, "instruction is listed in more than one block, or in the wrong one");
+				return;
+			}
+			verifier->positions[value] = i;
+
+			b32 is_last = (i == b->instructions.count - 1);
+			if (instruction->opcode == IrOpcode_Removed)
+			{
+				verify_error(verifier, block, value, "removed instruction is still listed");
+			}
+			if (ir_is_terminator(instruction->opcode) != is_last)
+			{
+				verify_error(verifier, block, value, is_last ? "block does not end with a terminator" : "terminator in the middle of the block");
+				return;
+			}
+			if (instruction->opcode == IrOpcode_Phi)
+			{
+				if (!phis_allowed)
+				{
+					verify_error(verifier, block, value, "phi after other instructions");
+				}
+				if (instruction->phi.operand_count != b->predecessors.count)
+				{
+					verify_error(verifier, block, value, "phi has %d operands for %d predecessors", instruction->phi.operand_count, (i32)b->predecessors.count);
+					return;
+				}
+			}
+			else
+			{
+				phis_allowed = false;
+			}
+		}
+
+		i32 successors[2];
+		i32 successor_count = ir_get_successors(function, block, successors);
+		for (i32 i = 0; i < successor_count; ++i)
+		{
+			if (successors[i] < 0 || successors[i] >= block_count)
+			{
+				verify_error(verifier, block, IR_NO_VALUE, "successor L%d does not exist", successors[i]);
+				return;
+			}
+		}
+	}
+
+	// Predecessor lists must match the edges of the terminators exactly, including how often an edge occurs.
+	for (i32 block = 0; block < block_count; ++block)
+	{
+		IrBlock* b = ir_get_block(function, block);
+		for (i64 i = 0; i < b->predecessors.count; ++i)
+		{
+			i32 predecessor = b->predecessors.items[i];
+			if (predecessor < 0 || predecessor >= block_count)
+			{
+				verify_error(verifier, block, IR_NO_VALUE, "predecessor L%d does not exist", predecessor);
+				return;
+			}
+
+			i32 listed = 0;
+			for (i64 j = 0; j < b->predecessors.count; ++j)
+			{
+				listed += (b->predecessors.items[j] == predecessor);
+			}
+
+			i32 successors[2];
+			i32 successor_count = ir_get_successors(function, predecessor, successors);
+			i32 edges = 0;
+			for (i32 j = 0; j < successor_count; ++j)
+			{
+				edges += (successors[j] == block);
+			}
+
+			if (listed != edges)
+			{
+				verify_error(verifier, block, IR_NO_VALUE, "predecessor L%d is listed %d times for %d edges", predecessor, listed, edges);
+				return;
+			}
+		}
+
+		i32 successors[2];
+		i32 successor_count = ir_get_successors(function, block, successors);
+		for (i32 i = 0; i < successor_count; ++i)
+		{
+			IrBlock* successor = ir_get_block(function, successors[i]);
+			b32 found = false;
+			for (i64 j = 0; j < successor->predecessors.count && !found; ++j)
+			{
+				found = (successor->predecessors.items[j] == block);
+			}
+			if (!found)
+			{
+				verify_error(verifier, block, IR_NO_VALUE, "L%d is not listed as a predecessor of its successor L%d", block, successors[i]);
+				return;
+			}
+		}
+	}
+
+	if (!verifier->result)
+	{
+		return;
+	}
+
+	i32* order = malloc(sizeof(i32) * block_count);
+	i32 order_count = ir_compute_reverse_postorder(function, order);
+	ir_compute_dominators(function, order, order_count, verifier->immediate_dominators);
+	free(order);
+
+	for (i32 block = 0; block < block_count; ++block)
+	{
+		IrBlock* b = ir_get_block(function, block);
+		for (i32 i = 0; i < b->instructions.count; ++i)
+		{
+			IrValue value = b->instructions.items[i];
+			IrInstruction* instruction = ir_get_instruction(function, value);
+
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+
+			if (instruction->opcode == IrOpcode_Phi)
+			{
+				// Each operand is used at the end of its predecessor. Edges that occur twice must agree.
+				for (i32 j = 0; j < operand_count; ++j)
+				{
+					i32 predecessor = b->predecessors.items[j];
+					IrBlock* p = ir_get_block(function, predecessor);
+					verify_operand(verifier, predecessor, value, operands[j], (i32)p->instructions.count);
+
+					for (i32 k = 0; k < j; ++k)
+					{
+						if (b->predecessors.items[k] == predecessor && operands[k] != operands[j])
+						{
+							verify_error(verifier, block, value, "phi operands for the same predecessor L%d differ", predecessor);
+						}
+					}
+				}
+			}
+			else
+			{
+				for (i32 j = 0; j < operand_count; ++j)
+				{
+					verify_operand(verifier, block, value, operands[j], i);
+				}
+			}
+
+			verify_types(verifier, block, value);
+		}
+	}
+}
+
+b32 ir_verify(Program* program, IrProgram* ir)
+{
+	IrVerifier verifier = { .program = program, .result = true };
+
+	b32 result = true;
+
+	for (i64 i = 0; i < ir->function_count; ++i)
+	{
+		IrFunction* function = &ir->functions[i];
+
+		verifier.function = function;
+		verifier.result = true;
+		verifier.immediate_dominators = malloc(sizeof(i32) * max(function->blocks.count, 1));
+		verifier.positions = malloc(sizeof(i32) * max(function->instructions.count, 1));
+
+		verify_function(&verifier);
+		result &= verifier.result;
+
+		free(verifier.immediate_dominators);
+		free(verifier.positions);
+	}
+
+	return result;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "program.h"
+
+
+// SSA intermediate representation, built from the analyzed program. Each function is a control flow graph of basic
+// blocks. Every instruction that produces something defines exactly one value, named by the instruction's index, and
+// every value is assigned exactly once; where control flow merges, phi instructions select between the values that
+// reach the block from each predecessor.
+
+typedef i32 IrValue; // Index into IrFunction.instructions.
+
+#define IR_NO_VALUE (-1)
+
+enum IrOpcode
+{
+	IrOpcode_Removed, // Left behind when a pass deletes an instruction. Not part of any block.
+
+	// Values without operands.
+	IrOpcode_Constant,
+	IrOpcode_Undefined, // Read of a variable before it was assigned.
+	IrOpcode_Parameter,
+
+	IrOpcode_Phi,
+	IrOpcode_Convert,
+	IrOpcode_Call,
+
+	// Binary operations. Both operands have the type of the operation, except for comparisons, which produce b32.
+	IrOpcode_BitwiseOr,
+	IrOpcode_BitwiseXor,
+	IrOpcode_BitwiseAnd,
+	IrOpcode_Equal,
+	IrOpcode_NotEqual,
+	IrOpcode_Less,
+	IrOpcode_Greater,
+	IrOpcode_LessEqual,
+	IrOpcode_GreaterEqual,
+	IrOpcode_LeftShift,
+	IrOpcode_RightShift,
+	IrOpcode_Addition,
+	IrOpcode_Subtraction,
+	IrOpcode_Multiplication,
+	IrOpcode_Division,
+	IrOpcode_Modulo,
+
+	// Unary operations.
+	IrOpcode_Negate,
+	IrOpcode_BitwiseNot,
+	IrOpcode_Not,
+
+	// Terminators. Every block ends with exactly one of these.
+	IrOpcode_Jump,
+	IrOpcode_Branch,
+	IrOpcode_Return,
+
+	IrOpcode_Count,
+};
+typedef enum IrOpcode IrOpcode;
+
+static b32 ir_is_binary_operation(IrOpcode opcode)
+{
+	return (opcode >= IrOpcode_BitwiseOr) && (opcode <= IrOpcode_Modulo);
+}
+
+static b32 ir_is_unary_operation(IrOpcode opcode)
+{
+	return (opcode >= IrOpcode_Negate) && (opcode <= IrOpcode_Not);
+}
+
+static b32 ir_is_comparison(IrOpcode opcode)
+{
+	return (opcode >= IrOpcode_Equal) && (opcode <= IrOpcode_GreaterEqual);
+}
+
+static b32 ir_is_terminator(IrOpcode opcode)
+{
+	return (opcode >= IrOpcode_Jump) && (opcode <= IrOpcode_Return);
+}
+
+struct IrBinary
+{
+	IrValue lhs;
+	IrValue rhs;
+};
+typedef struct IrBinary IrBinary;
+
+struct IrUnary
+{
+	IrValue operand;
+};
+typedef struct IrUnary IrUnary;
+
+// Operands live in IrFunction.operands. A phi has one per predecessor of its block, in the same order.
+struct IrOperandList
+{
+	i32 first_operand;
+	i32 operand_count;
+};
+typedef struct IrOperandList IrOperandList;
+
+struct IrCall
+{
+	i32 function_index;
+	i32 first_operand;
+	i32 operand_count;
+};
+typedef struct IrCall IrCall;
+
+struct IrJump
+{
+	i32 target;
+};
+typedef struct IrJump IrJump;
+
+struct IrBranch
+{
+	IrValue condition; // b32.
+	i32 then_block;
+	i32 else_block;
+};
+typedef struct IrBranch IrBranch;
+
+struct IrReturn
+{
+	IrValue value;
+};
+typedef struct IrReturn IrReturn;
+
+struct IrInstruction
+{
+	IrOpcode opcode;
+	NumericDatatype data_type; // Of the value. Unknown for terminators.
+	i32 block; // -1 once removed.
+
+	union
+	{
+		NumericLiteral constant;
+		i32 parameter_index;
+		IrOperandList phi;
+		IrUnary convert;
+		IrCall call;
+		IrBinary binary;
+		IrUnary unary;
+		IrJump jump;
+		IrBranch branch;
+		IrReturn ret;
+	};
+};
+typedef struct IrInstruction IrInstruction;
+
+struct IrBlock
+{
+	DynamicArray(IrValue) instructions; // Phis first, terminator last.
+	DynamicArray(i32) predecessors;
+};
+typedef struct IrBlock IrBlock;
+
+// Block 0 is the entry and has no predecessors.
+struct IrFunction
+{
+	i32 function_index;
+	b32 is_pure; // Set by the optimizer: always returns, without side effects and without trapping.
+
+	DynamicArray(IrInstruction) instructions;
+	DynamicArray(IrBlock) blocks;
+	DynamicArray(IrValue) operands; // Of phis and calls.
+};
+typedef struct IrFunction IrFunction;
+
+struct IrProgram
+{
+	IrFunction* functions; // Parallel to Program.functions.
+	i64 function_count;
+};
+typedef struct IrProgram IrProgram;
+
+
+static IrInstruction* ir_get_instruction(IrFunction* function, IrValue value)
+{
+	return &function->instructions.items[value];
+}
+
+static IrBlock* ir_get_block(IrFunction* function, i32 block)
+{
+	return &function->blocks.items[block];
+}
+
+static IrInstruction* ir_get_terminator(IrFunction* function, i32 block)
+{
+	IrBlock* b = ir_get_block(function, block);
+	return b->instructions.count ? ir_get_instruction(function, b->instructions.items[b->instructions.count - 1]) : 0;
+}
+
+IrProgram build_ir(Program* program, i32 thread_count);
+void free_ir(IrProgram* ir);
+
+// Editing. Instructions stay in IrFunction.instructions for good, so values remain valid while a pass runs. Removing
+// one only marks it; ir_compact_blocks then unlinks all removed instructions from their blocks at once.
+IrValue ir_insert_instruction(IrFunction* function, i32 block, i64 index, IrInstruction instruction); // Appends if index is -1.
+void ir_remove_instruction(IrFunction* function, IrValue value);
+void ir_compact_blocks(IrFunction* function);
+i32 ir_remove_unreachable_blocks(IrFunction* function); // Renumbers the remaining blocks. Returns how many were removed.
+i64 ir_get_first_non_phi(IrFunction* function, i32 block);
+
+// Number of operands that refer to each value. Removed instructions have no operands.
+void ir_count_uses(IrFunction* function, i32* use_counts);
+
+// Returns the successors of a block, read from its terminator.
+i32 ir_get_successors(IrFunction* function, i32 block, i32 successors[2]);
+
+// Returns the operands of an instruction, in place, so passes can rewrite them.
+IrValue* ir_get_operands(IrFunction* function, IrInstruction* instruction, i32* operand_count);
+
+// Blocks reachable from the entry in reverse postorder, so every block comes after its dominators. Returns the count;
+// order must have room for one entry per block.
+i32 ir_compute_reverse_postorder(IrFunction* function, i32* order);
+
+// Immediate dominator of every block, -1 for the entry and for unreachable blocks. order is the reverse postorder.
+void ir_compute_dominators(IrFunction* function, i32* order, i32 order_count, i32* immediate_dominators);
+
+b32 ir_verify(Program* program, IrProgram* ir); // Prints every violation to stderr.
+void ir_print(Program* program, IrProgram* ir, StringBuffer* output);
+
+String generate(Program* program, IrProgram* ir);
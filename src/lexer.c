@@ -3,6 +3,14 @@
 #include <ctype.h>
 #include <assert.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 
 struct TokenContinuation
 {
@@ -74,43 +82,729 @@ struct TokenKeywordMapping
 {
 	String str;
 	TokenType type;
+	b32 boolean_value; // Only for TokenType_NumericLiteral (true/false).
 };
 typedef struct TokenKeywordMapping TokenKeywordMapping;
 
 
-#define string(cstr) { .str = cstr, .len = sizeof(cstr) - 1 }
-static const TokenKeywordMapping token_keyword_map[] =
+// Keywords live in a perfect hash table, indexed by the first two characters and the length. The slots are computed
+// by the compiler from the list below, so classifying an identifier costs one hash and at most one compare. Two
+// keywords in the same slot do not compile (see is_keyword_slot); tweak the multipliers until all slots are distinct
+// again.
+#define KEYWORD_TABLE_SIZE 16
+#define keyword_hash(c0, c1, len) (((c0) + 3 * (c1) + 7 * (len)) & (KEYWORD_TABLE_SIZE - 1))
+
+// First character, second character, length, text, token type, and the value of the boolean literals.
+#define KEYWORDS(X) \
+	X('f', 'n', 2,	"fn",		TokenType_Function,			false) \
+	X('i', 'f', 2,	"if",		TokenType_If,				false) \
+	X('e', 'l', 4,	"else",		TokenType_Else,				false) \
+	X('w', 'h', 5,	"while",	TokenType_While,			false) \
+	X('f', 'o', 3,	"for",		TokenType_For,				false) \
+	X('r', 'e', 6,	"return",	TokenType_Return,			false) \
+	X('b', '3', 3,	"b32",		TokenType_B32,				false) \
+	X('i', '3', 3,	"i32",		TokenType_I32,				false) \
+	X('u', '3', 3,	"u32",		TokenType_U32,				false) \
+	X('f', '3', 3,	"f32",		TokenType_F32,				false) \
+	X('t', 'r', 4,	"true",		TokenType_NumericLiteral,	true) \
+	X('f', 'a', 5,	"false",	TokenType_NumericLiteral,	false)
+
+#define KEYWORD_LENGTH_CHECK(first, second, length, text, token_type, value) static_assert(sizeof(text) - 1 == length, "Wrong length for keyword '" text "'.");
+KEYWORDS(KEYWORD_LENGTH_CHECK)
+#undef KEYWORD_LENGTH_CHECK
+
+#define KEYWORD_ENTRY(first, second, length, text, token_type, value) [keyword_hash(first, second, length)] = { .str = { .str = text, .len = length }, .type = token_type, .boolean_value = value },
+static const TokenKeywordMapping token_keyword_table[KEYWORD_TABLE_SIZE] =
+{
+	KEYWORDS(KEYWORD_ENTRY)
+};
+#undef KEYWORD_ENTRY
+
+// Every keyword's slot is a case label, and duplicate case labels are an error, which keeps the table collision-free.
+static b32 is_keyword_slot(i32 slot)
+{
+	switch (slot)
+	{
+#define KEYWORD_CASE(first, second, length, text, token_type, value) case keyword_hash(first, second, length):
+		KEYWORDS(KEYWORD_CASE)
+#undef KEYWORD_CASE
+			return true;
+	}
+	return false;
+}
+
+static const TokenKeywordMapping* find_keyword(String identifier)
+{
+	if (identifier.len < 2)
+	{
+		return 0;
+	}
+
+	const TokenKeywordMapping* mapping = &token_keyword_table[keyword_hash(identifier.str[0], identifier.str[1], identifier.len)];
+	if (mapping->str.len == identifier.len && memcmp(mapping->str.str, identifier.str, identifier.len) == 0)
+	{
+		return mapping;
+	}
+	return 0;
+}
+
+static b32 keyword_table_is_consistent()
+{
+	// Every keyword must sit at the hash of its text, which catches characters that do not match it...
+	i32 boolean_count = 0;
+	for (i32 i = 0; i < KEYWORD_TABLE_SIZE; ++i)
+	{
+		const TokenKeywordMapping* mapping = &token_keyword_table[i];
+		if ((mapping->str.len != 0) != is_keyword_slot(i) || (mapping->str.len && find_keyword(mapping->str) != mapping))
+		{
+			return false;
+		}
+		boolean_count += (mapping->type == TokenType_NumericLiteral);
+	}
+
+	// ...and every keyword token type must be in the list.
+	for (TokenType type = TokenType_FirstKeyword; type <= TokenType_LastKeyword; ++type)
+	{
+		b32 found = false;
+		for (i32 i = 0; i < KEYWORD_TABLE_SIZE; ++i)
+		{
+			found |= (token_keyword_table[i].type == type);
+		}
+		if (!found)
+		{
+			return false;
+		}
+	}
+	return boolean_count == 2;
+}
+
+
+static i32 count_trailing_zeros(u32 mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (i32)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static b32 is_identifier_character(char c)
+{
+	return isalnum(c) || c == '_';
+}
+
+#if defined(__AVX2__)
+
+// Signed byte compares are fine here: All ranges we test are ASCII, and bytes >= 0x80 compare as negative.
+static __m256i simd_in_range(__m256i chars, char lo, char hi)
+{
+	__m256i above_lo = _mm256_cmpgt_epi8(chars, _mm256_set1_epi8(lo - 1));
+	__m256i below_hi = _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), chars);
+	return _mm256_and_si256(above_lo, below_hi);
+}
+
+static u32 simd_whitespace_mask(__m256i chars)
+{
+	// ' ', plus the range '\t' .. '\r', which covers \t, \n, \v, \f and \r.
+	__m256i space = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' '));
+	__m256i control = simd_in_range(chars, '\t', '\r');
+	return (u32)_mm256_movemask_epi8(_mm256_or_si256(space, control));
+}
+
+static u32 simd_newline_mask(__m256i chars)
+{
+	return (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')));
+}
+
+static u32 simd_digit_mask(__m256i chars)
+{
+	return (u32)_mm256_movemask_epi8(simd_in_range(chars, '0', '9'));
+}
+
+static u32 simd_identifier_mask(__m256i chars)
+{
+	__m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20)); // Folds 'A'..'Z' onto 'a'..'z'.
+	__m256i alpha = simd_in_range(lower, 'a', 'z');
+	__m256i digit = simd_in_range(chars, '0', '9');
+	__m256i underscore = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_'));
+	return (u32)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), underscore));
+}
+
+#endif
+
+// Returns the index of the first non-whitespace character at or after index.
+static i64 skip_whitespace(String source_code, i64 index)
+{
+	// Most runs are a single space between tokens. Don't bother with a vector load for these.
+	if (index + 1 < source_code.len && !isspace(source_code.str[index + 1]))
+	{
+		return index + 1;
+	}
+
+#if defined(__AVX2__)
+	for (; index + 32 <= source_code.len; index += 32)
+	{
+		__m256i chars = _mm256_loadu_si256((const __m256i*)(source_code.str + index));
+		u32 whitespace = simd_whitespace_mask(chars);
+		if (whitespace != 0xFFFFFFFF)
+		{
+			return index + count_trailing_zeros(~whitespace);
+		}
+	}
+#endif
+
+	for (; index < source_code.len && isspace(source_code.str[index]); ++index) {}
+	return index;
+}
+
+// Returns the index of the next '\n' at or after index, or the end of the source.
+static i64 find_newline(String source_code, i64 index)
+{
+#if defined(__AVX2__)
+	for (; index + 32 <= source_code.len; index += 32)
+	{
+		__m256i chars = _mm256_loadu_si256((const __m256i*)(source_code.str + index));
+		u32 newlines = simd_newline_mask(chars);
+		if (newlines)
+		{
+			return index + count_trailing_zeros(newlines);
+		}
+	}
+#endif
+
+	for (; index < source_code.len && source_code.str[index] != '\n'; ++index) {}
+	return index;
+}
+
+// Returns the index one past the last identifier character ([A-Za-z0-9_]) in the run starting at index.
+static i64 find_identifier_end(String source_code, i64 index)
+{
+#if defined(__AVX2__)
+	for (; index + 32 <= source_code.len; index += 32)
+	{
+		__m256i chars = _mm256_loadu_si256((const __m256i*)(source_code.str + index));
+		u32 identifier = simd_identifier_mask(chars);
+		if (identifier != 0xFFFFFFFF)
+		{
+			return index + count_trailing_zeros(~identifier);
+		}
+	}
+#endif
+
+	for (; index < source_code.len && is_identifier_character(source_code.str[index]); ++index) {}
+	return index;
+}
+
+// Returns the index one past the last digit in the run starting at index.
+static i64 find_digit_end(String source_code, i64 index)
+{
+#if defined(__AVX2__)
+	for (; index + 32 <= source_code.len; index += 32)
+	{
+		__m256i chars = _mm256_loadu_si256((const __m256i*)(source_code.str + index));
+		u32 digits = simd_digit_mask(chars);
+		if (digits != 0xFFFFFFFF)
+		{
+			return index + count_trailing_zeros(~digits);
+		}
+	}
+#endif
+
+	for (; index < source_code.len && isdigit(source_code.str[index]); ++index) {}
+	return index;
+}
+
+
+// Numeric literals.
+//
+// Integers are converted straight from the source span. Decimal floats are converted with the Eisel-Lemire algorithm
+// (https://arxiv.org/abs/2101.11408, following the structure of the fast_float library), which rounds exactly once from
+// the decimal digits to f32. Only inputs with more than 19 significant digits that land on a rounding boundary fall back
+// to strtof. Digits may be separated by '_'.
+
+#define F32_MANTISSA_BITS 23
+#define F32_MINIMUM_EXPONENT -127
+#define F32_INFINITE_POWER 0xFF
+#define F32_SMALLEST_POWER_OF_TEN -64
+#define F32_LARGEST_POWER_OF_TEN 38
+
+// 5^q normalized to 128 bits, for q in [F32_SMALLEST_POWER_OF_TEN, F32_LARGEST_POWER_OF_TEN]. Negative powers are
+// rounded up, positive powers truncated.
+static const u64 powers_of_five[][2] =
 {
-	{ .str = string("fn"),		.type = TokenType_Function },
-	{ .str = string("if"),		.type = TokenType_If },
-	{ .str = string("else"),	.type = TokenType_Else },
-	{ .str = string("while"),	.type = TokenType_While },
-	{ .str = string("for"),		.type = TokenType_For },
-	{ .str = string("return"),	.type = TokenType_Return },
-	{.str = string("b32"),		.type = TokenType_B32 },
-	{ .str = string("i32"),		.type = TokenType_I32 },
-	{ .str = string("u32"),		.type = TokenType_U32 },
-	{.str = string("f32"),		.type = TokenType_F32 },
+	{ 0xa87fea27a539e9a5, 0x3f2398d747b36224 }, // 5^-64
+	{ 0xd29fe4b18e88640e, 0x8eec7f0d19a03aad }, // 5^-63
+	{ 0x83a3eeeef9153e89, 0x1953cf68300424ac }, // 5^-62
+	{ 0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7 }, // 5^-61
+	{ 0xcdb02555653131b6, 0x3792f412cb06794d }, // 5^-60
+	{ 0x808e17555f3ebf11, 0xe2bbd88bbee40bd0 }, // 5^-59
+	{ 0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4 }, // 5^-58
+	{ 0xc8de047564d20a8b, 0xf245825a5a445275 }, // 5^-57
+	{ 0xfb158592be068d2e, 0xeed6e2f0f0d56712 }, // 5^-56
+	{ 0x9ced737bb6c4183d, 0x55464dd69685606b }, // 5^-55
+	{ 0xc428d05aa4751e4c, 0xaa97e14c3c26b886 }, // 5^-54
+	{ 0xf53304714d9265df, 0xd53dd99f4b3066a8 }, // 5^-53
+	{ 0x993fe2c6d07b7fab, 0xe546a8038efe4029 }, // 5^-52
+	{ 0xbf8fdb78849a5f96, 0xde98520472bdd033 }, // 5^-51
+	{ 0xef73d256a5c0f77c, 0x963e66858f6d4440 }, // 5^-50
+	{ 0x95a8637627989aad, 0xdde7001379a44aa8 }, // 5^-49
+	{ 0xbb127c53b17ec159, 0x5560c018580d5d52 }, // 5^-48
+	{ 0xe9d71b689dde71af, 0xaab8f01e6e10b4a6 }, // 5^-47
+	{ 0x9226712162ab070d, 0xcab3961304ca70e8 }, // 5^-46
+	{ 0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22 }, // 5^-45
+	{ 0xe45c10c42a2b3b05, 0x8cb89a7db77c506a }, // 5^-44
+	{ 0x8eb98a7a9a5b04e3, 0x77f3608e92adb242 }, // 5^-43
+	{ 0xb267ed1940f1c61c, 0x55f038b237591ed3 }, // 5^-42
+	{ 0xdf01e85f912e37a3, 0x6b6c46dec52f6688 }, // 5^-41
+	{ 0x8b61313bbabce2c6, 0x2323ac4b3b3da015 }, // 5^-40
+	{ 0xae397d8aa96c1b77, 0xabec975e0a0d081a }, // 5^-39
+	{ 0xd9c7dced53c72255, 0x96e7bd358c904a21 }, // 5^-38
+	{ 0x881cea14545c7575, 0x7e50d64177da2e54 }, // 5^-37
+	{ 0xaa242499697392d2, 0xdde50bd1d5d0b9e9 }, // 5^-36
+	{ 0xd4ad2dbfc3d07787, 0x955e4ec64b44e864 }, // 5^-35
+	{ 0x84ec3c97da624ab4, 0xbd5af13bef0b113e }, // 5^-34
+	{ 0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e }, // 5^-33
+	{ 0xcfb11ead453994ba, 0x67de18eda5814af2 }, // 5^-32
+	{ 0x81ceb32c4b43fcf4, 0x80eacf948770ced7 }, // 5^-31
+	{ 0xa2425ff75e14fc31, 0xa1258379a94d028d }, // 5^-30
+	{ 0xcad2f7f5359a3b3e, 0x096ee45813a04330 }, // 5^-29
+	{ 0xfd87b5f28300ca0d, 0x8bca9d6e188853fc }, // 5^-28
+	{ 0x9e74d1b791e07e48, 0x775ea264cf55347e }, // 5^-27
+	{ 0xc612062576589dda, 0x95364afe032a819e }, // 5^-26
+	{ 0xf79687aed3eec551, 0x3a83ddbd83f52205 }, // 5^-25
+	{ 0x9abe14cd44753b52, 0xc4926a9672793543 }, // 5^-24
+	{ 0xc16d9a0095928a27, 0x75b7053c0f178294 }, // 5^-23
+	{ 0xf1c90080baf72cb1, 0x5324c68b12dd6339 }, // 5^-22
+	{ 0x971da05074da7bee, 0xd3f6fc16ebca5e04 }, // 5^-21
+	{ 0xbce5086492111aea, 0x88f4bb1ca6bcf585 }, // 5^-20
+	{ 0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6 }, // 5^-19
+	{ 0x9392ee8e921d5d07, 0x3aff322e62439fd0 }, // 5^-18
+	{ 0xb877aa3236a4b449, 0x09befeb9fad487c3 }, // 5^-17
+	{ 0xe69594bec44de15b, 0x4c2ebe687989a9b4 }, // 5^-16
+	{ 0x901d7cf73ab0acd9, 0x0f9d37014bf60a11 }, // 5^-15
+	{ 0xb424dc35095cd80f, 0x538484c19ef38c95 }, // 5^-14
+	{ 0xe12e13424bb40e13, 0x2865a5f206b06fba }, // 5^-13
+	{ 0x8cbccc096f5088cb, 0xf93f87b7442e45d4 }, // 5^-12
+	{ 0xafebff0bcb24aafe, 0xf78f69a51539d749 }, // 5^-11
+	{ 0xdbe6fecebdedd5be, 0xb573440e5a884d1c }, // 5^-10
+	{ 0x89705f4136b4a597, 0x31680a88f8953031 }, // 5^-9
+	{ 0xabcc77118461cefc, 0xfdc20d2b36ba7c3e }, // 5^-8
+	{ 0xd6bf94d5e57a42bc, 0x3d32907604691b4d }, // 5^-7
+	{ 0x8637bd05af6c69b5, 0xa63f9a49c2c1b110 }, // 5^-6
+	{ 0xa7c5ac471b478423, 0x0fcf80dc33721d54 }, // 5^-5
+	{ 0xd1b71758e219652b, 0xd3c36113404ea4a9 }, // 5^-4
+	{ 0x83126e978d4fdf3b, 0x645a1cac083126ea }, // 5^-3
+	{ 0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4 }, // 5^-2
+	{ 0xcccccccccccccccc, 0xcccccccccccccccd }, // 5^-1
+	{ 0x8000000000000000, 0x0000000000000000 }, // 5^0
+	{ 0xa000000000000000, 0x0000000000000000 }, // 5^1
+	{ 0xc800000000000000, 0x0000000000000000 }, // 5^2
+	{ 0xfa00000000000000, 0x0000000000000000 }, // 5^3
+	{ 0x9c40000000000000, 0x0000000000000000 }, // 5^4
+	{ 0xc350000000000000, 0x0000000000000000 }, // 5^5
+	{ 0xf424000000000000, 0x0000000000000000 }, // 5^6
+	{ 0x9896800000000000, 0x0000000000000000 }, // 5^7
+	{ 0xbebc200000000000, 0x0000000000000000 }, // 5^8
+	{ 0xee6b280000000000, 0x0000000000000000 }, // 5^9
+	{ 0x9502f90000000000, 0x0000000000000000 }, // 5^10
+	{ 0xba43b74000000000, 0x0000000000000000 }, // 5^11
+	{ 0xe8d4a51000000000, 0x0000000000000000 }, // 5^12
+	{ 0x9184e72a00000000, 0x0000000000000000 }, // 5^13
+	{ 0xb5e620f480000000, 0x0000000000000000 }, // 5^14
+	{ 0xe35fa931a0000000, 0x0000000000000000 }, // 5^15
+	{ 0x8e1bc9bf04000000, 0x0000000000000000 }, // 5^16
+	{ 0xb1a2bc2ec5000000, 0x0000000000000000 }, // 5^17
+	{ 0xde0b6b3a76400000, 0x0000000000000000 }, // 5^18
+	{ 0x8ac7230489e80000, 0x0000000000000000 }, // 5^19
+	{ 0xad78ebc5ac620000, 0x0000000000000000 }, // 5^20
+	{ 0xd8d726b7177a8000, 0x0000000000000000 }, // 5^21
+	{ 0x878678326eac9000, 0x0000000000000000 }, // 5^22
+	{ 0xa968163f0a57b400, 0x0000000000000000 }, // 5^23
+	{ 0xd3c21bcecceda100, 0x0000000000000000 }, // 5^24
+	{ 0x84595161401484a0, 0x0000000000000000 }, // 5^25
+	{ 0xa56fa5b99019a5c8, 0x0000000000000000 }, // 5^26
+	{ 0xcecb8f27f4200f3a, 0x0000000000000000 }, // 5^27
+	{ 0x813f3978f8940984, 0x4000000000000000 }, // 5^28
+	{ 0xa18f07d736b90be5, 0x5000000000000000 }, // 5^29
+	{ 0xc9f2c9cd04674ede, 0xa400000000000000 }, // 5^30
+	{ 0xfc6f7c4045812296, 0x4d00000000000000 }, // 5^31
+	{ 0x9dc5ada82b70b59d, 0xf020000000000000 }, // 5^32
+	{ 0xc5371912364ce305, 0x6c28000000000000 }, // 5^33
+	{ 0xf684df56c3e01bc6, 0xc732000000000000 }, // 5^34
+	{ 0x9a130b963a6c115c, 0x3c7f400000000000 }, // 5^35
+	{ 0xc097ce7bc90715b3, 0x4b9f100000000000 }, // 5^36
+	{ 0xf0bdc21abb48db20, 0x1e86d40000000000 }, // 5^37
+	{ 0x96769950b50d88f4, 0x1314448000000000 }, // 5^38
 };
-#undef string
 
-TokenStream tokenize(String source_code)
+struct U128
 {
-	TokenStream stream = { 0 };
+	u64 low;
+	u64 high;
+};
+typedef struct U128 U128;
 
-	i32 line = 1;
+static U128 multiply_u64(u64 a, u64 b)
+{
+	U128 result;
+#if defined(_MSC_VER)
+	result.low = _umul128(a, b, &result.high);
+#else
+	unsigned __int128 product = (unsigned __int128)a * b;
+	result.low = (u64)product;
+	result.high = (u64)(product >> 64);
+#endif
+	return result;
+}
 
-	for (i64 c_index = 0; c_index < source_code.len; ++c_index)
+static i32 count_leading_zeros64(u64 value)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - (i32)index;
+#else
+	return __builtin_clzll(value);
+#endif
+}
+
+// Returns the bits of the f32 closest to w * 10^q.
+static u32 eisel_lemire_f32(u64 w, i64 q)
+{
+	if (w == 0 || q < F32_SMALLEST_POWER_OF_TEN)
+	{
+		return 0;
+	}
+	if (q > F32_LARGEST_POWER_OF_TEN)
+	{
+		return F32_INFINITE_POWER << F32_MANTISSA_BITS;
+	}
+
+	i32 leading_zeros = count_leading_zeros64(w);
+	w <<= leading_zeros;
+
+	// We need F32_MANTISSA_BITS + 3 correct bits. If the ones below those in the first product are all set, a carry
+	// from the lower half of the power could still change them, so take it into account.
+	const u64* power = powers_of_five[q - F32_SMALLEST_POWER_OF_TEN];
+	const u64 precision_mask = 0xFFFFFFFFFFFFFFFFull >> (F32_MANTISSA_BITS + 3);
+
+	U128 product = multiply_u64(w, power[0]);
+	if ((product.high & precision_mask) == precision_mask)
+	{
+		U128 second_product = multiply_u64(w, power[1]);
+		product.low += second_product.high;
+		if (second_product.high > product.low)
+		{
+			++product.high;
+		}
+	}
+
+	i32 upper_bit = (i32)(product.high >> 63);
+	i32 shift = upper_bit + 64 - F32_MANTISSA_BITS - 3;
+	u64 mantissa = product.high >> shift;
+
+	i32 power2 = (i32)(((((152170 + 65536) * q) >> 16) + 63) + upper_bit - leading_zeros - F32_MINIMUM_EXPONENT);
+
+	if (power2 <= 0)
+	{
+		// Subnormal.
+		if (-power2 + 1 >= 64)
+		{
+			return 0;
+		}
+		mantissa >>= -power2 + 1;
+		mantissa += (mantissa & 1);
+		mantissa >>= 1;
+		power2 = (mantissa < (1ull << F32_MANTISSA_BITS)) ? 0 : 1;
+		return (u32)(mantissa & ((1ull << F32_MANTISSA_BITS) - 1)) | ((u32)power2 << F32_MANTISSA_BITS);
+	}
+
+	// Exactly halfway between two floats: Round to even. This can only happen for small powers of ten.
+	if (product.low <= 1 && q >= -17 && q <= 10 && (mantissa & 3) == 1)
+	{
+		if ((mantissa << shift) == product.high)
+		{
+			mantissa &= ~1ull;
+		}
+	}
+
+	mantissa += (mantissa & 1);
+	mantissa >>= 1;
+	if (mantissa >= (2ull << F32_MANTISSA_BITS))
+	{
+		mantissa = (1ull << F32_MANTISSA_BITS);
+		++power2;
+	}
+	mantissa &= ~(1ull << F32_MANTISSA_BITS);
+
+	if (power2 >= F32_INFINITE_POWER)
+	{
+		power2 = F32_INFINITE_POWER;
+		mantissa = 0;
+	}
+
+	return (u32)mantissa | ((u32)power2 << F32_MANTISSA_BITS);
+}
+
+static f32 f32_from_bits(u32 bits)
+{
+	f32 result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+static b32 is_digit_in_base(char c, i32 base)
+{
+	switch (base)
+	{
+		case 2: return c == '0' || c == '1';
+		case 16: return isxdigit(c);
+		default: return isdigit(c);
+	}
+}
+
+static i32 digit_value(char c)
+{
+	if (c >= '0' && c <= '9') { return c - '0'; }
+	return (c | 0x20) - 'a' + 10;
+}
+
+// Returns the end of a run of digits (in the given base) and separators. A separator has to sit between two digits,
+// otherwise the run is still consumed but malformed is set.
+static i64 find_digit_sequence_end(String source_code, i64 index, i32 base, b32* malformed)
+{
+	*malformed |= (index < source_code.len && source_code.str[index] == '_');
+	while (index < source_code.len)
+	{
+		char c = source_code.str[index];
+		if (base == 10 && isdigit(c))
+		{
+			index = find_digit_end(source_code, index);
+		}
+		else if (c == '_')
+		{
+			++index;
+			*malformed |= (index == source_code.len || !is_digit_in_base(source_code.str[index], base));
+		}
+		else if (is_digit_in_base(c, base))
+		{
+			++index;
+		}
+		else
+		{
+			break;
+		}
+	}
+	return index;
+}
+
+static f32 parse_f32_fallback(String source_code, i64 start, i64 end)
+{
+	char buffer[128];
+	char* text = (end - start < (i64)sizeof(buffer)) ? buffer : malloc(end - start + 1);
+
+	i64 length = 0;
+	for (i64 i = start; i < end; ++i)
+	{
+		if (source_code.str[i] != '_')
+		{
+			text[length++] = source_code.str[i];
+		}
+	}
+	text[length] = 0;
+
+	f32 result = strtof(text, 0);
+
+	if (text != buffer)
+	{
+		free(text);
+	}
+	return result;
+}
+
+i64 parse_numeric_literal(String source_code, i64 index, NumericLiteral* result, NumericDatatype* target_type)
+{
+	i64 start = index;
+
+	i32 base = 10;
+	if (source_code.str[index] == '0' && index + 2 < source_code.len)
+	{
+		char prefix = source_code.str[index + 1] | 0x20;
+		i32 prefix_base = (prefix == 'x') ? 16 : (prefix == 'b') ? 2 : 0;
+		if (prefix_base && (is_digit_in_base(source_code.str[index + 2], prefix_base) || source_code.str[index + 2] == '_'))
+		{
+			base = prefix_base;
+			index += 2;
+		}
+	}
+
+	b32 malformed = false;
+	i64 integer_end = find_digit_sequence_end(source_code, index, base, &malformed);
+
+	b32 is_float = false;
+	i64 fraction_start = integer_end;
+	i64 fraction_end = integer_end;
+	i64 end = integer_end;
+
+	if (base == 10)
+	{
+		if (end + 1 < source_code.len && source_code.str[end] == '.' && isdigit(source_code.str[end + 1]))
+		{
+			is_float = true;
+			fraction_start = end + 1;
+			fraction_end = find_digit_sequence_end(source_code, fraction_start, 10, &malformed);
+			end = fraction_end;
+		}
+
+		if (end < source_code.len && (source_code.str[end] | 0x20) == 'e')
+		{
+			i64 exponent_digits = end + 1;
+			if (exponent_digits < source_code.len && (source_code.str[exponent_digits] == '+' || source_code.str[exponent_digits] == '-'))
+			{
+				++exponent_digits;
+			}
+			if (exponent_digits < source_code.len && (isdigit(source_code.str[exponent_digits]) || source_code.str[exponent_digits] == '_'))
+			{
+				is_float = true;
+				end = find_digit_sequence_end(source_code, exponent_digits, 10, &malformed);
+			}
+		}
+	}
+
+	if (malformed)
+	{
+		*target_type = NumericDatatype_Unknown;
+		*result = (NumericLiteral){ .type = NumericDatatype_Unknown };
+		return end;
+	}
+
+	if (!is_float)
+	{
+		u64 value = 0;
+		b32 overflow = false;
+		for (i64 i = index; i < integer_end; ++i)
+		{
+			char c = source_code.str[i];
+			if (c == '_')
+			{
+				continue;
+			}
+			value = value * base + digit_value(c);
+			overflow |= (value > UINT32_MAX);
+		}
+
+		if (overflow)
+		{
+			*target_type = NumericDatatype_U32;
+			*result = (NumericLiteral){ .type = NumericDatatype_Unknown };
+		}
+		else if (value > INT32_MAX)
+		{
+			*target_type = NumericDatatype_U32;
+			*result = (NumericLiteral){ .type = NumericDatatype_U32, .data_u32 = (u32)value };
+		}
+		else
+		{
+			*target_type = NumericDatatype_I32;
+			*result = (NumericLiteral){ .type = NumericDatatype_I32, .data_i32 = (i32)value };
+		}
+		return end;
+	}
+
+	// Decimal float: Collect up to 19 significant digits into w, such that the value is w * 10^q.
+	u64 w = 0;
+	i64 q = 0;
+	i32 significant_digits = 0;
+	b32 truncated = false;
+
+	for (i64 i = start; i < fraction_end; ++i)
+	{
+		char c = source_code.str[i];
+		if (c == '_' || c == '.')
+		{
+			continue;
+		}
+
+		b32 in_fraction = (i >= fraction_start);
+		if (significant_digits < 19)
+		{
+			if (w || c != '0')
+			{
+				w = w * 10 + (c - '0');
+				++significant_digits;
+			}
+			q -= in_fraction;
+		}
+		else
+		{
+			truncated |= (c != '0');
+			q += !in_fraction;
+		}
+	}
+
+	if (fraction_end < end)
+	{
+		i64 i = fraction_end + 1;
+		b32 negative = (source_code.str[i] == '-');
+		i += (source_code.str[i] == '+' || source_code.str[i] == '-');
+
+		i64 exponent = 0;
+		for (; i < end; ++i)
+		{
+			if (source_code.str[i] != '_' && exponent < 100000)
+			{
+				exponent = exponent * 10 + (source_code.str[i] - '0');
+			}
+		}
+		q += negative ? -exponent : exponent;
+	}
+
+	u32 bits = eisel_lemire_f32(w, q);
+	f32 value = f32_from_bits(bits);
+
+	// With truncated digits the true mantissa lies between w and w + 1. If both round to the same float, that's the answer.
+	if (truncated && eisel_lemire_f32(w + 1, q) != bits)
+	{
+		value = parse_f32_fallback(source_code, start, end);
+		memcpy(&bits, &value, sizeof(bits));
+	}
+
+	*target_type = NumericDatatype_F32;
+	if (bits == (F32_INFINITE_POWER << F32_MANTISSA_BITS))
+	{
+		*result = (NumericLiteral){ .type = NumericDatatype_Unknown };
+	}
+	else
+	{
+		*result = (NumericLiteral){ .type = NumericDatatype_F32, .data_f32 = value };
+	}
+	return end;
+}
+
+Lexer lexer_begin(String source_code, SymbolTable* symbols)
+{
+	assert(keyword_table_is_consistent());
+
+	Lexer lexer = { .source_code = source_code, .current_index = 0, .symbols = symbols };
+	return lexer;
+}
+
+Token lexer_next_token(Lexer* lexer, TokenPayload* payload)
+{
+	String source_code = lexer->source_code;
+
+	*payload = (TokenPayload){ 0 };
+
+	for (i64 c_index = lexer->current_index; c_index < source_code.len; ++c_index)
 	{
 		char c = source_code.str[c_index];
 		char next_c = (c_index + 1 < source_code.len) ? source_code.str[c_index + 1] : 0;
 
 		if (isspace(c))
 		{
-			if (c == '\n')
-			{
-				++line;
-			}
+			c_index = skip_whitespace(source_code, c_index) - 1;
 			continue;
 		}
 
@@ -118,8 +812,7 @@ TokenStream tokenize(String source_code)
 		{
 			if (next_c == '/')
 			{
-				for (; c_index < source_code.len && source_code.str[c_index] != '\n'; ++c_index) {}
-				++line;
+				c_index = find_newline(source_code, c_index);
 				continue;
 			}
 		}
@@ -128,7 +821,7 @@ TokenStream tokenize(String source_code)
 		Token token = 
 		{ 
 			.type = character_to_token_type[c], 
-			.source_location = {.line = line, .global_character_index = (i32)c_index }
+			.source_location = { .global_character_index = c_index }
 		};
 
 		TokenContinuation continuation;
@@ -151,153 +844,153 @@ Continuations:
 
 		if (isalpha(c) || c == '_')
 		{
-			for (i64 i = c_index + 1; i < source_code.len && (isalnum(source_code.str[i]) || source_code.str[i] == '_'); ++i)
-			{
-				++token_string.len;
-			}
+			token_string.len = find_identifier_end(source_code, c_index + 1) - c_index;
 
 			token.type = TokenType_Unknown;
 
-			for (i64 keyword_index = 0; keyword_index < arraysize(token_keyword_map); ++keyword_index)
+			const TokenKeywordMapping* keyword = find_keyword(token_string);
+			if (keyword)
 			{
-				if (string_equal(token_string, token_keyword_map[keyword_index].str))
+				token.type = keyword->type;
+				if (keyword->type == TokenType_NumericLiteral)
 				{
-					token.type = token_keyword_map[keyword_index].type;
-					break;
+					payload->numeric_literal = (NumericLiteral){ .type = NumericDatatype_B32, .data_b32 = keyword->boolean_value };
 				}
 			}
 
-			if (string_equal(token_string, string_from_cstr("true")))
-			{
-				token.type = TokenType_NumericLiteral;
-				token.data_index = (i32)stream.numeric_literals.count;
-				NumericLiteral numeric_literal = { .type = NumericDatatype_B32, .data_b32 = true };
-				array_push(&stream.numeric_literals, numeric_literal);
-			}
-			else if (string_equal(token_string, string_from_cstr("false")))
-			{
-				token.type = TokenType_NumericLiteral;
-				token.data_index = (i32)stream.numeric_literals.count;
-				NumericLiteral numeric_literal = { .type = NumericDatatype_B32, .data_b32 = false };
-				array_push(&stream.numeric_literals, numeric_literal);
-			}
-			
 			if (token.type == TokenType_Unknown)
 			{
 				token.type = TokenType_Identifier;
-				token.data_index = (i32)stream.strings.count;
-				array_push(&stream.strings, token_string);
+				token.data_index = (i32)symbol_intern(lexer->symbols, token_string);
 			}
 		}
 		else if (isdigit(c))
 		{
 			token.type = TokenType_NumericLiteral;
 
-			NumericLiteral numeric_literal = { .type = NumericDatatype_I32 };
-			b32 e_found = false;
+			NumericDatatype target_type;
+			token_string.len = parse_numeric_literal(source_code, c_index, &payload->numeric_literal, &target_type) - c_index;
+		}
+		else if (c == '"' && next_c)
+		{
+			assert(token_string.len == 1);
 
-			for (i64 i = c_index + 1; i < source_code.len; ++i)
+			for (i64 i = c_index + 1; i < source_code.len && source_code.str[i] != '"'; ++i)
 			{
-				char c = source_code.str[i];
-				if (!isdigit(c))
-				{
-					if (numeric_literal.type == NumericDatatype_I32)
-					{
-						if (c == '.') { numeric_literal.type = NumericDatatype_F32; }
-						if (c == 'e') { numeric_literal.type = NumericDatatype_F32; e_found = true; }
-						else { break; }
-					}
-					else if (numeric_literal.type == NumericDatatype_F32)
-					{
-						if (!e_found && c == 'e') { e_found = true; }
-						else { break; }
-					}
-					else
-					{
-						break;
-					}
-				}
-
 				++token_string.len;
 			}
 
-			char buf[32];
-			memcpy(buf, token_string.str, token_string.len);
-			buf[token_string.len] = 0;
+			token.type = TokenType_StringLiteral;
+			payload->string_literal = (String){ .str = token_string.str + 1, .len = token_string.len - 1 };
 
-			if (numeric_literal.type == NumericDatatype_I32)
-			{
-				numeric_literal.data_i32 = atoi(buf);
-			}
-			else if (numeric_literal.type == NumericDatatype_F32)
+			if (c_index + token_string.len < source_code.len)
 			{
-				numeric_literal.data_f32 = (f32)atof(buf);
-			}
-			else
-			{
-				assert(false);
+				++token_string.len; // Closing quote.
 			}
+		}
+
+		lexer->current_index = c_index + token_string.len;
+
+		return token;
+	}
+
+	lexer->current_index = source_code.len;
+
+	Token eof_token = { .type = TokenType_EOF, .source_location = { .global_character_index = source_code.len } };
+	return eof_token;
+}
+
+static void push_token(TokenStream* stream, TokenType type, i64 offset)
+{
+	i64 token_index = stream->types.count;
+	if (token_index % TOKEN_OFFSET_CHUNK_SIZE == 0)
+	{
+		array_push(&stream->offset_bases, offset);
+	}
+
+	i64 relative_offset = offset - stream->offset_bases.items[token_index / TOKEN_OFFSET_CHUNK_SIZE];
+	assert(relative_offset <= UINT32_MAX); // Would need more than 4GB of whitespace and comments between two chunks.
+
+	array_push(&stream->types, (u8)type);
+	array_push(&stream->offsets, (u32)relative_offset);
+}
+
+TokenStream tokenize(String source_code, SymbolTable* symbols)
+{
+	static_assert(TokenType_Count <= 256, "Token types are stored as u8.");
+
+	TokenStream stream = { .symbols = symbols };
 
+	Lexer lexer = lexer_begin(source_code, symbols);
+
+	for (;;)
+	{
+		TokenPayload payload;
+		Token token = lexer_next_token(&lexer, &payload);
+
+		if (token.type == TokenType_NumericLiteral)
+		{
 			token.data_index = (i32)stream.numeric_literals.count;
-			array_push(&stream.numeric_literals, numeric_literal);
+			array_push(&stream.numeric_literals, payload.numeric_literal);
 		}
-		else if (c == '"' && next_c)
+		else if (token.type == TokenType_StringLiteral)
 		{
-			assert(token_string.len == 1);
-
-			for (i64 i = c_index + 1; i < source_code.len && source_code.str[i] != '"'; ++i)
-			{
-				++token_string.len;
-			}
-
 			token.data_index = (i32)stream.strings.count;
-			String literal = { .str = token_string.str + 1, .len = token_string.len - 1 };
-			array_push(&stream.strings, literal);
+			array_push(&stream.strings, payload.string_literal);
 		}
 
-		array_push(&stream.tokens, token);
+		push_token(&stream, token.type, token.source_location.global_character_index);
+		if (token_has_payload(token.type))
+		{
+			array_push(&stream.payloads, token.data_index);
+		}
 
-		c_index += token_string.len - 1;
+		if (token.type == TokenType_EOF)
+		{
+			break;
+		}
 	}
 
-	Token eof_token = { .type = TokenType_EOF, .source_location = { .global_character_index = (i32)source_code.len, .line = line } };
-	array_push(&stream.tokens, eof_token);
-
 	return stream;
 }
 
 void free_token_stream(TokenStream* tokens)
 {
-	array_free(&tokens->tokens);
+	array_free(&tokens->types);
+	array_free(&tokens->offsets);
+	array_free(&tokens->offset_bases);
+	array_free(&tokens->payloads);
 	array_free(&tokens->strings);
 	array_free(&tokens->numeric_literals);
 }
 
 void print_tokens(TokenStream* tokens)
 {
-	for (i64 i = 0; i < tokens->tokens.count; ++i)
+	i64 payload_index = 0;
+
+	for (i64 i = 0; i < token_stream_count(tokens); ++i)
 	{
-		Token token = tokens->tokens.items[i];
+		TokenType type = token_stream_type(tokens, i);
+		i32 data_index = token_has_payload(type) ? tokens->payloads.items[payload_index++] : 0;
 
-		if (token.type == TokenType_Identifier)
+		if (type == TokenType_Identifier)
 		{
-			String identifer = tokens->strings.items[token.data_index];
+			String identifer = symbol_get_name(tokens->symbols, data_index);
 			printf("%.*s ", (i32)identifer.len, identifer.str);
 		}
-		else if (token.type == TokenType_NumericLiteral)
+		else if (type == TokenType_NumericLiteral)
 		{
-			NumericLiteral numeric_literal = tokens->numeric_literals.items[token.data_index];
+			NumericLiteral numeric_literal = tokens->numeric_literals.items[data_index];
 			printf("%s ", serialize_numeric_literal(numeric_literal));
 		}
 		else
 		{
-			printf("%s ", token_type_to_string(token.type));
+			printf("%s ", token_type_to_string(type));
 		}
 		
-		if (token.type == TokenType_EOF || token.type == TokenType_Semicolon || token.type == TokenType_OpenBrace || token.type == TokenType_CloseBrace)
+		if (type == TokenType_EOF || type == TokenType_Semicolon || type == TokenType_OpenBrace || type == TokenType_CloseBrace)
 		{
 			printf("\n");
 		}
 	}
 }
-
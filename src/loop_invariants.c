@@ -0,0 +1,421 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+// Natural loops, found from back edges: edges whose target dominates their source. All back edges to the same header
+// form one loop. Blocks are only ever appended by this pass, so headers keep their numbers while it runs.
+struct LoopAnalysis
+{
+	i32* order;
+	i32* order_index;
+	i32* immediate_dominators;
+	i32 order_count;
+
+	i32* loop_of; // Per block: The header of the loop being collected, if the block is part of it.
+	i32* worklist;
+
+	DynamicArray(IrValue) invariants; // Of the current loop, in the order they are hoisted.
+	DynamicArray(b32) is_invariant; // Per value.
+};
+typedef struct LoopAnalysis LoopAnalysis;
+
+
+static void analyze_loops(IrFunction* function, LoopAnalysis* analysis)
+{
+	i64 block_count = function->blocks.count;
+
+	analysis->order = realloc(analysis->order, sizeof(i32) * block_count);
+	analysis->order_index = realloc(analysis->order_index, sizeof(i32) * block_count);
+	analysis->immediate_dominators = realloc(analysis->immediate_dominators, sizeof(i32) * block_count);
+	analysis->loop_of = realloc(analysis->loop_of, sizeof(i32) * block_count);
+	analysis->worklist = realloc(analysis->worklist, sizeof(i32) * block_count);
+
+	analysis->order_count = ir_compute_reverse_postorder(function, analysis->order);
+	ir_compute_dominators(function, analysis->order, analysis->order_count, analysis->immediate_dominators);
+
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		analysis->order_index[i] = -1;
+	}
+	while (analysis->is_invariant.count < function->instructions.count)
+	{
+		array_push(&analysis->is_invariant, false);
+	}
+	for (i32 i = 0; i < analysis->order_count; ++i)
+	{
+		analysis->order_index[analysis->order[i]] = i;
+	}
+}
+
+// Dominators come first in reverse postorder, which rules out most pairs without walking up the tree. Unreachable
+// blocks have no index and are dominated by nothing.
+static b32 dominates(LoopAnalysis* analysis, i32 dominator, i32 block)
+{
+	if (analysis->order_index[block] < analysis->order_index[dominator])
+	{
+		return false;
+	}
+
+	while (block >= 0 && block != dominator)
+	{
+		block = analysis->immediate_dominators[block];
+	}
+	return block == dominator;
+}
+
+// Marks the blocks of the loop with the given header in loop_of and returns how many there are, 0 if the block is no
+// header. Walks backwards from the sources of the back edges up to the header.
+static i32 collect_loop(IrFunction* function, LoopAnalysis* analysis, i32 header)
+{
+	// Most blocks are no header, which is found out without touching every block.
+	IrBlock* h = ir_get_block(function, header);
+	b32 has_back_edge = false;
+	for (i64 i = 0; i < h->predecessors.count && !has_back_edge; ++i)
+	{
+		has_back_edge = dominates(analysis, header, h->predecessors.items[i]);
+	}
+	if (!has_back_edge)
+	{
+		return 0;
+	}
+
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		analysis->loop_of[i] = -1;
+	}
+
+	i32 block_count = 0;
+	i32 worklist_count = 0;
+
+	for (i64 i = 0; i < h->predecessors.count; ++i)
+	{
+		i32 predecessor = h->predecessors.items[i];
+		if (dominates(analysis, header, predecessor) && analysis->loop_of[predecessor] != header)
+		{
+			analysis->loop_of[predecessor] = header;
+			analysis->worklist[worklist_count++] = predecessor;
+			++block_count;
+		}
+	}
+
+	if (analysis->loop_of[header] != header)
+	{
+		analysis->loop_of[header] = header;
+		++block_count;
+	}
+
+	while (worklist_count)
+	{
+		i32 block = analysis->worklist[--worklist_count];
+		if (block == header)
+		{
+			continue;
+		}
+
+		IrBlock* b = ir_get_block(function, block);
+		for (i64 i = 0; i < b->predecessors.count; ++i)
+		{
+			i32 predecessor = b->predecessors.items[i];
+			if (analysis->loop_of[predecessor] != header)
+			{
+				analysis->loop_of[predecessor] = header;
+				analysis->worklist[worklist_count++] = predecessor;
+				++block_count;
+			}
+		}
+	}
+
+	return block_count;
+}
+
+// The block control enters the loop from, so that code placed there runs once before the loop. If the header has a
+// single predecessor outside the loop that only jumps to it, that is used as is. Otherwise a new block takes over all
+// edges from outside the loop, and the operands that header phis receive over those edges move into phis of the new
+// block.
+static i32 get_preheader(IrFunction* function, LoopAnalysis* analysis, i32 header)
+{
+	IrBlock* h = ir_get_block(function, header);
+	i64 predecessor_count = h->predecessors.count;
+
+	i32 outside_count = 0;
+	i32 outside = -1;
+	for (i64 i = 0; i < predecessor_count; ++i)
+	{
+		if (analysis->loop_of[h->predecessors.items[i]] != header)
+		{
+			outside = h->predecessors.items[i];
+			++outside_count;
+		}
+	}
+	assert(outside_count > 0);
+
+	if (outside_count == 1 && ir_get_terminator(function, outside)->opcode == IrOpcode_Jump)
+	{
+		return outside;
+	}
+
+	i32 preheader = (i32)function->blocks.count;
+	array_push(&function->blocks, (IrBlock){ 0 });
+
+	// The header's new predecessors are the preheader, followed by those inside the loop in their previous order. Its
+	// phis never need more operands than they had, so they are rewritten in place.
+	i32* order = malloc(sizeof(i32) * predecessor_count); // Indices of the outside predecessors, then of the inside ones.
+	i32 next_outside = 0;
+	i32 next_inside = outside_count;
+
+	h = ir_get_block(function, header);
+	for (i64 i = 0; i < predecessor_count; ++i)
+	{
+		i32 predecessor = h->predecessors.items[i];
+		if (analysis->loop_of[predecessor] == header)
+		{
+			order[next_inside++] = (i32)i;
+		}
+		else
+		{
+			order[next_outside++] = (i32)i;
+			array_push(&ir_get_block(function, preheader)->predecessors, predecessor);
+		}
+	}
+
+	IrValue* operands = malloc(sizeof(IrValue) * predecessor_count);
+
+	i64 phi_count = ir_get_first_non_phi(function, header);
+	for (i64 i = 0; i < phi_count; ++i)
+	{
+		IrValue value = ir_get_block(function, header)->instructions.items[i];
+		IrInstruction* phi = ir_get_instruction(function, value);
+		i32 first_operand = phi->phi.first_operand;
+		NumericDatatype data_type = phi->data_type;
+
+		for (i64 j = 0; j < predecessor_count; ++j)
+		{
+			operands[j] = function->operands.items[first_operand + order[j]];
+		}
+
+		IrValue incoming = operands[0];
+		if (outside_count > 1)
+		{
+			IrInstruction merge = { .opcode = IrOpcode_Phi, .data_type = data_type, .phi = { .first_operand = (i32)function->operands.count, .operand_count = outside_count } };
+			for (i32 j = 0; j < outside_count; ++j)
+			{
+				array_push(&function->operands, operands[j]);
+			}
+			incoming = ir_insert_instruction(function, preheader, -1, merge);
+		}
+
+		function->operands.items[first_operand] = incoming;
+		for (i64 j = outside_count; j < predecessor_count; ++j)
+		{
+			function->operands.items[first_operand + 1 + j - outside_count] = operands[j];
+		}
+		ir_get_instruction(function, value)->phi.operand_count = 1 + (i32)predecessor_count - outside_count;
+	}
+
+	IrInstruction jump = { .opcode = IrOpcode_Jump, .jump = { .target = header } };
+	ir_insert_instruction(function, preheader, -1, jump);
+
+	// Redirect the edges from outside. A branch to the header on both sides is one predecessor per edge, so all of
+	// them end up at the preheader.
+	h = ir_get_block(function, header);
+	for (i32 i = 0; i < outside_count; ++i)
+	{
+		IrInstruction* terminator = ir_get_terminator(function, h->predecessors.items[order[i]]);
+		if (terminator->opcode == IrOpcode_Jump)
+		{
+			terminator->jump.target = preheader;
+		}
+		else
+		{
+			terminator->branch.then_block = (terminator->branch.then_block == header) ? preheader : terminator->branch.then_block;
+			terminator->branch.else_block = (terminator->branch.else_block == header) ? preheader : terminator->branch.else_block;
+		}
+	}
+
+	i32* predecessors = malloc(sizeof(i32) * predecessor_count);
+	for (i64 i = 0; i < predecessor_count; ++i)
+	{
+		predecessors[i] = h->predecessors.items[order[i]];
+	}
+	h->predecessors.items[0] = preheader;
+	for (i64 i = outside_count; i < predecessor_count; ++i)
+	{
+		h->predecessors.items[1 + i - outside_count] = predecessors[i];
+	}
+	h->predecessors.count = 1 + predecessor_count - outside_count;
+
+	free(predecessors);
+	free(operands);
+	free(order);
+
+	analysis->loop_of[preheader] = -1;
+
+	return preheader;
+}
+
+static void move_instruction(IrFunction* function, IrValue value, i32 block)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	IrBlock* from = ir_get_block(function, instruction->block);
+
+	i64 index = 0;
+	while (from->instructions.items[index] != value)
+	{
+		++index;
+	}
+	memmove(from->instructions.items + index, from->instructions.items + index + 1, sizeof(IrValue) * (from->instructions.count - 1 - index));
+	--from->instructions.count;
+
+	// In front of the terminator.
+	IrBlock* to = ir_get_block(function, block);
+	IrValue terminator = to->instructions.items[to->instructions.count - 1];
+	to->instructions.items[to->instructions.count - 1] = value;
+	array_push(&to->instructions, terminator);
+	instruction->block = block;
+}
+
+// Hoists everything in the loop that computes the same value on every iteration. Operations without side effects
+// cannot trap either, so they are safe to run even if the loop body never does, wherever in the loop they are.
+static i32 hoist_from_loop(IrProgram* ir, IrFunction* function, LoopAnalysis* analysis, i32 header)
+{
+	analysis->invariants.count = 0;
+	i32 hoisted = 0; // Not counting constants.
+
+	// Reverse postorder visits operands before their uses, except for phis, which are never invariant here.
+	for (i32 i = analysis->order_index[header]; i < analysis->order_count; ++i)
+	{
+		i32 block = analysis->order[i];
+		if (analysis->loop_of[block] != header)
+		{
+			continue;
+		}
+
+		IrBlock* b = ir_get_block(function, block);
+		for (i64 j = 0; j < b->instructions.count; ++j)
+		{
+			IrValue value = b->instructions.items[j];
+			IrInstruction* instruction = ir_get_instruction(function, value);
+
+			// Constants are materialized where they are used anyway.
+			switch (instruction->opcode)
+			{
+				case IrOpcode_Constant:
+				case IrOpcode_Undefined:
+				case IrOpcode_Phi:
+					continue;
+			}
+			if (has_side_effects(ir, function, instruction))
+			{
+				continue;
+			}
+
+			b32 invariant = true;
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+			for (i32 k = 0; k < operand_count && invariant; ++k)
+			{
+				IrInstruction* operand = ir_get_instruction(function, operands[k]);
+				invariant = analysis->is_invariant.items[operands[k]] || (analysis->loop_of[operand->block] != header)
+					|| (operand->opcode == IrOpcode_Constant) || (operand->opcode == IrOpcode_Undefined);
+			}
+			if (!invariant)
+			{
+				continue;
+			}
+
+			// Constants from inside the loop come along, so they still dominate their uses.
+			for (i32 k = 0; k < operand_count; ++k)
+			{
+				IrInstruction* operand = ir_get_instruction(function, operands[k]);
+				if (analysis->loop_of[operand->block] == header && !analysis->is_invariant.items[operands[k]])
+				{
+					analysis->is_invariant.items[operands[k]] = true;
+					array_push(&analysis->invariants, operands[k]);
+				}
+			}
+
+			analysis->is_invariant.items[value] = true;
+			array_push(&analysis->invariants, value);
+			++hoisted;
+		}
+	}
+
+	if (analysis->invariants.count == 0)
+	{
+		return 0;
+	}
+
+	i32 preheader = get_preheader(function, analysis, header);
+	for (i64 i = 0; i < analysis->invariants.count; ++i)
+	{
+		move_instruction(function, analysis->invariants.items[i], preheader);
+		analysis->is_invariant.items[analysis->invariants.items[i]] = false;
+	}
+
+	return hoisted;
+}
+
+b32 hoist_loop_invariants(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics)
+{
+	LoopAnalysis analysis = { 0 };
+	DynamicArray(b32) done = { 0 }; // Per header.
+
+	i32 hoisted = 0;
+
+	// Innermost loops first, so what they hoist can move further out with the enclosing loop. The analysis is redone
+	// after every loop, since preheaders change the graph.
+	while (true)
+	{
+		analyze_loops(function, &analysis);
+
+		while (done.count < function->blocks.count)
+		{
+			array_push(&done, false);
+		}
+
+		i32 best_header = -1;
+		i32 best_size = 0;
+		for (i32 i = 0; i < analysis.order_count; ++i)
+		{
+			i32 header = analysis.order[i];
+			if (done.items[header])
+			{
+				continue;
+			}
+
+			i32 size = collect_loop(function, &analysis, header);
+			if (size == 0)
+			{
+				done.items[header] = true;
+			}
+			else if (best_header < 0 || size < best_size)
+			{
+				best_header = header;
+				best_size = size;
+			}
+		}
+
+		if (best_header < 0)
+		{
+			break;
+		}
+
+		done.items[best_header] = true;
+		collect_loop(function, &analysis, best_header);
+		hoisted += hoist_from_loop(ir, function, &analysis, best_header);
+	}
+
+	statistics->hoisted_instructions += hoisted;
+
+	free(analysis.order);
+	free(analysis.order_index);
+	free(analysis.immediate_dominators);
+	free(analysis.loop_of);
+	free(analysis.worklist);
+	array_free(&analysis.invariants);
+	array_free(&analysis.is_invariant);
+	array_free(&done);
+
+	return hoisted > 0;
+}
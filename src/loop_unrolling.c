@@ -0,0 +1,795 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+// How many instructions a loop may have once unrolled, counted like the inliner does.
+#define MAX_UNROLLED_SIZE 128
+
+// An innermost loop with one way in and one way out: The header has a phi per loop variable, is entered from a single
+// block outside and from a single latch inside, and is the only block that branches out of the loop.
+struct UnrollContext
+{
+	Program* program;
+	IrFunction* function;
+	OptimizationOptions options;
+	StringBuffer* remarks;
+
+	i32* order;
+	i32* order_index; // Per block, -1 if unreachable.
+	i32* immediate_dominators;
+	i32 order_count;
+	b32* in_loop; // Per block.
+	i32* worklist;
+	i32* loop_blocks;
+	i32 loop_block_count;
+
+	i32 header;
+	i32 preheader;
+	i32 latch;
+	i32 body; // The header's successor inside the loop.
+	i32 exit; // And outside.
+	i32 preheader_index; // Of the preheader in the header's predecessors, and of its operand in the header phis.
+	i32 latch_index;
+
+	IrValue* value_map; // Per value that existed before copying: The copy in the iteration being made. Others map to themselves.
+	i64 value_map_count;
+	i32* block_map; // Per block, likewise.
+	i64 block_map_count;
+	DynamicArray(IrValue) phi_values; // Per header phi: What it is in the iteration being made.
+	i32 header_copy; // Of the iteration copied last.
+};
+typedef struct UnrollContext UnrollContext;
+
+// What the induction variable does. The loop runs its body while the variable compares to the bound with opcode.
+struct InductionVariable
+{
+	IrValue phi;
+	IrOpcode opcode;
+	i64 init;
+	i64 step;
+	i64 bound;
+	i64 trip_count;
+};
+typedef struct InductionVariable InductionVariable;
+
+
+static void push_remark(UnrollContext* context, const char* format, ...)
+{
+	if (!context->remarks)
+	{
+		return;
+	}
+
+	Function* function = program_get_function(context->program, context->function->function_index);
+	String name = program_get_name(context->program, function->name);
+	string_buffer_push(context->remarks, "%.*s: ", (i32)name.len, name.str);
+
+	va_list args;
+	va_start(args, format);
+	string_buffer_push_va(context->remarks, format, args);
+	va_end(args);
+
+	string_buffer_push(context->remarks, "\n");
+}
+
+// Dominators come first in reverse postorder, which rules out most pairs without walking up the tree.
+static b32 dominates(UnrollContext* context, i32 dominator, i32 block)
+{
+	if (context->order_index[block] < context->order_index[dominator])
+	{
+		return false;
+	}
+
+	while (block >= 0 && block != dominator)
+	{
+		block = context->immediate_dominators[block];
+	}
+	return block == dominator;
+}
+
+static void analyze_loops(UnrollContext* context)
+{
+	IrFunction* function = context->function;
+	i64 block_count = function->blocks.count;
+
+	context->order = realloc(context->order, sizeof(i32) * block_count);
+	context->order_index = realloc(context->order_index, sizeof(i32) * block_count);
+	context->immediate_dominators = realloc(context->immediate_dominators, sizeof(i32) * block_count);
+	context->in_loop = realloc(context->in_loop, sizeof(b32) * block_count);
+	context->worklist = realloc(context->worklist, sizeof(i32) * block_count);
+	context->loop_blocks = realloc(context->loop_blocks, sizeof(i32) * block_count);
+
+	context->order_count = ir_compute_reverse_postorder(function, context->order);
+	ir_compute_dominators(function, context->order, context->order_count, context->immediate_dominators);
+
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		context->order_index[i] = -1;
+	}
+	for (i32 i = 0; i < context->order_count; ++i)
+	{
+		context->order_index[context->order[i]] = i;
+	}
+}
+
+// Marks the blocks of the loop with the given header and returns how many there are, 0 if the block is no header.
+// Also fills in the rest of the loop's shape, which the caller checks.
+static i32 collect_loop(UnrollContext* context, i32 header)
+{
+	IrFunction* function = context->function;
+
+	// Most blocks are no header, which is found out without touching every block.
+	IrBlock* h = ir_get_block(function, header);
+	b32 has_back_edge = false;
+	for (i64 i = 0; i < h->predecessors.count && !has_back_edge; ++i)
+	{
+		has_back_edge = dominates(context, header, h->predecessors.items[i]);
+	}
+	if (!has_back_edge)
+	{
+		return 0;
+	}
+
+	for (i64 i = 0; i < function->blocks.count; ++i)
+	{
+		context->in_loop[i] = false;
+	}
+
+	context->header = header;
+	context->preheader = -1;
+	context->latch = -1;
+	context->loop_block_count = 0;
+
+	i32 worklist_count = 0;
+	for (i32 i = 0; i < h->predecessors.count; ++i)
+	{
+		i32 predecessor = h->predecessors.items[i];
+		if (!dominates(context, header, predecessor))
+		{
+			context->preheader = (context->preheader < 0) ? predecessor : -2;
+			context->preheader_index = i;
+		}
+		else if (!context->in_loop[predecessor])
+		{
+			context->latch = (context->latch < 0) ? predecessor : -2;
+			context->latch_index = i;
+			context->in_loop[predecessor] = true;
+			context->worklist[worklist_count++] = predecessor;
+		}
+		else
+		{
+			context->latch = -2;
+		}
+	}
+	if (!worklist_count)
+	{
+		return 0;
+	}
+
+	context->in_loop[header] = true;
+	context->loop_blocks[context->loop_block_count++] = header;
+
+	while (worklist_count)
+	{
+		i32 block = context->worklist[--worklist_count];
+		if (block == header)
+		{
+			continue;
+		}
+		context->loop_blocks[context->loop_block_count++] = block;
+
+		IrBlock* b = ir_get_block(function, block);
+		for (i64 i = 0; i < b->predecessors.count; ++i)
+		{
+			i32 predecessor = b->predecessors.items[i];
+			if (!context->in_loop[predecessor])
+			{
+				context->in_loop[predecessor] = true;
+				context->worklist[worklist_count++] = predecessor;
+			}
+		}
+	}
+
+	return context->loop_block_count;
+}
+
+// Whether the loop has the shape unrolling expects, and no loops inside it.
+static b32 is_simple_loop(UnrollContext* context)
+{
+	IrFunction* function = context->function;
+	if (context->preheader < 0 || context->latch < 0 || context->latch == context->header)
+	{
+		return false;
+	}
+
+	IrInstruction* terminator = ir_get_terminator(function, context->header);
+	if (terminator->opcode != IrOpcode_Branch)
+	{
+		return false;
+	}
+	IrBranch branch = terminator->branch;
+	if (context->in_loop[branch.then_block] == context->in_loop[branch.else_block])
+	{
+		return false;
+	}
+	context->body = context->in_loop[branch.then_block] ? branch.then_block : branch.else_block;
+	context->exit = context->in_loop[branch.then_block] ? branch.else_block : branch.then_block;
+
+	for (i32 i = 0; i < context->loop_block_count; ++i)
+	{
+		i32 block = context->loop_blocks[i];
+		i32 successors[2];
+		i32 successor_count = ir_get_successors(function, block, successors);
+		for (i32 j = 0; j < successor_count; ++j)
+		{
+			i32 successor = successors[j];
+			if (block != context->header && !context->in_loop[successor])
+			{
+				return false;
+			}
+			if (successor != context->header && dominates(context, successor, block))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Instructions that turn into code.
+static i32 estimate_size(UnrollContext* context)
+{
+	i32 size = 0;
+	for (i32 i = 0; i < context->loop_block_count; ++i)
+	{
+		IrBlock* block = ir_get_block(context->function, context->loop_blocks[i]);
+		for (i64 j = 0; j < block->instructions.count; ++j)
+		{
+			IrOpcode opcode = ir_get_instruction(context->function, block->instructions.items[j])->opcode;
+			size += (opcode != IrOpcode_Constant && opcode != IrOpcode_Undefined && opcode != IrOpcode_Phi);
+		}
+	}
+	return size;
+}
+
+static b32 get_constant(IrFunction* function, IrValue value, NumericDatatype data_type, i64* result)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	if (instruction->opcode != IrOpcode_Constant)
+	{
+		return false;
+	}
+	*result = (data_type == NumericDatatype_U32) ? (i64)instruction->constant.data_u32 : (i64)instruction->constant.data_i32;
+	return true;
+}
+
+static IrOpcode swap_comparison(IrOpcode opcode)
+{
+	switch (opcode)
+	{
+		case IrOpcode_Less:			return IrOpcode_Greater;
+		case IrOpcode_LessEqual:	return IrOpcode_GreaterEqual;
+		case IrOpcode_Greater:		return IrOpcode_Less;
+		case IrOpcode_GreaterEqual:	return IrOpcode_LessEqual;
+	}
+	return opcode;
+}
+
+static IrOpcode negate_comparison(IrOpcode opcode)
+{
+	switch (opcode)
+	{
+		case IrOpcode_Equal:		return IrOpcode_NotEqual;
+		case IrOpcode_NotEqual:		return IrOpcode_Equal;
+		case IrOpcode_Less:			return IrOpcode_GreaterEqual;
+		case IrOpcode_LessEqual:	return IrOpcode_Greater;
+		case IrOpcode_Greater:		return IrOpcode_LessEqual;
+		case IrOpcode_GreaterEqual:	return IrOpcode_Less;
+	}
+	return opcode;
+}
+
+// The trip count follows from the constant start, step and bound, as long as the variable does not wrap around
+// before the loop ends. Values are compared as the variable's type, so u32 ones are taken as unsigned.
+static b32 compute_trip_count(InductionVariable* variable, NumericDatatype data_type)
+{
+	i64 lowest = (data_type == NumericDatatype_U32) ? 0 : INT32_MIN;
+	i64 highest = (data_type == NumericDatatype_U32) ? UINT32_MAX : INT32_MAX;
+	i64 init = variable->init;
+	i64 step = variable->step;
+	i64 bound = variable->bound;
+	i64 count;
+
+	switch (variable->opcode)
+	{
+		case IrOpcode_Less:
+		case IrOpcode_LessEqual:
+		{
+			i64 end = (variable->opcode == IrOpcode_Less) ? bound - 1 : bound;
+			if (init > end)
+			{
+				count = 0;
+				break;
+			}
+			if (step <= 0)
+			{
+				return false;
+			}
+			count = (end - init) / step + 1;
+		} break;
+		case IrOpcode_Greater:
+		case IrOpcode_GreaterEqual:
+		{
+			i64 end = (variable->opcode == IrOpcode_Greater) ? bound + 1 : bound;
+			if (init < end)
+			{
+				count = 0;
+				break;
+			}
+			if (step >= 0)
+			{
+				return false;
+			}
+			count = (init - end) / -step + 1;
+		} break;
+		case IrOpcode_NotEqual:
+		{
+			if ((bound - init) % step != 0 || (bound - init) / step < 0)
+			{
+				return false;
+			}
+			count = (bound - init) / step;
+		} break;
+		case IrOpcode_Equal:
+		{
+			count = (init == bound);
+		} break;
+		default:
+			return false;
+	}
+
+	i64 last = init + count * step;
+	if (last < lowest || last > highest || count > INT32_MAX)
+	{
+		return false;
+	}
+
+	variable->trip_count = count;
+	return true;
+}
+
+// The header branches on a comparison of one of its phis with a constant. The phi starts at a constant and has a
+// constant added to it on every iteration.
+static b32 find_induction_variable(UnrollContext* context, InductionVariable* variable)
+{
+	IrFunction* function = context->function;
+	IrBranch branch = ir_get_terminator(function, context->header)->branch;
+	IrInstruction* condition = ir_get_instruction(function, branch.condition);
+	if (!ir_is_comparison(condition->opcode))
+	{
+		return false;
+	}
+
+	variable->opcode = condition->opcode;
+	variable->phi = condition->binary.lhs;
+	IrValue bound = condition->binary.rhs;
+	IrInstruction* phi = ir_get_instruction(function, variable->phi);
+	if (phi->opcode != IrOpcode_Phi || phi->block != context->header)
+	{
+		variable->opcode = swap_comparison(condition->opcode);
+		variable->phi = condition->binary.rhs;
+		bound = condition->binary.lhs;
+		phi = ir_get_instruction(function, variable->phi);
+	}
+	if (phi->opcode != IrOpcode_Phi || phi->block != context->header)
+	{
+		return false;
+	}
+	if (branch.else_block == context->body)
+	{
+		variable->opcode = negate_comparison(variable->opcode);
+	}
+
+	NumericDatatype data_type = phi->data_type;
+	if (data_type != NumericDatatype_I32 && data_type != NumericDatatype_U32)
+	{
+		return false;
+	}
+
+	IrValue* operands = function->operands.items + phi->phi.first_operand;
+	IrInstruction* next = ir_get_instruction(function, operands[context->latch_index]);
+	if (!get_constant(function, operands[context->preheader_index], data_type, &variable->init) || !get_constant(function, bound, data_type, &variable->bound))
+	{
+		return false;
+	}
+
+	// Additions wrap around, so any step is a signed one.
+	i64 step;
+	if (next->opcode == IrOpcode_Addition && next->binary.lhs == variable->phi && get_constant(function, next->binary.rhs, NumericDatatype_I32, &step))
+	{
+		variable->step = step;
+	}
+	else if (next->opcode == IrOpcode_Addition && next->binary.rhs == variable->phi && get_constant(function, next->binary.lhs, NumericDatatype_I32, &step))
+	{
+		variable->step = step;
+	}
+	else if (next->opcode == IrOpcode_Subtraction && next->binary.lhs == variable->phi && get_constant(function, next->binary.rhs, NumericDatatype_I32, &step))
+	{
+		variable->step = -step;
+	}
+	else
+	{
+		return false;
+	}
+
+	return variable->step != 0 && compute_trip_count(variable, data_type);
+}
+
+static IrValue map_value(UnrollContext* context, IrValue value)
+{
+	return (value < context->value_map_count) ? context->value_map[value] : value;
+}
+
+// Starts over with every value mapping to itself, and the header phis taking the operands of the given edge.
+static void reset_map(UnrollContext* context, i32 operand_index)
+{
+	context->value_map_count = context->function->instructions.count;
+	context->value_map = realloc(context->value_map, sizeof(IrValue) * context->value_map_count);
+	for (i64 i = 0; i < context->value_map_count; ++i)
+	{
+		context->value_map[i] = (IrValue)i;
+	}
+
+	context->block_map_count = context->function->blocks.count;
+	context->block_map = realloc(context->block_map, sizeof(i32) * context->block_map_count);
+	for (i64 i = 0; i < context->block_map_count; ++i)
+	{
+		context->block_map[i] = (i32)i;
+	}
+
+	IrFunction* function = context->function;
+	IrBlock* h = ir_get_block(function, context->header);
+	context->phi_values.count = 0;
+	for (i64 i = 0; i < ir_get_first_non_phi(function, context->header); ++i)
+	{
+		IrInstruction* phi = ir_get_instruction(function, h->instructions.items[i]);
+		array_push(&context->phi_values, function->operands.items[phi->phi.first_operand + operand_index]);
+	}
+}
+
+// Edges back to the header stay, they are redirected when the next iteration is copied.
+static i32 map_target(UnrollContext* context, i32 target)
+{
+	return (target == context->header) ? target : context->block_map[target];
+}
+
+static void replace_target(IrFunction* function, i32 block, i32 from, i32 to)
+{
+	IrInstruction* terminator = ir_get_terminator(function, block);
+	if (terminator->opcode == IrOpcode_Jump)
+	{
+		terminator->jump.target = (terminator->jump.target == from) ? to : terminator->jump.target;
+	}
+	else if (terminator->opcode == IrOpcode_Branch)
+	{
+		terminator->branch.then_block = (terminator->branch.then_block == from) ? to : terminator->branch.then_block;
+		terminator->branch.else_block = (terminator->branch.else_block == from) ? to : terminator->branch.else_block;
+	}
+}
+
+// Appends a copy of one iteration, to be entered from the given block, which the caller redirects from the header to
+// header_copy. The header phis of the copy are replaced by phi_values, and its branch becomes a jump: Into the copied
+// body, or out of the loop if the body is not copied. Afterwards phi_values holds what the phis are in the next
+// iteration, and the copied latch still jumps to the original header. Returns the copied latch, or the copied header
+// without a body.
+static i32 copy_iteration(UnrollContext* context, i32 from, b32 with_body)
+{
+	IrFunction* function = context->function;
+	i32 header = context->header;
+	i64 phi_count = context->phi_values.count;
+
+	i32 first_copy = (i32)function->blocks.count;
+	for (i32 i = 0; i < context->loop_block_count; ++i)
+	{
+		i32 block = context->loop_blocks[i];
+		if (block == header || with_body)
+		{
+			array_push(&function->blocks, (IrBlock){ 0 });
+			context->block_map[block] = (i32)function->blocks.count - 1;
+		}
+	}
+
+	for (i64 i = 0; i < phi_count; ++i)
+	{
+		context->value_map[ir_get_block(function, header)->instructions.items[i]] = context->phi_values.items[i];
+	}
+
+	for (i32 i = 0; i < context->loop_block_count; ++i)
+	{
+		i32 block = context->loop_blocks[i];
+		if (block != header && !with_body)
+		{
+			continue;
+		}
+
+		IrBlock* source = ir_get_block(function, block);
+		for (i64 j = (block == header) ? phi_count : 0; j < source->instructions.count; ++j)
+		{
+			IrValue value = ir_get_block(function, block)->instructions.items[j];
+			IrInstruction instruction = *ir_get_instruction(function, value);
+
+			// Phi and call operands get their own range.
+			if (instruction.opcode == IrOpcode_Phi || instruction.opcode == IrOpcode_Call)
+			{
+				i32 operand_count;
+				i64 source_operand = ir_get_operands(function, &instruction, &operand_count) - function->operands.items;
+				i32 first_operand = (i32)function->operands.count;
+				for (i32 k = 0; k < operand_count; ++k)
+				{
+					IrValue operand = function->operands.items[source_operand + k];
+					array_push(&function->operands, operand);
+				}
+				if (instruction.opcode == IrOpcode_Phi)
+				{
+					instruction.phi.first_operand = first_operand;
+				}
+				else
+				{
+					instruction.call.first_operand = first_operand;
+				}
+			}
+
+			context->value_map[value] = ir_insert_instruction(function, context->block_map[block], -1, instruction);
+		}
+
+		IrBlock* copy = ir_get_block(function, context->block_map[block]);
+		source = ir_get_block(function, block);
+		for (i64 j = 0; j < source->predecessors.count && block != header; ++j)
+		{
+			array_push(&copy->predecessors, context->block_map[source->predecessors.items[j]]);
+		}
+	}
+
+	// Operands can refer to instructions copied after them, like phis of inner merges do.
+	for (i32 block = first_copy; block < function->blocks.count; ++block)
+	{
+		IrBlock* copy = ir_get_block(function, block);
+		for (i64 i = 0; i < copy->instructions.count; ++i)
+		{
+			IrInstruction* instruction = ir_get_instruction(function, copy->instructions.items[i]);
+
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+			for (i32 k = 0; k < operand_count; ++k)
+			{
+				operands[k] = map_value(context, operands[k]);
+			}
+
+			if (instruction->opcode == IrOpcode_Jump)
+			{
+				instruction->jump.target = map_target(context, instruction->jump.target);
+			}
+			else if (instruction->opcode == IrOpcode_Branch && block != context->block_map[header])
+			{
+				instruction->branch.then_block = map_target(context, instruction->branch.then_block);
+				instruction->branch.else_block = map_target(context, instruction->branch.else_block);
+			}
+		}
+	}
+
+	i32 header_copy = context->block_map[header];
+	i32 target = with_body ? context->block_map[context->body] : context->exit;
+	*ir_get_terminator(function, header_copy) = (IrInstruction){ .opcode = IrOpcode_Jump, .block = header_copy, .jump = { .target = target } };
+
+	array_push(&ir_get_block(function, header_copy)->predecessors, from);
+	context->header_copy = header_copy;
+
+	if (!with_body)
+	{
+		return header_copy;
+	}
+
+	for (i64 i = 0; i < phi_count; ++i)
+	{
+		IrInstruction* phi = ir_get_instruction(function, ir_get_block(function, header)->instructions.items[i]);
+		context->phi_values.items[i] = map_value(context, function->operands.items[phi->phi.first_operand + context->latch_index]);
+	}
+
+	return context->block_map[context->latch];
+}
+
+// Replaces the loop with trip_count copies of its body. The last copy of the header goes to the exit, and the values
+// it computes replace those of the original header outside the loop.
+static void unroll_fully(UnrollContext* context, i64 trip_count)
+{
+	IrFunction* function = context->function;
+	reset_map(context, context->preheader_index);
+
+	i32 from = context->preheader;
+	for (i64 i = 0; i < trip_count; ++i)
+	{
+		i32 latch = copy_iteration(context, from, true);
+		replace_target(function, from, context->header, context->header_copy);
+		from = latch;
+	}
+	i32 last = copy_iteration(context, from, false);
+	replace_target(function, from, context->header, last);
+
+	IrBlock* exit = ir_get_block(function, context->exit);
+	for (i64 i = 0; i < exit->predecessors.count; ++i)
+	{
+		exit->predecessors.items[i] = (exit->predecessors.items[i] == context->header) ? last : exit->predecessors.items[i];
+	}
+
+	// Only values of the header are visible outside the loop, since no other block of it dominates the exit.
+	for (i64 i = 0; i < context->value_map_count; ++i)
+	{
+		IrInstruction* instruction = &function->instructions.items[i];
+		if (instruction->opcode == IrOpcode_Removed || context->in_loop[instruction->block])
+		{
+			continue;
+		}
+
+		i32 operand_count;
+		IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+		for (i32 j = 0; j < operand_count; ++j)
+		{
+			operands[j] = map_value(context, operands[j]);
+		}
+	}
+}
+
+// Runs the first trip_count % factor iterations as copies ahead of the loop, then gives the loop factor copies of its
+// body. The header copies between them would always continue, so only the original header checks the condition.
+static void unroll_partially(UnrollContext* context, i64 trip_count, i32 factor)
+{
+	IrFunction* function = context->function;
+	i64 remainder = trip_count % factor;
+
+	if (remainder)
+	{
+		reset_map(context, context->preheader_index);
+
+		i32 from = context->preheader;
+		for (i64 i = 0; i < remainder; ++i)
+		{
+			i32 latch = copy_iteration(context, from, true);
+			replace_target(function, from, context->header, context->header_copy);
+			from = latch;
+		}
+
+		IrBlock* h = ir_get_block(function, context->header);
+		h->predecessors.items[context->preheader_index] = from;
+		for (i64 i = 0; i < context->phi_values.count; ++i)
+		{
+			IrInstruction* phi = ir_get_instruction(function, h->instructions.items[i]);
+			function->operands.items[phi->phi.first_operand + context->preheader_index] = context->phi_values.items[i];
+		}
+	}
+
+	// The back edge now comes from the last copy, and carries what the phis are after all of them. The original latch
+	// is redirected last, since every copy is made from it.
+	reset_map(context, context->latch_index);
+	i32 from = context->latch;
+	i32 first_header_copy = -1;
+	for (i32 i = 1; i < factor; ++i)
+	{
+		i32 latch = copy_iteration(context, from, true);
+		if (i > 1)
+		{
+			replace_target(function, from, context->header, context->header_copy);
+		}
+		first_header_copy = (i == 1) ? context->header_copy : first_header_copy;
+		from = latch;
+	}
+	replace_target(function, context->latch, context->header, first_header_copy);
+
+	IrBlock* h = ir_get_block(function, context->header);
+	h->predecessors.items[context->latch_index] = from;
+	for (i64 i = 0; i < context->phi_values.count; ++i)
+	{
+		IrInstruction* phi = ir_get_instruction(function, h->instructions.items[i]);
+		function->operands.items[phi->phi.first_operand + context->latch_index] = context->phi_values.items[i];
+	}
+}
+
+b32 unroll_loops(Program* program, IrFunction* function, OptimizationOptions options, OptimizationStatistics* statistics, StringBuffer* remarks)
+{
+	UnrollContext context = { .program = program, .function = function, .options = options, .remarks = remarks };
+	DynamicArray(b32) done = { 0 }; // Per header.
+
+	i32 unrolled = 0;
+
+	// Smallest loops first, which are innermost. Once one is unrolled fully, the loop around it may be innermost now.
+	while (true)
+	{
+		analyze_loops(&context);
+
+		while (done.count < function->blocks.count)
+		{
+			array_push(&done, false);
+		}
+
+		i32 best_header = -1;
+		i32 best_size = 0;
+		for (i32 i = 0; i < context.order_count; ++i)
+		{
+			i32 header = context.order[i];
+			if (done.items[header])
+			{
+				continue;
+			}
+
+			i32 size = collect_loop(&context, header);
+			if (size == 0)
+			{
+				done.items[header] = true;
+			}
+			else if (best_header < 0 || size < best_size)
+			{
+				best_header = header;
+				best_size = size;
+			}
+		}
+
+		if (best_header < 0)
+		{
+			break;
+		}
+
+		done.items[best_header] = true;
+		collect_loop(&context, best_header);
+		if (!is_simple_loop(&context))
+		{
+			continue;
+		}
+
+		InductionVariable variable;
+		if (!find_induction_variable(&context, &variable))
+		{
+			push_remark(&context, "Loop not unrolled: Its trip count is not a constant.");
+			continue;
+		}
+
+		i64 trip_count = variable.trip_count;
+		i32 size = estimate_size(&context);
+		i32 factor = options.unroll_factor;
+		if (trip_count * size <= MAX_UNROLLED_SIZE)
+		{
+			unroll_fully(&context, trip_count);
+			push_remark(&context, "Loop from %lld by %lld unrolled fully, %lld iterations of %d instructions.", variable.init, variable.step, trip_count, size);
+			++unrolled;
+		}
+		else if (factor >= 2 && trip_count >= 2 * factor && factor * size <= MAX_UNROLLED_SIZE)
+		{
+			unroll_partially(&context, trip_count, factor);
+			push_remark(&context, "Loop from %lld by %lld unrolled by %d, %lld iterations of %d instructions, %lld of them ahead of the loop.", variable.init, variable.step, factor, trip_count, size, trip_count % factor);
+			++unrolled;
+		}
+		else
+		{
+			push_remark(&context, "Loop from %lld by %lld not unrolled: %lld iterations of %d instructions are too large.", variable.init, variable.step, trip_count, size);
+		}
+	}
+
+	if (unrolled)
+	{
+		ir_remove_unreachable_blocks(function);
+	}
+
+	statistics->unrolled_loops += unrolled;
+
+	free(context.order);
+	free(context.order_index);
+	free(context.immediate_dominators);
+	free(context.in_loop);
+	free(context.worklist);
+	free(context.loop_blocks);
+	free(context.value_map);
+	free(context.block_map);
+	array_free(&context.phi_values);
+	array_free(&done);
+
+	return unrolled > 0;
+}
@@ -1,11 +1,19 @@
-#include "program.h"
+#include "optimizer.h"
 #include "platform.h"
 
 #include <time.h>
 
 
-#define timer_start(name) clock_t name##_start = clock();
-#define timer_end(name) name = (float)(clock() - name##_start) / CLOCKS_PER_SEC;
+// Wall-clock time. clock() is CPU time, which on Linux adds up all threads and so hides any speedup from -j.
+static f64 get_time()
+{
+	struct timespec time;
+	timespec_get(&time, TIME_UTC);
+	return (f64)time.tv_sec + (f64)time.tv_nsec * 1e-9;
+}
+
+#define timer_start(name) f64 name##_start = get_time();
+#define timer_end(name) name = (float)(get_time() - name##_start);
 
 
 static void assemble(String assembly, const char* obj)
@@ -36,19 +44,156 @@ static void assemble(String assembly, const char* obj)
 	system(nasm_command);
 }
 
+static void cache_path_for_output(const char* output, char* cache_path, i64 cache_path_size)
+{
+	String output_path = { .str = (char*)output, strlen(output) };
+
+	String output_dir = path_get_parent(output_path);
+	String output_stem = path_get_stem(output_path);
+
+	snprintf(cache_path, cache_path_size, "%.*s/%.*s.o2cache", (i32)output_dir.len, output_dir.str, (i32)output_stem.len, output_stem.str);
+}
+
+struct Options
+{
+	const char* input_path;
+	const char* output_path;
+
+	b32 stream_tokens; // Lex on demand while parsing instead of materializing all tokens first.
+	i32 thread_count;
+	b32 use_cache; // Reuse the analyzed program from the last run if the source did not change.
+	b32 emit_ir; // Print the intermediate representation before generating code.
+	b32 emit_remarks; // Print what the optimizer decided and why.
+	OptimizationOptions optimization;
+};
+typedef struct Options Options;
+
+static void print_usage(const char* executable)
+{
+	fprintf(stderr, "Usage: %s [--stream] [-j N] [--no-cache] [--emit-ir] [--remarks] [-O N] [--inline-threshold N] [--unroll-factor N] <file.o2> <out.obj>\n", executable);
+	fprintf(stderr, "  --stream    Lex tokens on demand while parsing. Keeps token memory bounded for large inputs.\n");
+	fprintf(stderr, "  -j N        Use up to N threads. Defaults to the number of processors.\n");
+	fprintf(stderr, "  --no-cache  Do not read or write the analyzed program cache next to the output.\n");
+	fprintf(stderr, "  --emit-ir   Print the intermediate representation of every function, after optimization.\n");
+	fprintf(stderr, "  --remarks   Print the optimizer's decisions, like which loops it unrolled.\n");
+	fprintf(stderr, "  -O N        Optimization level. 0 (default) disables all passes, 1 enables the scalar and loop passes,\n");
+	fprintf(stderr, "              2 also inlines calls and unrolls loops.\n");
+	fprintf(stderr, "  --inline-threshold N\n");
+	fprintf(stderr, "              How much bigger than the cost of a call a function may be to be inlined. Defaults to %d.\n", DEFAULT_INLINE_THRESHOLD);
+	fprintf(stderr, "  --unroll-factor N\n");
+	fprintf(stderr, "              How many copies of their body loops too large to unroll fully get. Defaults to %d, 1 disables it.\n", DEFAULT_UNROLL_FACTOR);
+}
+
+static b32 parse_options(i32 argc, char** argv, Options* options)
+{
+	i32 positional_count = 0;
+
+	for (i32 i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+
+		if (strcmp(arg, "--stream") == 0)
+		{
+			options->stream_tokens = true;
+		}
+		else if (strcmp(arg, "--no-cache") == 0)
+		{
+			options->use_cache = false;
+		}
+		else if (strcmp(arg, "--emit-ir") == 0)
+		{
+			options->emit_ir = true;
+		}
+		else if (strcmp(arg, "--remarks") == 0)
+		{
+			options->emit_remarks = true;
+		}
+		else if (strncmp(arg, "-O", 2) == 0)
+		{
+			// Both -O1 and -O 1.
+			const char* level = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : "");
+			if (level[0] < '0' || level[0] > '9')
+			{
+				fprintf(stderr, "Option '-O' expects an optimization level.\n");
+				return false;
+			}
+			options->optimization.level = atoi(level);
+		}
+		else if (strcmp(arg, "--inline-threshold") == 0)
+		{
+			if (i + 1 == argc || (argv[i + 1][0] < '0' || argv[i + 1][0] > '9'))
+			{
+				fprintf(stderr, "Option '--inline-threshold' expects a number.\n");
+				return false;
+			}
+			options->optimization.inline_threshold = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--unroll-factor") == 0)
+		{
+			if (i + 1 == argc || atoi(argv[i + 1]) < 1)
+			{
+				fprintf(stderr, "Option '--unroll-factor' expects a factor of at least 1.\n");
+				return false;
+			}
+			options->optimization.unroll_factor = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "-j") == 0)
+		{
+			if (i + 1 == argc || atoi(argv[i + 1]) < 1)
+			{
+				fprintf(stderr, "Option '-j' expects a thread count of at least 1.\n");
+				return false;
+			}
+			options->thread_count = atoi(argv[++i]);
+		}
+		else if (arg[0] == '-')
+		{
+			fprintf(stderr, "Unknown option '%s'.\n", arg);
+			return false;
+		}
+		else if (positional_count == 0)
+		{
+			options->input_path = arg;
+			++positional_count;
+		}
+		else if (positional_count == 1)
+		{
+			options->output_path = arg;
+			++positional_count;
+		}
+		else
+		{
+			++positional_count;
+		}
+	}
+
+	if (positional_count != 2)
+	{
+		fprintf(stderr, "Invalid number of arguments.\n");
+		return false;
+	}
+
+	return true;
+}
+
 i32 main(i32 argc, char** argv)
 {
-	if (argc != 3)
+	Options options = { .thread_count = get_processor_count(), .use_cache = true, .optimization = { .inline_threshold = DEFAULT_INLINE_THRESHOLD, .unroll_factor = DEFAULT_UNROLL_FACTOR } };
+	if (!parse_options(argc, argv, &options))
 	{
-		fprintf(stderr, "Invalid number of arguments.\nUsage: %s <file.o2> <out.obj>\n", argv[0]);
+		print_usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
 	
 
+	float cache_time = 0.f;
 	float lexer_time = 0.f;
 	float parser_time = 0.f;
 	float analyzer_time = 0.f;
+	float ir_time = 0.f;
+	float optimizer_time = 0.f;
+	OptimizationStatistics optimization_statistics = { 0 };
 	float generator_time = 0.f;
 	float total_time = 0.f;
 
@@ -56,50 +201,133 @@ i32 main(i32 argc, char** argv)
 
 
 	Program program = { 0 };
-	program.source_code = read_file(argv[1]);
+	String source_file = map_file(options.input_path);
+	program.source_code = source_file;
+
+	i64 source_size = program.source_code.len;
+	b32 cache_hit = false;
 
 	if (program.source_code.len > 0)
 	{
-		timer_start(lexer_time);
-		TokenStream tokens = tokenize(program.source_code);
-		timer_end(lexer_time);
+		TokenStream tokens = { 0 };
+		String cache_file = { 0 };
+
+		char cache_path[128];
+		cache_path_for_output(options.output_path, cache_path, sizeof(cache_path));
+
+		timer_start(cache_time);
+		u64 source_hash = hash_source(program.source_code);
+		cache_hit = options.use_cache && program_load_cache(&program, cache_path, source_hash, &cache_file);
+		timer_end(cache_time);
+
+		b32 analysis_result = cache_hit;
+
+		if (!cache_hit)
+		{
+			b32 parse_result;
+
+			if (options.stream_tokens)
+			{
+				// Lexing happens inside the parser, so its time is included in the parser time.
+				timer_start(parser_time);
+				Lexer lexer = lexer_begin(program.source_code, &program.symbols);
+				parse_result = parse_streaming(&program, &lexer);
+				timer_end(parser_time);
+			}
+			else
+			{
+				timer_start(lexer_time);
+				tokens = tokenize(program.source_code, &program.symbols);
+				timer_end(lexer_time);
+
+				//print_tokens(&tokens);
 
-		//print_tokens(&tokens);
 
+				timer_start(parser_time);
+				parse_result = parse(&program, tokens, options.thread_count);
+				timer_end(parser_time);
+			}
 
-		timer_start(parser_time);
-		b32 parse_result = parse(&program, tokens);
-		timer_end(parser_time);
+			if (parse_result)
+			{
+				timer_start(analyzer_time);
+				analysis_result = analyze(&program, options.thread_count);
+				timer_end(analyzer_time);
+
+				// A program that parsed after recovering from an error must not be served from the cache later, which
+				// would skip the diagnostic.
+				if (analysis_result && options.use_cache && !program.reported_diagnostics)
+				{
+					String cache_path_string = { .str = cache_path, strlen(cache_path) };
+					create_directory(path_get_parent(cache_path_string));
+					program_save_cache(&program, cache_path, source_hash);
+				}
+			}
+		}
 
-		if (parse_result)
+		if (analysis_result)
 		{
-			timer_start(analyzer_time);
-			b32 analysis_result = analyze(&program);
-			timer_end(analyzer_time);
+			program_print_ast(&program);
+
+			timer_start(ir_time);
+			IrProgram ir = build_ir(&program, options.thread_count);
+			timer_end(ir_time);
 
-			if (analysis_result)
+			timer_start(optimizer_time);
+			StringBuffer remarks = { 0 };
+			optimization_statistics = optimize(&program, &ir, options.optimization, options.thread_count, options.emit_remarks ? &remarks : NULL);
+			timer_end(optimizer_time);
+
+			if (options.emit_remarks)
+			{
+				printf("%.*s", (i32)remarks.count, remarks.items);
+				array_free(&remarks);
+			}
+
+			b32 ir_result = ir_verify(&program, &ir);
+
+			if (options.emit_ir)
 			{
-				program_print_ast(&program);
+				StringBuffer ir_text = { 0 };
+				ir_print(&program, &ir, &ir_text);
+				printf("%.*s", (i32)ir_text.count, ir_text.items);
+				array_free(&ir_text);
+			}
 
+			if (ir_result)
+			{
 				timer_start(generator_time);
-				String assembly = generate(program);
+				String assembly = generate(&program, &ir);
 				timer_end(generator_time);
 
-				assemble(assembly, argv[2]);
+				assemble(assembly, options.output_path);
 
 				string_free(&assembly);
 			}
+
+			free_ir(&ir);
 		}
 
 		free_program(&program);
 		free_token_stream(&tokens);
+		unmap_file(&cache_file);
 	}
 
+	unmap_file(&source_file);
+
 	timer_end(total_time);
 
-	printf("Lexer: %.3fs.\n", lexer_time);
+	float lexer_throughput = (lexer_time > 0.f) ? (source_size / (1024.f * 1024.f)) / lexer_time : 0.f;
+
+	printf("Cache: %.3fs (%s).\n", cache_time, cache_hit ? "hit" : "miss");
+	printf("Lexer: %.3fs (%.1f MB/s).\n", lexer_time, lexer_throughput);
 	printf("Parser: %.3fs.\n", parser_time);
 	printf("Analyzer: %.3fs.\n", analyzer_time);
+	printf("IR: %.3fs.\n", ir_time);
+	printf("Optimizer: %.3fs (removed %d instructions, %d blocks; hoisted %d out of loops; inlined %d calls; turned %d recursive calls into loops; unrolled %d loops).\n", optimizer_time,
+		(i32)optimization_statistics.removed_instructions, (i32)optimization_statistics.removed_blocks, (i32)optimization_statistics.hoisted_instructions,
+		(i32)optimization_statistics.inlined_calls, (i32)optimization_statistics.eliminated_recursive_calls,
+		(i32)optimization_statistics.unrolled_loops);
 	printf("Generator: %.3fs.\n", generator_time);
 	printf("Finished after %.3f seconds.\n", total_time);
 
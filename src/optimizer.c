@@ -0,0 +1,317 @@
+#include "optimizer.h"
+#include "platform.h"
+
+
+struct ParallelOptimization
+{
+	Program* program;
+	IrProgram* ir;
+	OptimizationOptions options;
+	OptimizationStatistics* statistics; // Per function, so workers never share one.
+	StringBuffer* remarks; // Per function, or NULL.
+	b32 unroll; // Whether to unroll loops before the other passes. Only done once per function.
+};
+typedef struct ParallelOptimization ParallelOptimization;
+
+
+b32 may_trap(IrFunction* function, IrInstruction* instruction)
+{
+	// Integer division traps on zero and on INT_MIN / -1.
+	if ((instruction->opcode != IrOpcode_Division && instruction->opcode != IrOpcode_Modulo) || instruction->data_type == NumericDatatype_F32)
+	{
+		return false;
+	}
+
+	IrInstruction* divisor = ir_get_instruction(function, instruction->binary.rhs);
+	if (divisor->opcode != IrOpcode_Constant || divisor->constant.data_u32 == 0)
+	{
+		return true;
+	}
+	return (instruction->data_type == NumericDatatype_I32 && divisor->constant.data_i32 == -1);
+}
+
+b32 has_side_effects(IrProgram* ir, IrFunction* function, IrInstruction* instruction)
+{
+	if (ir_is_terminator(instruction->opcode))
+	{
+		return true;
+	}
+	if (instruction->opcode == IrOpcode_Call)
+	{
+		return !ir->functions[instruction->call.function_index].is_pure;
+	}
+	return may_trap(function, instruction);
+}
+
+// The language has no memory or I/O, so a function can only fail to be pure by trapping or by not returning. Loops
+// and recursion are taken to possibly not return; the latter is excluded by starting with no function marked pure.
+static void find_pure_functions(IrProgram* ir)
+{
+	b32* has_loops = calloc(max(ir->function_count, 1), sizeof(b32));
+
+	for (i64 i = 0; i < ir->function_count; ++i)
+	{
+		IrFunction* function = &ir->functions[i];
+		function->is_pure = false;
+
+		i32* order = malloc(sizeof(i32) * function->blocks.count);
+		i32* order_index = malloc(sizeof(i32) * function->blocks.count);
+		i32 order_count = ir_compute_reverse_postorder(function, order);
+		for (i32 j = 0; j < order_count; ++j)
+		{
+			order_index[order[j]] = j;
+		}
+
+		// Every cycle contains an edge that goes backwards in reverse postorder.
+		for (i32 j = 0; j < order_count && !has_loops[i]; ++j)
+		{
+			i32 successors[2];
+			i32 successor_count = ir_get_successors(function, order[j], successors);
+			for (i32 k = 0; k < successor_count; ++k)
+			{
+				has_loops[i] |= (order_index[successors[k]] <= j);
+			}
+		}
+
+		free(order_index);
+		free(order);
+	}
+
+	b32 changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (i64 i = 0; i < ir->function_count; ++i)
+		{
+			IrFunction* function = &ir->functions[i];
+			if (function->is_pure || has_loops[i])
+			{
+				continue;
+			}
+
+			b32 pure = true;
+			for (i64 j = 0; j < function->blocks.count && pure; ++j)
+			{
+				IrBlock* block = ir_get_block(function, (i32)j);
+				for (i64 k = 0; k < block->instructions.count && pure; ++k)
+				{
+					IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[k]);
+					pure = ir_is_terminator(instruction->opcode) || !has_side_effects(ir, function, instruction);
+				}
+			}
+
+			function->is_pure = pure;
+			changed |= pure;
+		}
+	}
+
+	free(has_loops);
+}
+
+// Tarjan's strongly connected components of the call graph. Components are completed callees first, which is the
+// order the inliner goes in. A function is recursive if its component has other members too, or if it calls itself.
+static void analyze_call_graph(IrProgram* ir, i32* order, b32* is_recursive)
+{
+	i64 function_count = ir->function_count;
+
+	// Callees of each function, as ranges of one array.
+	i64* first_callee = malloc(sizeof(i64) * (function_count + 1));
+	DynamicArray(i32) callees = { 0 };
+	for (i64 i = 0; i < function_count; ++i)
+	{
+		IrFunction* function = &ir->functions[i];
+		first_callee[i] = callees.count;
+		is_recursive[i] = false;
+
+		for (i64 j = 0; j < function->blocks.count; ++j)
+		{
+			IrBlock* block = ir_get_block(function, (i32)j);
+			for (i64 k = 0; k < block->instructions.count; ++k)
+			{
+				IrInstruction* instruction = ir_get_instruction(function, block->instructions.items[k]);
+				if (instruction->opcode == IrOpcode_Call)
+				{
+					array_push(&callees, instruction->call.function_index);
+					is_recursive[i] |= (instruction->call.function_index == i);
+				}
+			}
+		}
+	}
+	first_callee[function_count] = callees.count;
+
+	i32* index = malloc(sizeof(i32) * function_count);
+	i32* lowlink = malloc(sizeof(i32) * function_count);
+	b32* on_stack = calloc(max(function_count, 1), sizeof(b32));
+	i32* component_stack = malloc(sizeof(i32) * function_count);
+	i64* next_callee = malloc(sizeof(i64) * function_count);
+	i32* call_stack = malloc(sizeof(i32) * function_count);
+	i32 component_count = 0;
+	i32 call_count = 0;
+	i32 next_index = 0;
+	i32 order_count = 0;
+
+	for (i64 i = 0; i < function_count; ++i)
+	{
+		index[i] = -1;
+	}
+
+	for (i32 root = 0; root < function_count; ++root)
+	{
+		if (index[root] >= 0)
+		{
+			continue;
+		}
+
+		index[root] = lowlink[root] = next_index++;
+		next_callee[root] = first_callee[root];
+		component_stack[component_count++] = root;
+		on_stack[root] = true;
+		call_stack[call_count++] = root;
+
+		while (call_count)
+		{
+			i32 function = call_stack[call_count - 1];
+
+			if (next_callee[function] < first_callee[function + 1])
+			{
+				i32 callee = callees.items[next_callee[function]++];
+				if (index[callee] < 0)
+				{
+					index[callee] = lowlink[callee] = next_index++;
+					next_callee[callee] = first_callee[callee];
+					component_stack[component_count++] = callee;
+					on_stack[callee] = true;
+					call_stack[call_count++] = callee;
+				}
+				else if (on_stack[callee])
+				{
+					lowlink[function] = min(lowlink[function], index[callee]);
+				}
+				continue;
+			}
+
+			--call_count;
+			if (call_count)
+			{
+				i32 caller = call_stack[call_count - 1];
+				lowlink[caller] = min(lowlink[caller], lowlink[function]);
+			}
+
+			if (lowlink[function] == index[function])
+			{
+				i32 first = order_count;
+				i32 member;
+				do
+				{
+					member = component_stack[--component_count];
+					on_stack[member] = false;
+					order[order_count++] = member;
+				} while (member != function);
+
+				for (i32 j = first; j < order_count && order_count - first > 1; ++j)
+				{
+					is_recursive[order[j]] = true;
+				}
+			}
+		}
+	}
+
+	free(call_stack);
+	free(next_callee);
+	free(component_stack);
+	free(on_stack);
+	free(lowlink);
+	free(index);
+	free(first_callee);
+	array_free(&callees);
+}
+
+static void optimize_task(void* data, i64 function_index, i32 worker_index)
+{
+	ParallelOptimization* optimization = data;
+	IrFunction* function = &optimization->ir->functions[function_index];
+	OptimizationStatistics* statistics = &optimization->statistics[function_index];
+	StringBuffer* remarks = optimization->remarks ? &optimization->remarks[function_index] : NULL;
+
+	if (optimization->unroll)
+	{
+		unroll_loops(optimization->program, function, optimization->options, statistics, remarks);
+	}
+
+	// Removing a branch can merge what flows into a phi into a single constant, which can decide another branch.
+	b32 changed = true;
+	while (changed)
+	{
+		fold_constants(function);
+		changed = eliminate_tail_recursion(optimization->ir, function, statistics);
+		changed |= number_values(optimization->ir, function, statistics);
+		changed |= hoist_loop_invariants(optimization->ir, function, statistics);
+		changed |= eliminate_dead_code(optimization->ir, function, statistics);
+	}
+}
+
+OptimizationStatistics optimize(Program* program, IrProgram* ir, OptimizationOptions options, i32 thread_count, StringBuffer* remarks)
+{
+	OptimizationStatistics result = { 0 };
+
+	if (options.level <= 0)
+	{
+		return result;
+	}
+
+	find_pure_functions(ir);
+
+	ParallelOptimization optimization = { .program = program, .ir = ir, .options = options };
+	optimization.statistics = calloc(max(ir->function_count, 1), sizeof(OptimizationStatistics));
+	if (remarks)
+	{
+		optimization.remarks = calloc(max(ir->function_count, 1), sizeof(StringBuffer));
+	}
+
+	i32 worker_count = (i32)max(min(thread_count, ir->function_count), 1);
+	parallel_for(ir->function_count, worker_count, optimize_task, &optimization);
+
+	// Inlining reads callees while it changes callers, so it runs on one thread, callees first. Then loops are unrolled,
+	// and everything goes through the other passes again, which is where the copies get simplified.
+	if (options.level >= 2)
+	{
+		i32* order = malloc(sizeof(i32) * max(ir->function_count, 1));
+		b32* is_recursive = malloc(sizeof(b32) * max(ir->function_count, 1));
+		analyze_call_graph(ir, order, is_recursive);
+
+		for (i64 i = 0; i < ir->function_count; ++i)
+		{
+			i32 function_index = order[i];
+			inline_calls(program, ir, &ir->functions[function_index], is_recursive, options, &optimization.statistics[function_index]);
+		}
+
+		optimization.unroll = true;
+		parallel_for(ir->function_count, worker_count, optimize_task, &optimization);
+
+		free(is_recursive);
+		free(order);
+	}
+
+	for (i64 i = 0; i < ir->function_count; ++i)
+	{
+		result.removed_instructions += optimization.statistics[i].removed_instructions;
+		result.removed_blocks += optimization.statistics[i].removed_blocks;
+		result.hoisted_instructions += optimization.statistics[i].hoisted_instructions;
+		result.inlined_calls += optimization.statistics[i].inlined_calls;
+		result.eliminated_recursive_calls += optimization.statistics[i].eliminated_recursive_calls;
+		result.unrolled_loops += optimization.statistics[i].unrolled_loops;
+	}
+
+	// In function order, whichever worker got to them first.
+	for (i64 i = 0; i < ir->function_count && remarks; ++i)
+	{
+		StringBuffer* function_remarks = &optimization.remarks[i];
+		string_buffer_push(remarks, "%.*s", (i32)function_remarks->count, function_remarks->items);
+		array_free(function_remarks);
+	}
+	free(optimization.remarks);
+
+	free(optimization.statistics);
+
+	return result;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ir.h"
+
+
+#define DEFAULT_INLINE_THRESHOLD 8
+#define DEFAULT_UNROLL_FACTOR 4
+
+struct OptimizationOptions
+{
+	i32 level; // 0 leaves the IR as built.
+	i32 inline_threshold; // Size a callee may exceed the overhead of calling it by and still be inlined, at level 2.
+	i32 unroll_factor; // How many copies of their body loops that are too large to unroll fully get, at level 2.
+};
+typedef struct OptimizationOptions OptimizationOptions;
+
+// What the passes did, summed over all functions.
+struct OptimizationStatistics
+{
+	i64 removed_instructions;
+	i64 removed_blocks;
+	i64 hoisted_instructions;
+	i64 inlined_calls;
+	i64 eliminated_recursive_calls;
+	i64 unrolled_loops;
+};
+typedef struct OptimizationStatistics OptimizationStatistics;
+
+// Runs the passes enabled by options on every function. Output does not depend on thread_count. If remarks is not NULL,
+// passes that make decisions worth knowing about, like which loops to unroll, explain them there, a line each.
+OptimizationStatistics optimize(Program* program, IrProgram* ir, OptimizationOptions options, i32 thread_count, StringBuffer* remarks);
+
+
+// Shared by the passes. Calls to other functions only depend on their is_pure flag, which does not change while the
+// passes run.
+b32 may_trap(IrFunction* function, IrInstruction* instruction);
+b32 has_side_effects(IrProgram* ir, IrFunction* function, IrInstruction* instruction); // Includes trapping.
+
+
+// Substitutes calls to small functions with a copy of the callee's body. A callee is inlined if its size estimate is at
+// most options.inline_threshold plus what the call itself costs, or if it is marked #inline; never if it is marked
+// #noinline or is recursive. Callees are read, so they must not change meanwhile, and should be done first.
+b32 inline_calls(Program* program, IrProgram* ir, IrFunction* function, b32* is_recursive, OptimizationOptions options, OptimizationStatistics* statistics);
+
+
+// Passes. Each one works on a single function and returns whether it changed anything.
+
+// Evaluates operations on constants, with the semantics of the generated code: i32, u32 and b32 wrap around, f32 follows
+// IEEE single precision. Operations that trap at run time, like division by zero, are left alone. Integer chains of
+// the same commutative operation are reassociated, so that their constants end up next to each other.
+b32 fold_constants(IrFunction* function);
+
+// Turns branches on constants into jumps, then removes unreachable blocks, phis that no longer select anything, jumps
+// between blocks that can be merged, and instructions whose value is never used and that have no side effects.
+b32 eliminate_dead_code(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics);
+
+// Global value numbering: walks the dominator tree and replaces every instruction that computes the same operation on
+// the same operands as one that dominates it, or as another phi of its block. Calls to pure functions are included.
+b32 number_values(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics);
+
+// Loop invariant code motion: moves instructions whose operands do not change inside a loop into a block that runs once
+// before it, creating one if needed. Inner loops are done first. Pure calls are moved as well.
+b32 hoist_loop_invariants(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics);
+
+// Turns returns of calls to the function itself into jumps back to a loop header, where phis take the arguments as the
+// new parameter values. Linear recursions like return n * f(n - 1) become loops too, with an accumulator for the
+// operation that is applied on the way back out, as long as it is an integer addition, multiplication or bitwise one.
+b32 eliminate_tail_recursion(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics);
+
+// Unrolls innermost loops whose induction variable has a constant start, step and bound. Loops with few enough
+// iterations are replaced by that many copies of their body; larger ones get options.unroll_factor copies, and the
+// iterations left over run as copies ahead of the loop. Remarks may be NULL.
+b32 unroll_loops(Program* program, IrFunction* function, OptimizationOptions options, OptimizationStatistics* statistics, StringBuffer* remarks);
@@ -1,53 +1,147 @@
 #include "program.h"
+#include "platform.h"
 
 #include <assert.h>
+#include <ctype.h>
 
 
 static ExpressionHandle push_expression(Program* program, Expression expression)
 {
 	ExpressionHandle result = (i32)program->expressions.count;
-	array_push(&program->expressions, expression);
+	chunked_array_push(&program->arena, &program->expressions, expression);
 	return result;
 }
 
 static i32 push_statement(Program* program, Statement statement)
 {
 	i32 result = (i32)program->statements.count;
-	array_push(&program->statements, statement);
+	chunked_array_push(&program->arena, &program->statements, statement);
 	return result;
 }
 
+// In streaming mode, tokens are pulled from the lexer on demand into a ring buffer of this many entries. The parser
+// never looks further ahead than the current token and never withdraws more than one, so this can stay small.
+#define TOKEN_WINDOW_SIZE 64
+
+struct TokenWindow
+{
+	Token tokens[TOKEN_WINDOW_SIZE];
+	String strings[TOKEN_WINDOW_SIZE];
+	NumericLiteral numeric_literals[TOKEN_WINDOW_SIZE];
+};
+typedef struct TokenWindow TokenWindow;
+
 struct ParseContext
 {
 	Program* program;
-	TokenStream tokens;
 	i64 current_token;
+
+	// Materialized mode. Payloads are not stored per token, so we track the payload belonging to the current token (or
+	// the next one that has one).
+	TokenStream tokens;
+	i64 current_payload;
+
+	// Streaming mode. Literal tokens store their ring slot as their data_index.
+	Lexer* lexer;
+	TokenWindow* window;
+	i64 lexed_token_count;
+
+	// Set on parallel workers. Errors are not printed; the input is parsed again serially to report them.
+	b32 speculative;
+	b32 error_reported;
 };
 typedef struct ParseContext ParseContext;
 
+// Call before printing a diagnostic. Returns whether it should actually be printed.
+static b32 context_report_error(ParseContext* context)
+{
+	context->error_reported = true;
+	return !context->speculative;
+}
+
+static void context_lex_until(ParseContext* context, i64 token_index)
+{
+	while (context->lexed_token_count <= token_index)
+	{
+		i32 slot = (i32)(context->lexed_token_count++ & (TOKEN_WINDOW_SIZE - 1));
+
+		TokenPayload payload;
+		Token token = lexer_next_token(context->lexer, &payload);
+
+		if (token.type == TokenType_NumericLiteral)
+		{
+			token.data_index = slot;
+			context->window->numeric_literals[slot] = payload.numeric_literal;
+		}
+		else if (token.type == TokenType_StringLiteral)
+		{
+			token.data_index = slot;
+			context->window->strings[slot] = payload.string_literal;
+		}
+
+		context->window->tokens[slot] = token;
+	}
+}
+
+static Token* context_get_window_token(ParseContext* context, i64 token_index)
+{
+	assert(token_index > context->lexed_token_count - TOKEN_WINDOW_SIZE);
+
+	context_lex_until(context, token_index);
+	return &context->window->tokens[token_index & (TOKEN_WINDOW_SIZE - 1)];
+}
+
 static Token context_peek(ParseContext* context)
 {
-	return context->tokens.tokens.items[context->current_token];
+	if (context->lexer)
+	{
+		return *context_get_window_token(context, context->current_token);
+	}
+
+	TokenStream* tokens = &context->tokens;
+	i64 index = context->current_token;
+
+	Token token = { .type = token_stream_type(tokens, index) };
+	token.source_location.global_character_index = token_stream_offset(tokens, index);
+	if (token_has_payload(token.type))
+	{
+		token.data_index = tokens->payloads.items[context->current_payload];
+	}
+	return token;
 }
 
 static TokenType context_peek_type(ParseContext* context)
 {
-	return context->tokens.tokens.items[context->current_token].type;
+	if (context->lexer)
+	{
+		return context_get_window_token(context, context->current_token)->type;
+	}
+	return token_stream_type(&context->tokens, context->current_token);
 }
 
 static void context_advance(ParseContext* context)
 {
+	if (!context->lexer && token_has_payload(token_stream_type(&context->tokens, context->current_token)))
+	{
+		++context->current_payload;
+	}
 	++context->current_token;
 }
 
 static void context_withdraw(ParseContext* context)
 {
 	--context->current_token;
+	if (!context->lexer && token_has_payload(token_stream_type(&context->tokens, context->current_token)))
+	{
+		--context->current_payload;
+	}
 }
 
 static Token context_consume(ParseContext* context)
 {
-	return context->tokens.tokens.items[context->current_token++];
+	Token token = context_peek(context);
+	context_advance(context);
+	return token;
 }
 
 
@@ -111,9 +205,9 @@ static ExpressionType unary_operator_infos[TokenType_Count] =
 static b32 context_expect_not_eof(ParseContext* context)
 {
 	b32 result = context_peek_type(context) != TokenType_EOF;
-	if (!result)
+	if (!result && context_report_error(context))
 	{
-		fprintf(stderr, "LINE %d: Unexpected EOF.\n", context_peek(context).source_location.line);
+		fprintf(stderr, "LINE %d: Unexpected EOF.\n", program_get_line_number(context->program, context_peek(context).source_location));
 	}
 	return result;
 }
@@ -121,20 +215,21 @@ static b32 context_expect_not_eof(ParseContext* context)
 static b32 context_expect(ParseContext* context, TokenType expected)
 {
 	b32 result = context_peek_type(context) == expected;
-	if (!result)
+	if (!result && context_report_error(context))
 	{
 		Token unexpected_token = context_peek(context);
+		i32 line = program_get_line_number(context->program, unexpected_token.source_location);
 		if (expected == TokenType_Identifier)
 		{
-			fprintf(stderr, "LINE %d: Expected identifier, got '%s'.\n", unexpected_token.source_location.line, token_type_to_string(unexpected_token.type));
+			fprintf(stderr, "LINE %d: Expected identifier, got '%s'.\n", line, token_type_to_string(unexpected_token.type));
 		}
 		else if (expected == TokenType_NumericLiteral)
 		{
-			fprintf(stderr, "LINE %d: Expected literal, got '%s'.\n", unexpected_token.source_location.line, token_type_to_string(unexpected_token.type));
+			fprintf(stderr, "LINE %d: Expected literal, got '%s'.\n", line, token_type_to_string(unexpected_token.type));
 		}
 		else
 		{
-			fprintf(stderr, "LINE %d: Expected '%s', got '%s'.\n", unexpected_token.source_location.line, token_type_to_string(expected), token_type_to_string(unexpected_token.type));
+			fprintf(stderr, "LINE %d: Expected '%s', got '%s'.\n", line, token_type_to_string(expected), token_type_to_string(unexpected_token.type));
 		}
 
 		program_print_line_error(context->program, unexpected_token.source_location);
@@ -142,14 +237,47 @@ static b32 context_expect(ParseContext* context, TokenType expected)
 	return result;
 }
 
+static b32 context_expect_datatype(ParseContext* context)
+{
+	b32 result = token_is_datatype(context_peek_type(context));
+	if (!result && context_report_error(context))
+	{
+		Token unexpected_token = context_peek(context);
+		fprintf(stderr, "LINE %d: Expected type, got '%s'.\n", program_get_line_number(context->program, unexpected_token.source_location),
+			token_type_to_string(unexpected_token.type));
+		program_print_line_error(context->program, unexpected_token.source_location);
+	}
+	return result;
+}
+
 static String get_token_string(ParseContext* context, Token token)
 {
-	return context->tokens.strings.items[token.data_index];
+	return context->lexer ? context->window->strings[token.data_index] : context->tokens.strings.items[token.data_index];
+}
+
+static Symbol get_token_symbol(ParseContext* context, Token token)
+{
+	assert(token.type == TokenType_Identifier);
+	return (Symbol)token.data_index;
 }
 
 static NumericLiteral get_token_numeric_literal(ParseContext* context, Token token)
 {
-	return context->tokens.numeric_literals.items[token.data_index];
+	return context->lexer ? context->window->numeric_literals[token.data_index] : context->tokens.numeric_literals.items[token.data_index];
+}
+
+// Compares against the source, since workers of the parallel parse have no symbol table.
+static b32 identifier_equals(ParseContext* context, Token token, const char* word)
+{
+	String source_code = context->program->source_code;
+	i64 start = token.source_location.global_character_index;
+	i64 length = (i64)strlen(word);
+
+	if (start + length > (i64)source_code.len || memcmp(source_code.str + start, word, length) != 0)
+	{
+		return false;
+	}
+	return start + length == (i64)source_code.len || !(isalnum(source_code.str[start + length]) || source_code.str[start + length] == '_');
 }
 
 static ExpressionHandle parse_expression(ParseContext* context, i32 min_precedence);
@@ -171,6 +299,29 @@ static ExpressionHandle parse_atom(ParseContext* context)
 	else if (token.type == TokenType_NumericLiteral)
 	{
 		NumericLiteral numeric_literal = get_token_numeric_literal(context, token);
+		if (numeric_literal.type == NumericDatatype_Unknown)
+		{
+			if (!context_report_error(context))
+			{
+				return 0;
+			}
+
+			NumericDatatype target_type;
+			parse_numeric_literal(context->program->source_code, token.source_location.global_character_index, &numeric_literal, &target_type);
+
+			i32 line = program_get_line_number(context->program, token.source_location);
+			if (target_type == NumericDatatype_Unknown)
+			{
+				fprintf(stderr, "LINE %d: Malformed numeric literal.\n", line);
+			}
+			else
+			{
+				fprintf(stderr, "LINE %d: Numeric literal does not fit into %s.\n", line, numeric_to_string(target_type));
+			}
+			program_print_line_error(context->program, token.source_location);
+			return 0;
+		}
+
 		Expression expression = 
 		{ 
 			.type = ExpressionType_NumericLiteral,
@@ -192,7 +343,7 @@ static ExpressionHandle parse_atom(ParseContext* context)
 	}
 	else if (token.type == TokenType_Identifier)
 	{
-		String identifier = get_token_string(context, token);
+		Symbol identifier = get_token_symbol(context, token);
 
 		if (context_peek_type(context) == TokenType_OpenParenthesis)
 		{
@@ -218,6 +369,11 @@ static ExpressionHandle parse_atom(ParseContext* context)
 				}
 
 				ExpressionHandle expression = parse_expression(context, 0);
+				if (!expression)
+				{
+					return 0;
+				}
+
 				if (last)
 				{
 					program_get_expression(context->program, last)->next = expression;
@@ -243,7 +399,7 @@ static ExpressionHandle parse_atom(ParseContext* context)
 			{
 				.type = ExpressionType_Identifier,
 				.source_location = token.source_location,
-				.identifier = identifier,
+				.identifier = {.name = identifier },
 			};
 			return push_expression(context->program, expression);
 		}
@@ -251,6 +407,10 @@ static ExpressionHandle parse_atom(ParseContext* context)
 	else if (token_is_unary_operator(token.type) && context_expect_not_eof(context))
 	{
 		ExpressionHandle rhs = parse_atom(context);
+		if (!rhs)
+		{
+			return 0;
+		}
 
 		Expression expression = 
 		{ 
@@ -260,9 +420,9 @@ static ExpressionHandle parse_atom(ParseContext* context)
 		};
 		return push_expression(context->program, expression);
 	}
-	else
+	else if (context_report_error(context))
 	{
-		fprintf(stderr, "LINE %d: Unexpected token '%s'.\n", token.source_location.line, token_type_to_string(token.type));
+		fprintf(stderr, "LINE %d: Unexpected token '%s'.\n", program_get_line_number(context->program, token.source_location), token_type_to_string(token.type));
 
 		program_print_line_error(context->program, token.source_location);
 	}
@@ -275,11 +435,14 @@ static ExpressionHandle parse_expression(ParseContext* context, i32 min_preceden
 	// https://eli.thegreenplace.net/2012/08/02/parsing-expressions-by-precedence-climbing
 
 	ExpressionHandle lhs = parse_atom(context);
+	if (!lhs)
+	{
+		return 0;
+	}
 
 	for (;;)
 	{
-		Token next_token = context_peek(context);
-		TokenType next_token_type = next_token.type;
+		TokenType next_token_type = context_peek_type(context);
 
 		if (!token_is_binary_operator(next_token_type) && !token_is_assignment_operator(next_token_type))
 		{
@@ -292,11 +455,17 @@ static ExpressionHandle parse_expression(ParseContext* context, i32 min_preceden
 			break;
 		}
 
+		Token next_token = context_peek(context);
+
 		i32 next_min_precedence = info.precedence + info.associativity;
 
 		context_advance(context);
 
 		ExpressionHandle rhs = parse_expression(context, next_min_precedence);
+		if (!rhs)
+		{
+			return 0;
+		}
 
 		if (token_is_binary_operator(next_token_type))
 		{
@@ -342,7 +511,7 @@ static i32 parse_statement(ParseContext* context)
 	{
 		context_advance(context);
 
-		String identifier = get_token_string(context, token);
+		Symbol identifier = get_token_symbol(context, token);
 
 		Expression lhs_expression =
 		{
@@ -364,6 +533,10 @@ static i32 parse_statement(ParseContext* context)
 		{
 			context_advance(context);
 
+			if (!context_expect_datatype(context))
+			{
+				return 0;
+			}
 			Token data_type_token = context_consume(context);
 			NumericDatatype data_type = token_type_to_numeric(data_type_token.type);
 
@@ -381,11 +554,17 @@ static i32 parse_statement(ParseContext* context)
 				context_advance(context);
 
 				ExpressionHandle rhs = parse_expression(context, 0);
-
-				statement.type = StatementType_DeclarationAssignment;
-				statement.declaration_assignment = (DeclarationAssignmentStatement) { .data_type = data_type, .lhs = lhs, .rhs = rhs };
+				if (rhs)
+				{
+					statement.type = StatementType_DeclarationAssignment;
+					statement.declaration_assignment = (DeclarationAssignmentStatement) { .data_type = data_type, .lhs = lhs, .rhs = rhs };
+				}
+				else
+				{
+					statement.type = StatementType_Error;
+				}
 			}
-			else
+			else if (context_report_error(context))
 			{
 				Token unexpected_token = context_peek(context);
 				program_print_line_error(context->program, unexpected_token.source_location);
@@ -398,16 +577,22 @@ static i32 parse_statement(ParseContext* context)
 			ExpressionHandle rhs = parse_expression(context, 0);
 			NumericDatatype data_type = NumericDatatype_Unknown;
 
-			statement.type = StatementType_DeclarationAssignment;
-			statement.declaration_assignment = (DeclarationAssignmentStatement){ .data_type = data_type, .lhs = lhs, .rhs = rhs };
+			if (rhs)
+			{
+				statement.type = StatementType_DeclarationAssignment;
+				statement.declaration_assignment = (DeclarationAssignmentStatement){ .data_type = data_type, .lhs = lhs, .rhs = rhs };
+			}
 		}
 		else if (token_is_assignment_operator(declaration_assignment_token))
 		{
 			context_withdraw(context);
 			ExpressionHandle expression = parse_expression(context, 0);
 
-			statement.type = StatementType_Simple;
-			statement.simple = (SimpleStatement) { .expression = expression };
+			if (expression)
+			{
+				statement.type = StatementType_Simple;
+				statement.simple = (SimpleStatement) { .expression = expression };
+			}
 		}
 
 		if (statement.type != StatementType_Error)
@@ -447,8 +632,8 @@ static i32 parse_statement(ParseContext* context)
 					else_statement_count = parse_statement(context);
 				}
 
-				context->program->statements.items[statement_index].branch.then_statement_count = then_statement_count;
-				context->program->statements.items[statement_index].branch.else_statement_count = else_statement_count;
+				program_get_statement(context->program, statement_index)->branch.then_statement_count = then_statement_count;
+				program_get_statement(context->program, statement_index)->branch.else_statement_count = else_statement_count;
 
 				return then_statement_count + else_statement_count + 1;
 			}
@@ -472,7 +657,7 @@ static i32 parse_statement(ParseContext* context)
 				i32 statement_index = push_statement(context->program, statement);
 
 				i32 then_statement_count = parse_statement(context);
-				context->program->statements.items[statement_index].loop.then_statement_count = then_statement_count;
+				program_get_statement(context->program, statement_index)->loop.then_statement_count = then_statement_count;
 
 				return then_statement_count + 1;
 			}
@@ -519,7 +704,7 @@ static i32 parse_statement(ParseContext* context)
 			statement_count += parse_statement(context);
 			++direct_statement_count;
 		}
-		context->program->statements.items[statement_index].block.statement_count = statement_count;
+		program_get_statement(context->program, statement_index)->block.statement_count = statement_count;
 
 		if (context_expect(context, TokenType_CloseBrace))
 		{
@@ -605,17 +790,15 @@ static b32 parse_function(ParseContext* context)
 		}
 		context_advance(context);
 
-		if (!context_expect(context, TokenType_I32))
+		if (!context_expect_datatype(context))
 		{
 			return false;
 		}
-		context_advance(context);
+		Token data_type_token = context_consume(context);
 
+		Symbol parameter_name = get_token_symbol(context, parameter_name_token);
 
-
-		String parameter_name = get_token_string(context, parameter_name_token);
-
-		FunctionParameter parameter = { .name = parameter_name };
+		FunctionParameter parameter = { .name = parameter_name, .data_type = token_type_to_numeric(data_type_token.type) };
 		array_push(&context->program->function_parameters, parameter);
 
 		if (context_peek_type(context) == TokenType_Comma)
@@ -645,11 +828,11 @@ static b32 parse_function(ParseContext* context)
 	}
 	context_advance(context);
 
-	if (!context_expect(context, TokenType_I32))
+	if (!context_expect_datatype(context))
 	{
 		return false;
 	}
-	context_advance(context);
+	Token return_data_type_token = context_consume(context);
 
 	if (!context_expect(context, TokenType_CloseParenthesis))
 	{
@@ -657,6 +840,36 @@ static b32 parse_function(ParseContext* context)
 	}
 	context_advance(context);
 
+	InliningHint inlining = InliningHint_None;
+	while (context_peek_type(context) == TokenType_Hashtag)
+	{
+		context_advance(context);
+
+		if (!context_expect(context, TokenType_Identifier))
+		{
+			return false;
+		}
+		Token attribute_token = context_consume(context);
+
+		if (identifier_equals(context, attribute_token, "inline"))
+		{
+			inlining = InliningHint_Always;
+		}
+		else if (identifier_equals(context, attribute_token, "noinline"))
+		{
+			inlining = InliningHint_Never;
+		}
+		else
+		{
+			if (context_report_error(context))
+			{
+				fprintf(stderr, "LINE %d: Unknown function attribute. Expected '#inline' or '#noinline'.\n", program_get_line_number(context->program, attribute_token.source_location));
+				program_print_line_error(context->program, attribute_token.source_location);
+			}
+			return false;
+		}
+	}
+
 	if (!context_expect(context, TokenType_OpenBrace))
 	{
 		return false;
@@ -671,30 +884,34 @@ static b32 parse_function(ParseContext* context)
 	}
 
 	Function function = { 0 };
-	function.name = get_token_string(context, name_token);
+	function.name = get_token_symbol(context, name_token);
 	function.source_location = source_location;
 	function.calling_convention = CallingConvention_Windows_x64;
+	function.inlining = inlining;
 	function.body_first_statement = body_statement_index;
 	function.body_statement_count = body_statement_count;
+	function.return_data_type = token_type_to_numeric(return_data_type_token.type);
 	function.first_parameter = first_parameter;
 	function.parameter_count = parameter_count;
 
-	array_push(&context->program->functions, function);
+	chunked_array_push(&context->program->arena, &context->program->functions, function);
 
 	return true;
 }
 
-b32 parse(Program* program, TokenStream stream)
+static b32 parse_functions(ParseContext* context)
 {
-	ParseContext context = { program, stream, 0 };
+	Program* program = context->program;
+
+	program_index_lines(program);
 
 	push_expression(program, (Expression) { .type = ExpressionType_Error }); // Dummy.
 
 	b32 result = true;
 
-	while (context_peek_type(&context) != TokenType_EOF)
+	while (context_peek_type(context) != TokenType_EOF)
 	{
-		b32 success = parse_function(&context);
+		b32 success = parse_function(context);
 		result &= success;
 
 		if (!success)
@@ -706,3 +923,286 @@ b32 parse(Program* program, TokenStream stream)
 
 	return result;
 }
+
+
+// Parallel parsing. A top-level function only depends on its own tokens, so the token stream is cut before every 'fn'
+// outside of braces, and runs of consecutive functions are parsed on worker threads, each into a program of its own.
+// The nodes are then copied into the real program in source order with their handles rebased, which gives exactly the
+// nodes the serial parser would have produced. If any worker fails, the whole input goes through the serial parser
+// instead, so that diagnostics come out the same too.
+
+#define PARALLEL_PARSE_MINIMUM_TOKENS (64 * 1024)
+#define PARALLEL_PARSE_TASKS_PER_THREAD 8
+
+struct ParseTask
+{
+	i64 first_token;
+	i64 first_payload;
+	i64 end_token;
+
+	Program program; // Like the real program, expression 0 is a dummy, so that handle 0 keeps meaning "none".
+	b32 success;
+
+	// Position of this task's first expression (after the dummy), statement, function and parameter in the real program.
+	i64 expression_base;
+	i64 statement_base;
+	i64 function_base;
+	i64 parameter_base;
+};
+typedef struct ParseTask ParseTask;
+
+struct ParallelParse
+{
+	Program* program;
+	TokenStream tokens;
+	DynamicArray(ParseTask) tasks;
+};
+typedef struct ParallelParse ParallelParse;
+
+static void split_into_tasks(ParallelParse* parallel, i64 minimum_task_token_count)
+{
+	TokenStream* tokens = &parallel->tokens;
+	i64 eof_token = token_stream_count(tokens) - 1;
+	assert(token_stream_type(tokens, eof_token) == TokenType_EOF);
+
+	ParseTask task = { 0 };
+	i64 payload = 0;
+	i32 depth = 0;
+
+	for (i64 i = 0; i < eof_token; ++i)
+	{
+		TokenType type = token_stream_type(tokens, i);
+
+		if (type == TokenType_OpenBrace)
+		{
+			++depth;
+		}
+		else if (type == TokenType_CloseBrace)
+		{
+			--depth;
+		}
+		else if (type == TokenType_Function && depth == 0 && i - task.first_token >= minimum_task_token_count)
+		{
+			task.end_token = i;
+			array_push(&parallel->tasks, task);
+
+			task = (ParseTask){ .first_token = i, .first_payload = payload };
+		}
+
+		payload += token_has_payload(type);
+	}
+
+	task.end_token = eof_token;
+	array_push(&parallel->tasks, task);
+}
+
+static void parse_task(void* data, i64 task_index, i32 worker_index)
+{
+	ParallelParse* parallel = data;
+	ParseTask* task = &parallel->tasks.items[task_index];
+
+	task->program.source_code = parallel->program->source_code;
+	program_reserve_nodes(&task->program, task->end_token - task->first_token);
+
+	ParseContext context =
+	{
+		.program = &task->program,
+		.current_token = task->first_token,
+		.tokens = parallel->tokens,
+		.current_payload = task->first_payload,
+		.speculative = true,
+	};
+
+	push_expression(&task->program, (Expression) { .type = ExpressionType_Error }); // Dummy.
+
+	while (context.current_token < task->end_token)
+	{
+		if (!parse_function(&context))
+		{
+			return;
+		}
+	}
+
+	task->success = context.current_token == task->end_token && !context.error_reported;
+}
+
+static ExpressionHandle rebase_handle(ExpressionHandle handle, i64 expression_base)
+{
+	return handle ? (ExpressionHandle)(handle - 1 + expression_base) : 0;
+}
+
+static void rebase_expression(Expression* expression, i64 expression_base)
+{
+	expression->next = rebase_handle(expression->next, expression_base);
+
+	if (expression_is_binary_operation(expression->type))
+	{
+		expression->binary.lhs = rebase_handle(expression->binary.lhs, expression_base);
+		expression->binary.rhs = rebase_handle(expression->binary.rhs, expression_base);
+	}
+	else if (expression_is_unary_operation(expression->type))
+	{
+		expression->unary.rhs = rebase_handle(expression->unary.rhs, expression_base);
+	}
+	else if (expression->type == ExpressionType_Assignment)
+	{
+		expression->assignment.lhs = rebase_handle(expression->assignment.lhs, expression_base);
+		expression->assignment.rhs = rebase_handle(expression->assignment.rhs, expression_base);
+	}
+	else if (expression->type == ExpressionType_FunctionCall)
+	{
+		expression->function_call.first_argument = rebase_handle(expression->function_call.first_argument, expression_base);
+	}
+}
+
+static void rebase_statement(Statement* statement, i64 expression_base)
+{
+	switch (statement->type)
+	{
+		case StatementType_Simple:
+			statement->simple.expression = rebase_handle(statement->simple.expression, expression_base);
+			break;
+		case StatementType_Declaration:
+			statement->declaration.lhs = rebase_handle(statement->declaration.lhs, expression_base);
+			break;
+		case StatementType_DeclarationAssignment:
+			statement->declaration_assignment.lhs = rebase_handle(statement->declaration_assignment.lhs, expression_base);
+			statement->declaration_assignment.rhs = rebase_handle(statement->declaration_assignment.rhs, expression_base);
+			break;
+		case StatementType_Return:
+			statement->ret.rhs = rebase_handle(statement->ret.rhs, expression_base);
+			break;
+		case StatementType_Branch:
+			statement->branch.condition = rebase_handle(statement->branch.condition, expression_base);
+			break;
+		case StatementType_Loop:
+			statement->loop.condition = rebase_handle(statement->loop.condition, expression_base);
+			break;
+	}
+}
+
+static void merge_task(void* data, i64 task_index, i32 worker_index)
+{
+	ParallelParse* parallel = data;
+	ParseTask* task = &parallel->tasks.items[task_index];
+	Program* program = parallel->program;
+	Program* source = &task->program;
+
+	for (i64 i = 1; i < source->expressions.count; ++i)
+	{
+		Expression* expression = program_get_expression(program, (ExpressionHandle)(task->expression_base + i - 1));
+		*expression = *program_get_expression(source, (ExpressionHandle)i);
+		rebase_expression(expression, task->expression_base);
+	}
+
+	for (i64 i = 0; i < source->statements.count; ++i)
+	{
+		Statement* statement = program_get_statement(program, (i32)(task->statement_base + i));
+		*statement = *program_get_statement(source, (i32)i);
+		rebase_statement(statement, task->expression_base);
+	}
+
+	for (i64 i = 0; i < source->functions.count; ++i)
+	{
+		Function* function = program_get_function(program, task->function_base + i);
+		*function = *program_get_function(source, i);
+		function->body_first_statement += (i32)task->statement_base;
+		function->first_parameter += task->parameter_base;
+	}
+
+	memcpy(program->function_parameters.items + task->parameter_base, source->function_parameters.items, sizeof(FunctionParameter) * source->function_parameters.count);
+
+	free_program(source);
+}
+
+// Returns false without touching the program if the input is too small to be worth it or has errors.
+static b32 parse_parallel(Program* program, TokenStream stream, i32 thread_count)
+{
+	i64 token_count = token_stream_count(&stream);
+	if (thread_count <= 1 || token_count < PARALLEL_PARSE_MINIMUM_TOKENS)
+	{
+		return false;
+	}
+
+	ParallelParse parallel = { .program = program, .tokens = stream };
+	split_into_tasks(&parallel, token_count / (thread_count * PARALLEL_PARSE_TASKS_PER_THREAD));
+
+	parallel_for(parallel.tasks.count, thread_count, parse_task, &parallel);
+
+	b32 success = true;
+	i64 expression_count = 1;
+	i64 statement_count = 0;
+	i64 function_count = 0;
+	i64 parameter_count = 0;
+
+	for (i64 i = 0; i < parallel.tasks.count; ++i)
+	{
+		ParseTask* task = &parallel.tasks.items[i];
+		success &= task->success;
+
+		task->expression_base = expression_count;
+		task->statement_base = statement_count;
+		task->function_base = function_count;
+		task->parameter_base = parameter_count;
+
+		expression_count += task->program.expressions.count - 1;
+		statement_count += task->program.statements.count;
+		function_count += task->program.functions.count;
+		parameter_count += task->program.function_parameters.count;
+	}
+
+	if (success)
+	{
+		program_index_lines(program);
+
+		push_expression(program, (Expression) { .type = ExpressionType_Error }); // Dummy.
+
+		chunked_array_resize(&program->arena, &program->expressions, expression_count);
+		chunked_array_resize(&program->arena, &program->statements, statement_count);
+		chunked_array_resize(&program->arena, &program->functions, function_count);
+		array_reserve(&program->function_parameters, parameter_count);
+		program->function_parameters.count = parameter_count;
+
+		parallel_for(parallel.tasks.count, thread_count, merge_task, &parallel);
+	}
+	else
+	{
+		for (i64 i = 0; i < parallel.tasks.count; ++i)
+		{
+			free_program(&parallel.tasks.items[i].program);
+		}
+	}
+
+	array_free(&parallel.tasks);
+
+	return success;
+}
+
+b32 parse(Program* program, TokenStream stream, i32 thread_count)
+{
+	program_reserve_nodes(program, token_stream_count(&stream));
+
+	if (parse_parallel(program, stream, thread_count))
+	{
+		return true;
+	}
+
+	ParseContext context = { .program = program, .tokens = stream };
+	b32 result = parse_functions(&context);
+	program->reported_diagnostics |= context.error_reported;
+	return result;
+}
+
+b32 parse_streaming(Program* program, Lexer* lexer)
+{
+	// The token count is not known up front. Typical code averages a bit over four characters per token, and
+	// underestimating only costs an extra arena block.
+	program_reserve_nodes(program, program->source_code.len / 4);
+
+	TokenWindow window;
+
+	ParseContext context = { .program = program, .lexer = lexer, .window = &window };
+	b32 result = parse_functions(&context);
+	program->reported_diagnostics |= context.error_reported;
+	return result;
+}
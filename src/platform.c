@@ -1,3 +1,7 @@
+#if defined(__linux__)
+#define _GNU_SOURCE // madvise hints.
+#endif
+
 #include "platform.h"
 
 #if defined(_WIN32)
@@ -14,10 +18,103 @@ void create_directory(String path)
 	CreateDirectoryA(zero_terminated_path, 0);
 }
 
+static String map_file_view(const char* filename, b32 copy_on_write, b32 report_errors)
+{
+	String result = { 0 };
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		if (report_errors)
+		{
+			fprintf(stderr, "Could not open file '%s'.\n", filename);
+		}
+		return result;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return result;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, 0, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+	{
+		result.str = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+		if (result.str)
+		{
+			result.len = file_size.QuadPart;
+		}
+		CloseHandle(mapping); // The view keeps the mapping alive.
+	}
+	CloseHandle(file);
+
+	if (!result.str && report_errors)
+	{
+		fprintf(stderr, "Could not map file '%s'.\n", filename);
+	}
+
+	return result;
+}
+
+void unmap_file(String* file)
+{
+	if (file->str)
+	{
+		UnmapViewOfFile(file->str);
+	}
+	file->str = 0;
+	file->len = 0;
+}
+
+i32 get_processor_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (i32)info.dwNumberOfProcessors;
+}
+
+String map_executable()
+{
+	char path[MAX_PATH];
+	DWORD length = GetModuleFileNameA(0, path, sizeof(path));
+	if (length == 0 || length == sizeof(path))
+	{
+		return (String){ 0 };
+	}
+	return map_file_view(path, false, false);
+}
+
+typedef HANDLE Thread;
+
+static i64 atomic_fetch_increment(volatile i64* value)
+{
+	return InterlockedIncrement64(value) - 1;
+}
+
+static DWORD WINAPI thread_entry(void* parameter);
+
+static Thread start_thread(void* parameter)
+{
+	return CreateThread(0, 0, thread_entry, parameter, 0, 0);
+}
+
+static void join_thread(Thread thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
 #elif defined(__linux__)
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 void create_directory(String path)
 {
@@ -27,9 +124,173 @@ void create_directory(String path)
 	mkdir(zero_terminated_path, 0777);
 }
 
+static String map_file_view(const char* filename, b32 copy_on_write, b32 report_errors)
+{
+	String result = { 0 };
+
+	i32 fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		if (report_errors)
+		{
+			fprintf(stderr, "Could not open file '%s'.\n", filename);
+		}
+		return result;
+	}
+
+	struct stat file_info;
+	if (fstat(fd, &file_info) != 0 || file_info.st_size == 0)
+	{
+		close(fd);
+		return result;
+	}
+
+	void* mapping = mmap(0, file_info.st_size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps the file alive.
+
+	if (mapping == MAP_FAILED)
+	{
+		if (report_errors)
+		{
+			fprintf(stderr, "Could not map file '%s'.\n", filename);
+		}
+		return result;
+	}
+
+	// The lexer walks the file front to back exactly once.
+	madvise(mapping, file_info.st_size, MADV_SEQUENTIAL);
+	madvise(mapping, file_info.st_size, MADV_WILLNEED);
+
+	result.str = mapping;
+	result.len = file_info.st_size;
+	return result;
+}
+
+void unmap_file(String* file)
+{
+	if (file->str)
+	{
+		munmap(file->str, file->len);
+	}
+	file->str = 0;
+	file->len = 0;
+}
+
+i32 get_processor_count()
+{
+	return (i32)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+String map_executable()
+{
+	return map_file_view("/proc/self/exe", false, false);
+}
+
+typedef pthread_t Thread;
+
+static i64 atomic_fetch_increment(volatile i64* value)
+{
+	return __atomic_fetch_add(value, 1, __ATOMIC_RELAXED);
+}
+
+static void* thread_entry(void* parameter);
+
+static Thread start_thread(void* parameter)
+{
+	Thread thread;
+	pthread_create(&thread, 0, thread_entry, parameter);
+	return thread;
+}
+
+static void join_thread(Thread thread)
+{
+	pthread_join(thread, 0);
+}
+
 #endif
 
 
+String map_file(const char* filename)
+{
+	return map_file_view(filename, false, true);
+}
+
+String map_file_copy_on_write(const char* filename)
+{
+	return map_file_view(filename, true, false);
+}
+
+struct ParallelWork
+{
+	volatile i64 next_index;
+	i64 count;
+
+	ParallelTask* task;
+	void* data;
+};
+typedef struct ParallelWork ParallelWork;
+
+struct ParallelWorker
+{
+	ParallelWork* work;
+	i32 worker_index;
+};
+typedef struct ParallelWorker ParallelWorker;
+
+static void run_parallel_work(ParallelWorker* worker)
+{
+	ParallelWork* work = worker->work;
+	for (i64 index = atomic_fetch_increment(&work->next_index); index < work->count; index = atomic_fetch_increment(&work->next_index))
+	{
+		work->task(work->data, index, worker->worker_index);
+	}
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_entry(void* parameter)
+{
+	run_parallel_work(parameter);
+	return 0;
+}
+#elif defined(__linux__)
+static void* thread_entry(void* parameter)
+{
+	run_parallel_work(parameter);
+	return 0;
+}
+#endif
+
+void parallel_for(i64 count, i32 thread_count, ParallelTask* task, void* data)
+{
+	ParallelWork work = { .count = count, .task = task, .data = data };
+
+	i32 worker_count = (i32)max(min(thread_count, count), 1);
+	ParallelWorker* workers = malloc(sizeof(ParallelWorker) * worker_count);
+	Thread* helpers = malloc(sizeof(Thread) * worker_count);
+
+	for (i32 i = 0; i < worker_count; ++i)
+	{
+		workers[i] = (ParallelWorker){ .work = &work, .worker_index = i };
+	}
+
+	// Worker 0 is the calling thread.
+	for (i32 i = 1; i < worker_count; ++i)
+	{
+		helpers[i] = start_thread(&workers[i]);
+	}
+
+	run_parallel_work(&workers[0]);
+
+	for (i32 i = 1; i < worker_count; ++i)
+	{
+		join_thread(helpers[i]);
+	}
+
+	free(helpers);
+	free(workers);
+}
+
+
 
 
 String read_file(const char* filename)
@@ -62,6 +323,20 @@ String read_file(const char* filename)
 	return source_code;
 }
 
+b32 write_binary_file(const char* filename, String s)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Could not open file '%s'.\n", filename);
+		return false;
+	}
+
+	b32 result = fwrite(s.str, 1, s.len, f) == (u64)s.len;
+	result &= fclose(f) == 0;
+	return result;
+}
+
 void write_file(const char* filename, String s)
 {
 	FILE* f = fopen(filename, "w");
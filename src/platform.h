@@ -6,7 +6,31 @@ void create_directory(String path);
 
 
 String read_file(const char* filename);
+
+// Maps the file read-only. The result is not zero-terminated and must be released with unmap_file.
+String map_file(const char* filename);
+void unmap_file(String* file);
+
+// Maps the file so that its pages can be modified in memory without affecting the file. Returns an empty string without
+// printing anything if the file cannot be opened. Release with unmap_file.
+String map_file_copy_on_write(const char* filename);
+
+// Maps the running compiler's own executable read-only. Returns an empty string if it cannot be opened. Release with
+// unmap_file.
+String map_executable();
+
 void write_file(const char* filename, String s);
+b32 write_binary_file(const char* filename, String s);
+
+i32 get_processor_count();
+
+// Calls task(data, index, worker_index) for every index in [0, count), spread over up to thread_count threads including
+// the calling one. Indices are handed out in increasing order but may complete in any order. worker_index is in
+// [0, thread_count) and identifies the calling thread, so tasks can keep per-thread scratch state. Returns once all
+// tasks have completed.
+typedef void ParallelTask(void* data, i64 index, i32 worker_index);
+void parallel_for(i64 count, i32 thread_count, ParallelTask* task, void* data);
+
 String path_get_parent(String path);
 String path_get_filename(String path);
 String path_get_stem(String path);
@@ -4,22 +4,80 @@
 #include <ctype.h>
 
 
-String program_get_line(Program* program, i32 character_index)
+void program_reserve_nodes(Program* program, i64 token_count)
 {
-	i64 left = character_index;
-	while (left > 0 && program->source_code.str[left - 1] != '\n')
+	// Every expression consumes at least one token (plus the dummy at handle 0), every statement at least two and
+	// every function at least ten.
+	i64 expression_count = token_count + 1;
+	i64 statement_count = token_count / 2;
+	i64 function_count = token_count / 10;
+
+	arena_reserve(&program->arena,
+		chunked_array_bytes(&program->expressions, expression_count) +
+		chunked_array_bytes(&program->statements, statement_count) +
+		chunked_array_bytes(&program->functions, function_count));
+
+	array_reserve(&program->expressions.chunks, chunked_array_chunk_count(expression_count));
+	array_reserve(&program->statements.chunks, chunked_array_chunk_count(statement_count));
+	array_reserve(&program->functions.chunks, chunked_array_chunk_count(function_count));
+}
+
+void program_index_lines(Program* program)
+{
+	String source_code = program->source_code;
+
+	program->line_starts.count = 0;
+	array_push(&program->line_starts, 0);
+
+	for (char* c = memchr(source_code.str, '\n', source_code.len); c; )
 	{
-		--left;
+		i64 line_start = (c - source_code.str) + 1;
+		array_push(&program->line_starts, line_start);
+		c = memchr(c + 1, '\n', source_code.len - line_start);
 	}
-	while (isspace(program->source_code.str[left]))
+}
+
+static i64 find_line_index(Program* program, i64 character_index)
+{
+	assert(program->line_starts.count > 0);
+
+	// Last line starting at or before the character.
+	i64 low = 0;
+	i64 high = program->line_starts.count - 1;
+	while (low < high)
 	{
-		++left;
+		i64 middle = low + (high - low + 1) / 2;
+		if (program->line_starts.items[middle] <= character_index)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
 	}
+	return low;
+}
+
+i32 program_get_line_number(Program* program, SourceLocation source_location)
+{
+	return (i32)find_line_index(program, source_location.global_character_index) + 1;
+}
 
-	i64 right = character_index;
-	while (right < program->source_code.len && program->source_code.str[right + 1] != '\n')
+String program_get_line(Program* program, i64 character_index)
+{
+	i64 line_index = find_line_index(program, character_index);
+
+	i64 left = program->line_starts.items[line_index];
+	i64 right = (line_index + 1 < program->line_starts.count) ? program->line_starts.items[line_index + 1] - 1 : program->source_code.len;
+
+	while (left < character_index && isspace(program->source_code.str[left]))
 	{
-		++right;
+		++left;
+	}
+	while (right > left && isspace(program->source_code.str[right - 1]))
+	{
+		--right;
 	}
 
 	String result = { .str = program->source_code.str + left, .len = right - left };
@@ -122,7 +180,9 @@ static void print_expression(Program* program, ExpressionHandle expression_handl
 	{
 		IdentifierExpression e = expression->identifier;
 
-		printf("%.*s\n", (i32)e.name.len, e.name.str);
+		String name = program_get_name(program, e.name);
+
+		printf("%.*s\n", (i32)name.len, name.str);
 	}
 	else if (expression_is_binary_operation(expression->type))
 	{
@@ -150,7 +210,7 @@ static void print_expression(Program* program, ExpressionHandle expression_handl
 		Expression* lhs = program_get_expression(program, e.lhs);
 		assert(lhs->type == ExpressionType_Identifier); // Temporary.
 
-		String identifier = lhs->identifier.name;
+		String identifier = program_get_name(program, lhs->identifier.name);
 
 		printf("Variable assignment %.*s\n", (i32)identifier.len, identifier.str);
 		print_expression(program, e.rhs, indent + 1, active_mask);
@@ -159,7 +219,9 @@ static void print_expression(Program* program, ExpressionHandle expression_handl
 	{
 		FunctionCallExpression e = expression->function_call;
 
-		printf("Function call %.*s\n", (i32)e.function_name.len, e.function_name.str);
+		String function_name = program_get_name(program, e.function_name);
+
+		printf("Function call %.*s\n", (i32)function_name.len, function_name.str);
 
 		set_bit(active_mask, indent + 1);
 		ExpressionHandle current = e.first_argument;
@@ -205,7 +267,7 @@ static void print_statements(Program* program, i32 first_statement, i32 statemen
 			Expression* lhs = program_get_expression(program, e.lhs);
 			assert(lhs->type == ExpressionType_Identifier); // Temporary.
 
-			String identifier = lhs->identifier.name;
+			String identifier = program_get_name(program, lhs->identifier.name);
 
 			printf("Variable declaration %.*s\n", (i32)identifier.len, identifier.str);
 		}
@@ -216,7 +278,7 @@ static void print_statements(Program* program, i32 first_statement, i32 statemen
 			Expression* lhs = program_get_expression(program, e.lhs);
 			assert(lhs->type == ExpressionType_Identifier); // Temporary.
 
-			String identifier = lhs->identifier.name;
+			String identifier = program_get_name(program, lhs->identifier.name);
 
 			printf("Variable declaration & assignment %.*s\n", (i32)identifier.len, identifier.str);
 			print_expression(program, e.rhs, indent + 1, active_mask);
@@ -271,7 +333,10 @@ static void print_statements(Program* program, i32 first_statement, i32 statemen
 
 static void print_function(Program* program, Function function)
 {
-	printf("FUNCTION %.*s\n", (i32)function.name.len, function.name.str);
+	String name = program_get_name(program, function.name);
+
+	const char* attributes[] = { [InliningHint_None] = "", [InliningHint_Always] = " #inline", [InliningHint_Never] = " #noinline" };
+	printf("FUNCTION %.*s%s\n", (i32)name.len, name.str, attributes[function.inlining]);
 
 	i32 active_mask = 0;
 	print_statements(program, function.body_first_statement, function.body_statement_count, 0, &active_mask);
@@ -282,17 +347,26 @@ void program_print_ast(Program* program)
 {
 	for (i64 i = 0; i < program->functions.count; ++i)
 	{
-		print_function(program, program->functions.items[i]);
+		print_function(program, *program_get_function(program, i));
 	}
 }
 
 void free_program(Program* program)
 {
-	array_free(&program->functions);
+	array_free(&program->functions.chunks);
+	array_free(&program->statements.chunks);
+	array_free(&program->expressions.chunks);
 	array_free(&program->function_parameters);
-	array_free(&program->statements);
-	array_free(&program->expressions);
+	arena_free(&program->arena);
+
+	program->functions.count = 0;
+	program->statements.count = 0;
+	program->expressions.count = 0;
+	array_free(&program->line_starts);
+
+	free_symbol_table(&program->symbols);
 
-	string_free(&program->source_code);
+	// The source code is owned by whoever loaded it.
+	program->source_code = (String){ 0 };
 }
 
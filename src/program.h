@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "arena.h"
 #include "token.h"
 
 
@@ -82,8 +83,8 @@ static b32 expression_is_comparison_operation(ExpressionType type)
 
 struct IdentifierExpression
 {
-	String name;
-	i32 offset_from_frame_pointer; // Temporary: This will eventually move into the intermediate representation.
+	Symbol name;
+	i32 variable_index; // Within the function: Parameters first, then locals in order of declaration. Set by the analyzer.
 };
 typedef struct IdentifierExpression IdentifierExpression;
 
@@ -109,7 +110,7 @@ typedef struct AssignmentExpression AssignmentExpression;
 
 struct FunctionCallExpression
 {
-	String function_name;
+	Symbol function_name;
 	ExpressionHandle first_argument;
 	i32 function_index;
 };
@@ -120,6 +121,7 @@ struct Expression
 	ExpressionType type;
 	SourceLocation source_location;
 	ExpressionHandle next;
+	NumericDatatype result_data_type; // Set by the analyzer.
 
 	union
 	{
@@ -217,16 +219,26 @@ enum CallingConvention
 };
 typedef enum CallingConvention CallingConvention;
 
+// Set with #inline or #noinline after the return type.
+enum InliningHint
+{
+	InliningHint_None, // The optimizer decides.
+	InliningHint_Always,
+	InliningHint_Never,
+};
+typedef enum InliningHint InliningHint;
+
 struct FunctionParameter
 {
-	String name;
+	Symbol name;
+	NumericDatatype data_type;
 };
 typedef struct FunctionParameter FunctionParameter;
 
 struct LocalVariable
 {
-	String name;
-	i32 offset_from_frame_pointer;
+	Symbol name;
+	i32 variable_index;
 	NumericDatatype data_type; // TODO: Generalize.
 	SourceLocation source_location;
 };
@@ -234,20 +246,22 @@ typedef struct LocalVariable LocalVariable;
 
 struct Function
 {
-	String name;
+	Symbol name;
 	SourceLocation source_location;
 
 	CallingConvention calling_convention;
+	InliningHint inlining;
 
 	i32 body_first_statement;
 	i32 body_statement_count;
+	NumericDatatype return_data_type;
 
 
 
 	i64 first_parameter;
 	i64 parameter_count;
 
-	i64 stack_size;
+	i32 variable_count; // Parameters and locals. Set by the analyzer.
 };
 typedef struct Function Function;
 
@@ -255,35 +269,64 @@ typedef struct Function Function;
 struct Program
 {
 	String source_code;
+	SymbolTable symbols;
+	DynamicArray(i64) line_starts; // Offset of the first character of each line. See program_index_lines.
+
+	Arena arena; // Backs the chunks of functions, statements and expressions. Released in free_program.
 
-	DynamicArray(Function) functions;
+	ChunkedArray(Function) functions;
 	DynamicArray(FunctionParameter) function_parameters;
-	DynamicArray(Statement) statements;
-	DynamicArray(Expression) expressions;
+	ChunkedArray(Statement) statements;
+	ChunkedArray(Expression) expressions;
+
+	b32 reported_diagnostics; // Set by any phase that printed a diagnostic, even one it recovered from.
 };
 typedef struct Program Program;
 
 
 static Expression* program_get_expression(Program* program, ExpressionHandle expression_handle)
 {
-	return &program->expressions.items[expression_handle];
+	return chunked_array_get(&program->expressions, expression_handle);
 }
 
 static Statement* program_get_statement(Program* program, i32 statement_index)
 {
-	return &program->statements.items[statement_index];
+	return chunked_array_get(&program->statements, statement_index);
+}
+
+static Function* program_get_function(Program* program, i64 function_index)
+{
+	return chunked_array_get(&program->functions, function_index);
+}
+
+static String program_get_name(Program* program, Symbol symbol)
+{
+	return symbol_get_name(&program->symbols, symbol);
 }
 
-b32 parse(Program* program, TokenStream stream);
-b32 analyze(Program* program);
-String generate(Program program);
+b32 parse(Program* program, TokenStream stream, i32 thread_count); // Output does not depend on thread_count.
+b32 parse_streaming(Program* program, Lexer* lexer); // Pulls tokens on demand, so token memory stays bounded.
+b32 analyze(Program* program, i32 thread_count); // Diagnostics and output do not depend on thread_count.
 
 void program_print_ast(Program* program);
 
-String program_get_line(Program* program, i32 character_index);
+// Sizes the node arena for a source of about token_count tokens, so parsing does not have to allocate.
+void program_reserve_nodes(Program* program, i64 token_count);
+
+void program_index_lines(Program* program);
+i32 program_get_line_number(Program* program, SourceLocation source_location);
+
+String program_get_line(Program* program, i64 character_index);
 i32 program_get_column(Program* program, SourceLocation source_location, String line);
 
 void program_print_line(Program* program, SourceLocation source_location, const FILE* stream);
 void program_print_line_error(Program* program, SourceLocation source_location);
 
 void free_program(Program* program);
+
+// Binary cache of an analyzed program, keyed by a hash of the source and the compiler version. After a successful load,
+// the nodes live inside cache_file, which must stay mapped until the program is freed. Symbols can be looked up by
+// name, but no new ones can be interned, and line numbers are not available.
+u64 hash_source(String source_code);
+b32 program_save_cache(Program* program, const char* path, u64 source_hash);
+b32 program_load_cache(Program* program, const char* path, u64 source_hash, String* cache_file);
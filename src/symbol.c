@@ -0,0 +1,81 @@
+#include "symbol.h"
+
+
+static u32 hash_name(String name)
+{
+	// FNV-1a.
+	u32 hash = 2166136261u;
+	for (i64 i = 0; i < name.len; ++i)
+	{
+		hash ^= (u8)name.str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void insert_slot(SymbolTable* table, u32 hash, Symbol symbol)
+{
+	i64 mask = table->slot_count - 1;
+	for (i64 slot = hash & mask; ; slot = (slot + 1) & mask)
+	{
+		if (!table->slots[slot])
+		{
+			table->slots[slot] = symbol + 1;
+			return;
+		}
+	}
+}
+
+static void grow_slots(SymbolTable* table)
+{
+	free(table->slots);
+
+	table->slot_count = max(table->slot_count * 2, 256);
+	table->slots = calloc(table->slot_count, sizeof(Symbol));
+
+	for (i64 i = 0; i < table->names.count; ++i)
+	{
+		insert_slot(table, table->hashes.items[i], (Symbol)i);
+	}
+}
+
+Symbol symbol_intern(SymbolTable* table, String name)
+{
+	// Keep the load factor below 1/2.
+	if ((table->names.count + 1) * 2 > table->slot_count)
+	{
+		grow_slots(table);
+	}
+
+	u32 hash = hash_name(name);
+
+	i64 mask = table->slot_count - 1;
+	for (i64 slot = hash & mask; ; slot = (slot + 1) & mask)
+	{
+		Symbol entry = table->slots[slot];
+		if (!entry)
+		{
+			Symbol symbol = (Symbol)table->names.count;
+			array_push(&table->names, name);
+			array_push(&table->hashes, hash);
+			table->slots[slot] = symbol + 1;
+			return symbol;
+		}
+
+		Symbol symbol = entry - 1;
+		if (table->hashes.items[symbol] == hash && string_equal(table->names.items[symbol], name))
+		{
+			return symbol;
+		}
+	}
+}
+
+void free_symbol_table(SymbolTable* table)
+{
+	array_free(&table->names);
+	array_free(&table->hashes);
+
+	free(table->slots);
+	table->slots = 0;
+	table->slot_count = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.h"
+
+
+// Identifiers are interned during lexing. Every distinct name gets a 32-bit id, so later phases can compare names as
+// integers and only go back to the string for printing.
+typedef u32 Symbol;
+
+struct SymbolTable
+{
+	DynamicArray(String) names; // Indexed by symbol.
+	DynamicArray(u32) hashes; // Indexed by symbol.
+
+	Symbol* slots; // Open addressing, stores symbol + 1 (0 means empty).
+	i64 slot_count;
+};
+typedef struct SymbolTable SymbolTable;
+
+Symbol symbol_intern(SymbolTable* table, String name);
+void free_symbol_table(SymbolTable* table);
+
+static String symbol_get_name(SymbolTable* table, Symbol symbol)
+{
+	return table->names.items[symbol];
+}
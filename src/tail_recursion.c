@@ -0,0 +1,310 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+// A return of a call to the function itself, either directly or combined with one other value by an operation that can
+// be regrouped: return f(...), or return x op f(...).
+struct RecursionSite
+{
+	i32 block;
+	IrValue call;
+	IrValue accumulation; // The op instruction, or IR_NO_VALUE for a plain tail call.
+};
+typedef struct RecursionSite RecursionSite;
+
+
+// Associative and commutative on integers, since they wrap around. Not on floats.
+static b32 can_accumulate(IrInstruction* instruction)
+{
+	switch (instruction->opcode)
+	{
+		case IrOpcode_BitwiseOr:
+		case IrOpcode_BitwiseXor:
+		case IrOpcode_BitwiseAnd:
+		case IrOpcode_Addition:
+		case IrOpcode_Multiplication:
+			return instruction->data_type != NumericDatatype_F32;
+	}
+	return false;
+}
+
+static u32 get_identity(IrOpcode opcode)
+{
+	switch (opcode)
+	{
+		case IrOpcode_Multiplication:	return 1;
+		case IrOpcode_BitwiseAnd:		return 0xFFFFFFFF;
+	}
+	return 0;
+}
+
+static b32 is_self_call(IrFunction* function, IrValue value, i32 block)
+{
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	return instruction->opcode == IrOpcode_Call && instruction->call.function_index == function->function_index && instruction->block == block;
+}
+
+// The call is what the block returns, and nothing after it has side effects, so skipping the rest of the block and
+// going around again does what returning the call's result would have.
+static b32 find_site(IrProgram* ir, IrFunction* function, i32* use_counts, i32 block, RecursionSite* site)
+{
+	IrInstruction* terminator = ir_get_terminator(function, block);
+	if (!terminator || terminator->opcode != IrOpcode_Return)
+	{
+		return false;
+	}
+
+	IrValue value = terminator->ret.value;
+	IrInstruction* instruction = ir_get_instruction(function, value);
+	*site = (RecursionSite){ .block = block, .call = value, .accumulation = IR_NO_VALUE };
+
+	if (!is_self_call(function, value, block))
+	{
+		if (!can_accumulate(instruction) || instruction->block != block || use_counts[value] != 1)
+		{
+			return false;
+		}
+
+		IrValue lhs = instruction->binary.lhs;
+		IrValue rhs = instruction->binary.rhs;
+		if (is_self_call(function, rhs, block) && use_counts[rhs] == 1)
+		{
+			site->call = rhs;
+		}
+		else if (is_self_call(function, lhs, block) && use_counts[lhs] == 1)
+		{
+			site->call = lhs;
+		}
+		else
+		{
+			return false;
+		}
+		site->accumulation = value;
+	}
+
+	IrBlock* b = ir_get_block(function, block);
+	i64 index = b->instructions.count - 2;
+	while (b->instructions.items[index] != site->call)
+	{
+		if (has_side_effects(ir, function, ir_get_instruction(function, b->instructions.items[index])))
+		{
+			return false;
+		}
+		--index;
+	}
+	return true;
+}
+
+b32 eliminate_tail_recursion(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics)
+{
+	i32* use_counts = malloc(sizeof(i32) * function->instructions.count);
+	ir_count_uses(function, use_counts);
+
+	// Only sites that combine with the same operation as the first one share the accumulator. The others stay calls.
+	DynamicArray(RecursionSite) sites = { 0 };
+	IrOpcode accumulation_opcode = IrOpcode_Removed;
+	NumericDatatype accumulation_type = 0;
+	for (i32 block = 0; block < function->blocks.count; ++block)
+	{
+		RecursionSite site;
+		if (!find_site(ir, function, use_counts, block, &site))
+		{
+			continue;
+		}
+
+		if (site.accumulation != IR_NO_VALUE)
+		{
+			IrInstruction* accumulation = ir_get_instruction(function, site.accumulation);
+			if (accumulation_opcode == IrOpcode_Removed)
+			{
+				accumulation_opcode = accumulation->opcode;
+				accumulation_type = accumulation->data_type;
+			}
+			else if (accumulation->opcode != accumulation_opcode)
+			{
+				continue;
+			}
+		}
+		array_push(&sites, site);
+	}
+
+	free(use_counts);
+
+	if (sites.count == 0)
+	{
+		array_free(&sites);
+		return false;
+	}
+
+	// The entry keeps the parameters and jumps to a new loop header with the rest of it. The header has a phi per
+	// parameter, and one for the accumulator, which starts out as the identity of the operation.
+	i32 header = (i32)function->blocks.count;
+	array_push(&function->blocks, (IrBlock){ 0 });
+
+	IrBlock* entry = ir_get_block(function, 0);
+	IrBlock* h = ir_get_block(function, header);
+	i64 parameter_count = 0;
+	for (i64 i = 0; i < entry->instructions.count; ++i)
+	{
+		IrValue value = entry->instructions.items[i];
+		IrInstruction* instruction = ir_get_instruction(function, value);
+		if (instruction->opcode == IrOpcode_Parameter)
+		{
+			entry->instructions.items[parameter_count++] = value;
+		}
+		else
+		{
+			instruction->block = header;
+			array_push(&h->instructions, value);
+		}
+	}
+	entry->instructions.count = parameter_count;
+
+	for (i64 i = 0; i < sites.count; ++i)
+	{
+		sites.items[i].block = (sites.items[i].block == 0) ? header : sites.items[i].block;
+	}
+
+	i32 successors[2];
+	i32 successor_count = ir_get_successors(function, header, successors);
+	for (i32 i = 0; i < successor_count; ++i)
+	{
+		IrBlock* successor = ir_get_block(function, successors[i]);
+		for (i64 j = 0; j < successor->predecessors.count; ++j)
+		{
+			if (successor->predecessors.items[j] == 0)
+			{
+				successor->predecessors.items[j] = header;
+			}
+		}
+	}
+
+	IrValue identity = IR_NO_VALUE;
+	if (accumulation_opcode != IrOpcode_Removed)
+	{
+		IrInstruction constant = { .opcode = IrOpcode_Constant, .data_type = accumulation_type, .constant = { .type = accumulation_type, .data_u32 = get_identity(accumulation_opcode) } };
+		identity = ir_insert_instruction(function, 0, -1, constant);
+	}
+	ir_insert_instruction(function, 0, -1, (IrInstruction){ .opcode = IrOpcode_Jump, .jump = { .target = header } });
+
+	h = ir_get_block(function, header);
+	array_push(&h->predecessors, 0);
+	for (i64 i = 0; i < sites.count; ++i)
+	{
+		array_push(&h->predecessors, sites.items[i].block);
+	}
+	i32 operand_count = (i32)h->predecessors.count;
+
+	// Parameters are replaced everywhere by their phi, including in the arguments of the calls, which become the phi
+	// operands. Only the operand coming from the entry still refers to the parameter.
+	IrValue* parameters = malloc(sizeof(IrValue) * (parameter_count + 1));
+	IrValue* phis = malloc(sizeof(IrValue) * (parameter_count + 1));
+	for (i64 i = 0; i < parameter_count; ++i)
+	{
+		parameters[i] = ir_get_block(function, 0)->instructions.items[i];
+		IrInstruction* parameter = ir_get_instruction(function, parameters[i]);
+
+		IrInstruction phi = { .opcode = IrOpcode_Phi, .data_type = parameter->data_type, .phi = { .first_operand = (i32)function->operands.count, .operand_count = operand_count } };
+		array_push(&function->operands, parameters[i]);
+		for (i64 j = 0; j < sites.count; ++j)
+		{
+			IrInstruction* call = ir_get_instruction(function, sites.items[j].call);
+			IrValue argument = function->operands.items[call->call.first_operand + parameter->parameter_index];
+			array_push(&function->operands, argument);
+		}
+		phis[i] = ir_insert_instruction(function, header, i, phi);
+	}
+
+	IrValue accumulator = IR_NO_VALUE;
+	if (identity != IR_NO_VALUE)
+	{
+		IrInstruction phi = { .opcode = IrOpcode_Phi, .data_type = accumulation_type, .phi = { .first_operand = (i32)function->operands.count, .operand_count = operand_count } };
+		array_push(&function->operands, identity);
+		for (i64 j = 0; j < sites.count; ++j)
+		{
+			// Plain tail calls pass the accumulator on as it is.
+			array_push(&function->operands, sites.items[j].accumulation);
+		}
+		accumulator = ir_insert_instruction(function, header, parameter_count, phi);
+		for (i64 j = 0; j < sites.count; ++j)
+		{
+			IrValue* operand = &function->operands.items[ir_get_instruction(function, accumulator)->phi.first_operand + 1 + j];
+			*operand = (*operand == IR_NO_VALUE) ? accumulator : *operand;
+		}
+	}
+
+	for (i64 i = 0; i < function->instructions.count; ++i)
+	{
+		i32 count;
+		IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &count);
+		for (i32 j = 0; j < count; ++j)
+		{
+			for (i64 k = 0; k < parameter_count; ++k)
+			{
+				operands[j] = (operands[j] == parameters[k]) ? phis[k] : operands[j];
+			}
+		}
+	}
+	for (i64 i = 0; i < parameter_count; ++i)
+	{
+		function->operands.items[ir_get_instruction(function, phis[i])->phi.first_operand] = parameters[i];
+	}
+
+	// At each site, the operation now combines the accumulator instead of the call's result, and the return goes back to
+	// the header. Every other return combines the accumulator with what it returned.
+	b32* is_site = calloc(function->blocks.count, sizeof(b32));
+	for (i64 i = 0; i < sites.count; ++i)
+	{
+		RecursionSite site = sites.items[i];
+		is_site[site.block] = true;
+
+		if (site.accumulation != IR_NO_VALUE)
+		{
+			IrInstruction* accumulation = ir_get_instruction(function, site.accumulation);
+			if (accumulation->binary.lhs == site.call)
+			{
+				accumulation->binary.lhs = accumulator;
+			}
+			else
+			{
+				accumulation->binary.rhs = accumulator;
+			}
+		}
+
+		ir_remove_instruction(function, site.call);
+		*ir_get_terminator(function, site.block) = (IrInstruction){ .opcode = IrOpcode_Jump, .block = site.block, .jump = { .target = header } };
+	}
+
+	for (i32 block = 0; block < function->blocks.count && accumulator != IR_NO_VALUE; ++block)
+	{
+		IrInstruction* terminator = ir_get_terminator(function, block);
+		if (is_site[block] || terminator->opcode != IrOpcode_Return)
+		{
+			continue;
+		}
+
+		// A base case that returns the identity returns the accumulator as it is.
+		IrInstruction* returned = ir_get_instruction(function, terminator->ret.value);
+		if (returned->opcode == IrOpcode_Constant && returned->constant.data_u32 == get_identity(accumulation_opcode))
+		{
+			terminator->ret.value = accumulator;
+			continue;
+		}
+
+		IrInstruction combine = { .opcode = accumulation_opcode, .data_type = accumulation_type, .binary = { .lhs = accumulator, .rhs = terminator->ret.value } };
+		IrValue value = ir_insert_instruction(function, block, ir_get_block(function, block)->instructions.count - 1, combine);
+		ir_get_terminator(function, block)->ret.value = value;
+	}
+
+	ir_compact_blocks(function);
+
+	statistics->eliminated_recursive_calls += sites.count;
+
+	free(is_site);
+	free(phis);
+	free(parameters);
+	array_free(&sites);
+
+	return true;
+}
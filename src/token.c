@@ -62,6 +62,9 @@ static const char* token_strings[TokenType_Count] =
 	[TokenType_GreaterGreater]		= ">>",
 	[TokenType_GreaterGreaterEqual] = ">>=",
 	[TokenType_Arrow]				= "->",
+	[TokenType_Identifier]			= "identifier",
+	[TokenType_NumericLiteral]		= "numeric literal",
+	[TokenType_StringLiteral]		= "string literal",
 };
 
 const char* token_type_to_string(TokenType type)
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "datatype.h"
+#include "symbol.h"
 
 
 enum TokenType
@@ -131,6 +132,11 @@ static b32 token_is_unary_operator(TokenType type)
 	return (type == TokenType_Minus) || (type == TokenType_Tilde) || (type == TokenType_Exclamation);
 }
 
+static b32 token_has_payload(TokenType type)
+{
+	return (type == TokenType_Identifier) || (type == TokenType_NumericLiteral) || (type == TokenType_StringLiteral);
+}
+
 const char* token_type_to_string(TokenType type);
 NumericDatatype token_type_to_numeric(TokenType type);
 
@@ -142,15 +148,69 @@ struct Token
 };
 typedef struct Token Token;
 
+#define TOKEN_OFFSET_CHUNK_SIZE 256
+
+// The materialized token stream is stored as parallel arrays, so that scanning token types (which is most of what the
+// parser does) touches one byte per token. A token's data_index is not stored per token: Only tokens with a payload
+// (see token_has_payload) get an entry in payloads, in token order, so readers walking the stream keep a cursor into it.
+// Tokens only know their offset into the source; line numbers are looked up when needed (see program_get_line_number).
 struct TokenStream
 {
-	DynamicArray(Token) tokens;
-	DynamicArray(String) strings;
+	DynamicArray(u8) types;
+	DynamicArray(u32) offsets; // Relative to offset_bases[token_index / TOKEN_OFFSET_CHUNK_SIZE].
+	DynamicArray(i64) offset_bases;
+	DynamicArray(i32) payloads; // Symbol for identifiers, otherwise index into strings or numeric_literals.
+
+	DynamicArray(String) strings; // String literals.
 	DynamicArray(NumericLiteral) numeric_literals;
+
+	SymbolTable* symbols; // Identifiers. Owned by the caller of tokenize.
 };
 typedef struct TokenStream TokenStream;
 
-TokenStream tokenize(String source_code);
+static i64 token_stream_count(TokenStream* stream)
+{
+	return stream->types.count;
+}
+
+static TokenType token_stream_type(TokenStream* stream, i64 token_index)
+{
+	return (TokenType)stream->types.items[token_index];
+}
+
+static i64 token_stream_offset(TokenStream* stream, i64 token_index)
+{
+	return stream->offset_bases.items[token_index / TOKEN_OFFSET_CHUNK_SIZE] + stream->offsets.items[token_index];
+}
+
+// Data attached to a single token. Literal tokens carry their value here until it is stored somewhere more permanent.
+struct TokenPayload
+{
+	NumericLiteral numeric_literal;
+	String string_literal;
+};
+typedef struct TokenPayload TokenPayload;
+
+struct Lexer
+{
+	String source_code;
+	i64 current_index;
+
+	SymbolTable* symbols;
+};
+typedef struct Lexer Lexer;
+
+// Pull interface: Returns one token per call, and TokenType_EOF forever once the source is exhausted.
+Lexer lexer_begin(String source_code, SymbolTable* symbols);
+Token lexer_next_token(Lexer* lexer, TokenPayload* payload);
+
+// Converts the literal starting at index and returns the index one past its end. If the value does not fit into
+// target_type, result->type is NumericDatatype_Unknown. A literal with a separator that is not between two digits is
+// malformed, and both are NumericDatatype_Unknown.
+i64 parse_numeric_literal(String source_code, i64 index, NumericLiteral* result, NumericDatatype* target_type);
+
+// Lexes the whole source up front.
+TokenStream tokenize(String source_code, SymbolTable* symbols);
 void free_token_stream(TokenStream* tokens);
 void print_tokens(TokenStream* tokens);
 
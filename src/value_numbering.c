@@ -0,0 +1,271 @@
+#include "optimizer.h"
+
+#include <assert.h>
+
+
+// Values seen on the way from the entry down the dominator tree to the current block, in an open addressing hash table
+// keyed by what the instructions compute. Entries are removed in the reverse order they were added when the walk leaves
+// a subtree, so probe sequences of the remaining entries never run through a slot that was emptied.
+struct NumberingContext
+{
+	IrProgram* ir;
+	IrFunction* function;
+
+	IrValue* table; // IR_NO_VALUE where empty.
+	u64 slot_count;
+	DynamicArray(u64) added_slots;
+
+	IrValue* replacement; // Per value: The equivalent value it was replaced with, or IR_NO_VALUE.
+	i64 replaced_count;
+};
+typedef struct NumberingContext NumberingContext;
+
+
+static b32 is_commutative(IrOpcode opcode)
+{
+	switch (opcode)
+	{
+		case IrOpcode_BitwiseOr:
+		case IrOpcode_BitwiseXor:
+		case IrOpcode_BitwiseAnd:
+		case IrOpcode_Equal:
+		case IrOpcode_NotEqual:
+		case IrOpcode_Addition:
+		case IrOpcode_Multiplication:
+			return true;
+	}
+	return false;
+}
+
+static b32 can_number(NumberingContext* context, IrInstruction* instruction)
+{
+	IrOpcode opcode = instruction->opcode;
+	if (opcode == IrOpcode_Call)
+	{
+		return context->ir->functions[instruction->call.function_index].is_pure;
+	}
+	return (opcode == IrOpcode_Constant) || (opcode == IrOpcode_Undefined) || (opcode == IrOpcode_Phi) || (opcode == IrOpcode_Convert)
+		|| ir_is_binary_operation(opcode) || ir_is_unary_operation(opcode);
+}
+
+// Operands in the order they are compared in. Commutative operations are compared with the smaller value first.
+static IrValue* get_key_operands(IrFunction* function, IrInstruction* instruction, IrValue swapped[2], i32* operand_count)
+{
+	IrValue* operands = ir_get_operands(function, instruction, operand_count);
+	if (is_commutative(instruction->opcode) && operands[0] > operands[1])
+	{
+		swapped[0] = operands[1];
+		swapped[1] = operands[0];
+		return swapped;
+	}
+	return operands;
+}
+
+static u64 hash_instruction(IrFunction* function, IrInstruction* instruction)
+{
+	u64 hash = ((u64)instruction->opcode << 32) | (u64)instruction->data_type;
+
+	switch (instruction->opcode)
+	{
+		case IrOpcode_Constant:	hash ^= (u64)instruction->constant.data_u32 << 8; break;
+		case IrOpcode_Phi:		hash ^= (u64)instruction->block << 8; break;
+		case IrOpcode_Call:		hash ^= (u64)instruction->call.function_index << 8; break;
+	}
+
+	IrValue swapped[2];
+	i32 operand_count;
+	IrValue* operands = get_key_operands(function, instruction, swapped, &operand_count);
+	for (i32 i = 0; i < operand_count; ++i)
+	{
+		hash = (hash ^ (u64)operands[i]) * 0x9E3779B97F4A7C15ull;
+	}
+
+	return hash ^ (hash >> 29);
+}
+
+static b32 instructions_equal(IrFunction* function, IrInstruction* a, IrInstruction* b)
+{
+	if (a->opcode != b->opcode || a->data_type != b->data_type)
+	{
+		return false;
+	}
+
+	switch (a->opcode)
+	{
+		case IrOpcode_Constant:	return a->constant.data_u32 == b->constant.data_u32;
+		case IrOpcode_Phi:		if (a->block != b->block) { return false; } break;
+		case IrOpcode_Call:		if (a->call.function_index != b->call.function_index) { return false; } break;
+	}
+
+	IrValue swapped_a[2];
+	IrValue swapped_b[2];
+	i32 operand_count_a;
+	i32 operand_count_b;
+	IrValue* operands_a = get_key_operands(function, a, swapped_a, &operand_count_a);
+	IrValue* operands_b = get_key_operands(function, b, swapped_b, &operand_count_b);
+	if (operand_count_a != operand_count_b)
+	{
+		return false;
+	}
+	for (i32 i = 0; i < operand_count_a; ++i)
+	{
+		if (operands_a[i] != operands_b[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void number_block(NumberingContext* context, i32 block)
+{
+	IrFunction* function = context->function;
+	IrBlock* b = ir_get_block(function, block);
+
+	for (i64 i = 0; i < b->instructions.count; ++i)
+	{
+		IrValue value = b->instructions.items[i];
+		IrInstruction* instruction = ir_get_instruction(function, value);
+
+		// Operands dominate their uses, so they have been numbered already. The exception are phi operands coming
+		// around a back edge, which are rewritten once the walk is done.
+		i32 operand_count;
+		IrValue* operands = ir_get_operands(function, instruction, &operand_count);
+		for (i32 j = 0; j < operand_count; ++j)
+		{
+			if (context->replacement[operands[j]] != IR_NO_VALUE)
+			{
+				operands[j] = context->replacement[operands[j]];
+			}
+		}
+
+		if (!can_number(context, instruction))
+		{
+			continue;
+		}
+
+		u64 mask = context->slot_count - 1;
+		u64 slot = hash_instruction(function, instruction) & mask;
+		while (context->table[slot] != IR_NO_VALUE && !instructions_equal(function, ir_get_instruction(function, context->table[slot]), instruction))
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		if (context->table[slot] != IR_NO_VALUE)
+		{
+			context->replacement[value] = context->table[slot];
+			ir_remove_instruction(function, value);
+			++context->replaced_count;
+		}
+		else
+		{
+			context->table[slot] = value;
+			array_push(&context->added_slots, slot);
+		}
+	}
+}
+
+b32 number_values(IrProgram* ir, IrFunction* function, OptimizationStatistics* statistics)
+{
+	i64 block_count = function->blocks.count;
+	i64 instruction_count = function->instructions.count;
+
+	NumberingContext context = { .ir = ir, .function = function };
+
+	context.slot_count = 16;
+	while (context.slot_count < 2 * instruction_count)
+	{
+		context.slot_count *= 2;
+	}
+	context.table = malloc(sizeof(IrValue) * context.slot_count);
+	for (u64 i = 0; i < context.slot_count; ++i)
+	{
+		context.table[i] = IR_NO_VALUE;
+	}
+
+	context.replacement = malloc(sizeof(IrValue) * instruction_count);
+	for (i64 i = 0; i < instruction_count; ++i)
+	{
+		context.replacement[i] = IR_NO_VALUE;
+	}
+
+	i32* order = malloc(sizeof(i32) * block_count);
+	i32* immediate_dominators = malloc(sizeof(i32) * block_count);
+	i32 order_count = ir_compute_reverse_postorder(function, order);
+	ir_compute_dominators(function, order, order_count, immediate_dominators);
+
+	// Dominator tree as child lists.
+	i32* first_child = malloc(sizeof(i32) * block_count);
+	i32* next_sibling = malloc(sizeof(i32) * block_count);
+	for (i64 i = 0; i < block_count; ++i)
+	{
+		first_child[i] = -1;
+	}
+	for (i32 i = order_count - 1; i > 0; --i)
+	{
+		i32 block = order[i];
+		i32 parent = immediate_dominators[block];
+		next_sibling[block] = first_child[parent];
+		first_child[parent] = block;
+	}
+
+	// Depth first. Leaving a block is pushed as its complement, below its children.
+	i64* scope_start = malloc(sizeof(i64) * block_count);
+	i32* stack = malloc(sizeof(i32) * 2 * block_count);
+	i32 stack_count = 0;
+	stack[stack_count++] = order[0];
+
+	while (stack_count)
+	{
+		i32 entry = stack[--stack_count];
+		if (entry < 0)
+		{
+			i32 block = ~entry;
+			while (context.added_slots.count > scope_start[block])
+			{
+				context.table[context.added_slots.items[--context.added_slots.count]] = IR_NO_VALUE;
+			}
+			continue;
+		}
+
+		scope_start[entry] = context.added_slots.count;
+		number_block(&context, entry);
+
+		stack[stack_count++] = ~entry;
+		for (i32 child = first_child[entry]; child >= 0; child = next_sibling[child])
+		{
+			stack[stack_count++] = child;
+		}
+	}
+
+	if (context.replaced_count)
+	{
+		for (i64 i = 0; i < instruction_count; ++i)
+		{
+			i32 operand_count;
+			IrValue* operands = ir_get_operands(function, &function->instructions.items[i], &operand_count);
+			for (i32 j = 0; j < operand_count; ++j)
+			{
+				if (context.replacement[operands[j]] != IR_NO_VALUE)
+				{
+					operands[j] = context.replacement[operands[j]];
+				}
+			}
+		}
+		ir_compact_blocks(function);
+	}
+
+	statistics->removed_instructions += context.replaced_count;
+
+	free(stack);
+	free(scope_start);
+	free(next_sibling);
+	free(first_child);
+	free(immediate_dominators);
+	free(order);
+	free(context.replacement);
+	free(context.table);
+	array_free(&context.added_slots);
+
+	return context.replaced_count > 0;
+}